@@ -0,0 +1,332 @@
+/**
+Microbenchmarks for blitz11 access, iteration, layout and kernel paths,
+each next to a raw-pointer baseline doing the same work.
+
+Build (needs Google Benchmark), from the top of the tree:
+
+    cmake -S . -B build -DBLITZ11_BUILD_BENCHMARKS=ON
+    cmake --build build --target blitz11_bench
+    build/bench/blitz11_bench --benchmark_filter=Sum
+
+The benchmark is compiled with BLITZ11_BENCH_CXXFLAGS (default
+"-O3 -march=native -DNDEBUG"), which are also recorded in its output.
+
+For regression tracking against a stored baseline, see regress.py.
+
+Sizes are total elements, from L1-resident to DRAM-sized.  Layouts:
+row-major (C order), reversed (every stride negative) and column-major
+(Fortran order).  Throughput is reported as bytes_per_second over the
+bytes each kernel must touch.
+*/
+
+#include "blitz11.hpp"
+#include "blitz11_ops.hpp"
+#include "blitz11_layout.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <string>
+
+
+namespace {
+
+enum class Order { ROW, REVERSED, COLUMN };
+
+/** Extents of a rank-RANK cube with about n elements */
+template<int RANK>
+std::array<int, RANK> cube(int64_t const n)
+{
+    int const side = std::max(1, (int)std::lround(std::pow((double)n, 1.0 / RANK)));
+    std::array<int, RANK> ext;
+    ext.fill(side);
+    return ext;
+}
+
+/** Zero-based array of extents ext, in the given layout */
+template<class T, int RANK>
+Array<T, RANK> make_array(std::array<int, RANK> const &ext, Order const order)
+{
+    std::array<int, RANK> low;
+    low.fill(0);
+    std::vector<Dope<int>> dopes(row_major_dopes(&low[0], &ext[0], RANK));
+    if (order == Order::COLUMN) {
+        ptrdiff_t stride = 1;
+        for (int k=0; k<RANK; ++k) {
+            dopes[k].stride = stride;
+            stride *= ext[k];
+        }
+    } else if (order == Order::REVERSED) {
+        for (int k=0; k<RANK; ++k) dopes[k].stride = -dopes[k].stride;
+    }
+    Array<T, RANK> arr(allocate_block<T>(&dopes[0], RANK), dopes);
+    fill(arr, T(1));
+    return arr;
+}
+
+template<int RANK>
+int64_t count(std::array<int, RANK> const &ext)
+{
+    int64_t n = 1;
+    for (int k=0; k<RANK; ++k) n *= ext[k];
+    return n;
+}
+
+void sizes(benchmark::internal::Benchmark *b)
+{
+    b->RangeMultiplier(8)->Range(1 << 10, 1 << 24);
+}
+
+}    // namespace
+
+
+// ---------------------------------------------------------------
+// Element access through index() / operator(), row-major loop nest
+// (last index fastest) whatever the layout: strided for COLUMN
+
+template<class T, int RANK, Order ORDER>
+void BM_IndexAccess(benchmark::State &state)
+{
+    auto const ext(cube<RANK>(state.range(0)));
+    Array<T, RANK> const arr(make_array<T, RANK>(ext, ORDER));
+    for (auto _ : state) {
+        T s = 0;
+        std::array<int, RANK> ix;
+        ix.fill(0);
+        for (;;) {
+            for (ix[RANK-1]=0; ix[RANK-1]<ext[RANK-1]; ++ix[RANK-1]) s += arr(&ix[0]);
+            int k = RANK-2;
+            for (; k >= 0; --k) {
+                if (++ix[k] < ext[k]) break;
+                ix[k] = 0;
+            }
+            if (k < 0) break;
+        }
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetBytesProcessed(state.iterations() * count<RANK>(ext) * sizeof(T));
+}
+
+template<class T>
+void BM_RawAccess3(benchmark::State &state)
+{
+    auto const ext(cube<3>(state.range(0)));
+    std::vector<T> v(count<3>(ext), T(1));
+    T const * const p = v.data();
+    for (auto _ : state) {
+        T s = 0;
+        for (int i=0; i<ext[0]; ++i)
+            for (int j=0; j<ext[1]; ++j)
+                for (int k=0; k<ext[2]; ++k) s += p[(i*ext[1] + j)*ext[2] + k];
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetBytesProcessed(state.iterations() * count<3>(ext) * sizeof(T));
+}
+
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 1, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 1, Order::REVERSED)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 2, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 2, Order::COLUMN)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 3, Order::REVERSED)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, double, 3, Order::COLUMN)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_IndexAccess, float, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawAccess3, float)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawAccess3, double)->Apply(sizes);
+
+
+// ---------------------------------------------------------------
+// Whole-array iteration (sum) across ranks and layouts
+
+template<class T, int RANK, Order ORDER>
+void BM_Sum(benchmark::State &state)
+{
+    auto const ext(cube<RANK>(state.range(0)));
+    Array<T, RANK> const arr(make_array<T, RANK>(ext, ORDER));
+    for (auto _ : state) benchmark::DoNotOptimize(sum(arr));
+    state.SetBytesProcessed(state.iterations() * count<RANK>(ext) * sizeof(T));
+}
+
+template<class T, int RANK, Order ORDER>
+void BM_SumGeneral(benchmark::State &state)
+{
+    auto const ext(cube<RANK>(state.range(0)));
+    GeneralArray<T> const arr(make_array<T, RANK>(ext, ORDER));
+    for (auto _ : state) benchmark::DoNotOptimize(sum(arr));
+    state.SetBytesProcessed(state.iterations() * count<RANK>(ext) * sizeof(T));
+}
+
+template<class T>
+void BM_RawSum(benchmark::State &state)
+{
+    std::vector<T> v(state.range(0), T(1));
+    for (auto _ : state) {
+        T s = 0;
+        for (T const x : v) s += x;
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetBytesProcessed(state.iterations() * v.size() * sizeof(T));
+}
+
+BENCHMARK_TEMPLATE(BM_Sum, double, 1, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, double, 1, Order::REVERSED)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, double, 2, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, double, 2, Order::COLUMN)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, double, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, double, 3, Order::REVERSED)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, double, 3, Order::COLUMN)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Sum, float, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_SumGeneral, double, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawSum, float)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawSum, double)->Apply(sizes);
+
+
+// ---------------------------------------------------------------
+// Copies between layouts
+
+template<class T, Order SRC, Order DST>
+void BM_Copy3(benchmark::State &state)
+{
+    auto const ext(cube<3>(state.range(0)));
+    Array<T, 3> const src(make_array<T, 3>(ext, SRC));
+    Array<T, 3> const dst(make_array<T, 3>(ext, DST));
+    for (auto _ : state) {
+        copy(dst, src);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 2 * count<3>(ext) * sizeof(T));
+}
+
+template<class T>
+void BM_CopyToTiled3(benchmark::State &state)
+{
+    auto const ext(cube<3>(state.range(0)));
+    Array<T, 3> const src(make_array<T, 3>(ext, Order::ROW));
+    int const low[3] = {0, 0, 0};
+    int const tile[3] = {8, 8, 8};
+    auto const dst(TiledArray<T, 3>::allocate(low, &ext[0], tile));
+    for (auto _ : state) {
+        copy(dst, src);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 2 * count<3>(ext) * sizeof(T));
+}
+
+template<class T>
+void BM_CopyToMorton3(benchmark::State &state)
+{
+    auto const ext(cube<3>(state.range(0)));
+    Array<T, 3> const src(make_array<T, 3>(ext, Order::ROW));
+    int const low[3] = {0, 0, 0};
+    auto const dst(MortonArray<T, 3>::allocate(low, &ext[0]));
+    for (auto _ : state) {
+        copy(dst, src);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 2 * count<3>(ext) * sizeof(T));
+}
+
+template<class T>
+void BM_RawCopy(benchmark::State &state)
+{
+    std::vector<T> a(state.range(0), T(1)), b(state.range(0));
+    for (auto _ : state) {
+        std::copy(a.begin(), a.end(), b.begin());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 2 * a.size() * sizeof(T));
+}
+
+BENCHMARK_TEMPLATE(BM_Copy3, double, Order::ROW, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Copy3, double, Order::REVERSED, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Copy3, double, Order::COLUMN, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Copy3, float, Order::ROW, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_CopyToTiled3, double)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_CopyToMorton3, double)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawCopy, double)->Apply(sizes);
+
+
+// ---------------------------------------------------------------
+// Axis reductions
+
+template<class T>
+void BM_SumAxis3(benchmark::State &state)
+{
+    auto const ext(cube<3>(state.range(0)));
+    Array<T, 3> const arr(make_array<T, 3>(ext, Order::ROW));
+    int const axis = state.range(1);
+    for (auto _ : state) benchmark::DoNotOptimize(sum_axis(arr, axis).memory().data());
+    state.SetBytesProcessed(state.iterations() * count<3>(ext) * sizeof(T));
+}
+
+BENCHMARK_TEMPLATE(BM_SumAxis3, double)->ArgsProduct({
+    benchmark::CreateRange(1 << 12, 1 << 24, 64), {0, 1, 2}});
+
+
+// ---------------------------------------------------------------
+// Expression evaluation: c = a + s*b
+
+template<class T, int RANK, Order ORDER>
+void BM_Axpy(benchmark::State &state)
+{
+    auto const ext(cube<RANK>(state.range(0)));
+    Array<T, RANK> const a(make_array<T, RANK>(ext, ORDER));
+    Array<T, RANK> const b(make_array<T, RANK>(ext, ORDER));
+    Array<T, RANK> const c(make_array<T, RANK>(ext, Order::ROW));
+    T const s = 2;
+    for (auto _ : state) {
+        transform(c, a, b, [s](T const x, T const y) { return x + s*y; });
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 3 * count<RANK>(ext) * sizeof(T));
+}
+
+template<class T>
+void BM_RawAxpy(benchmark::State &state)
+{
+    std::vector<T> a(state.range(0), T(1)), b(state.range(0), T(1)), c(state.range(0));
+    T const s = 2;
+    for (auto _ : state) {
+        for (size_t i=0; i<c.size(); ++i) c[i] = a[i] + s*b[i];
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * 3 * c.size() * sizeof(T));
+}
+
+BENCHMARK_TEMPLATE(BM_Axpy, double, 1, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Axpy, double, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Axpy, double, 3, Order::REVERSED)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Axpy, double, 3, Order::COLUMN)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Axpy, float, 3, Order::ROW)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawAxpy, double)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RawAxpy, float)->Apply(sizes);
+
+
+// Compiler metadata goes into the JSON context, next to Google
+// Benchmark's host/CPU/cache description, so regress.py can tell when
+// a baseline came from a different toolchain.
+#ifndef BLITZ11_BENCH_FLAGS
+#define BLITZ11_BENCH_FLAGS ""
+#endif
+
+int main(int argc, char **argv)
+{
+#if defined(__clang__)
+    benchmark::AddCustomContext("compiler", "clang " __clang_version__);
+#elif defined(__GNUC__)
+    benchmark::AddCustomContext("compiler", "gcc " __VERSION__);
+#endif
+    benchmark::AddCustomContext("cplusplus", std::to_string(__cplusplus));
+    benchmark::AddCustomContext("cxxflags", BLITZ11_BENCH_FLAGS);
+#if defined(__AVX2__)
+    benchmark::AddCustomContext("simd", "avx2");
+#elif defined(__SSE2__)
+    benchmark::AddCustomContext("simd", "sse2");
+#endif
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""
+Regression runner for the blitz11 microbenchmarks (blitz11_bench.cpp).
+
+Runs the benchmark binary with JSON output, which carries Google
+Benchmark's host/CPU/cache description plus the compiler, flags and
+SIMD level recorded by blitz11_bench's main().  The results are
+compared against a stored baseline; any benchmark whose time grows by
+more than the threshold is reported and the exit status is 1.
+
+    # Record a baseline
+    ./regress.py run ./blitz11_bench -o baseline.json
+
+    # Later: run again and compare (exit 1 on regression)
+    ./regress.py check ./blitz11_bench baseline.json --threshold 0.10
+
+    # Compare two existing result files
+    ./regress.py compare baseline.json current.json
+
+With --repetitions > 1, the median over repetitions is compared, which
+is much less noisy than single runs.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+# Context keys that make timings incomparable when they differ
+CONTEXT_KEYS = ('host_name', 'num_cpus', 'mhz_per_cpu', 'compiler', 'cxxflags', 'simd',
+    'library_build_type')
+
+
+def run(binary, out, bench_filter=None, min_time=None, repetitions=1):
+    """Runs the benchmark binary, writing JSON results to out"""
+    cmd = [binary, '--benchmark_out=' + out, '--benchmark_out_format=json']
+    if bench_filter:
+        cmd.append('--benchmark_filter=' + bench_filter)
+    if min_time is not None:
+        cmd.append('--benchmark_min_time=%g' % min_time)
+    if repetitions > 1:
+        cmd += ['--benchmark_repetitions=%d' % repetitions,
+            '--benchmark_report_aggregates_only=true']
+    subprocess.run(cmd, check=True)
+    with open(out) as fin:
+        return json.load(fin)
+
+
+def times(results, metric):
+    """{benchmark name: time in ns}, preferring the median aggregate"""
+    scale = {'ns': 1., 'us': 1e3, 'ms': 1e6, 's': 1e9}
+    ret = {}
+    for b in results['benchmarks']:
+        if b.get('error_occurred'):
+            continue
+        name = b.get('run_name', b['name'])
+        kind = b.get('aggregate_name')
+        if kind not in (None, 'median'):
+            continue
+        if kind is None and name in ret:
+            continue    # A median already seen for this name wins
+        ret[name] = b[metric] * scale[b.get('time_unit', 'ns')]
+    return ret
+
+
+def context_diffs(base, cur):
+    diffs = []
+    for k in CONTEXT_KEYS:
+        a = base['context'].get(k)
+        b = cur['context'].get(k)
+        if a != b:
+            diffs.append('%s: %s -> %s' % (k, a, b))
+    return diffs
+
+
+def compare(base, cur, threshold, metric='cpu_time', out=sys.stdout):
+    """Prints a report; returns the list of regressed benchmark names"""
+    bt = times(base, metric)
+    ct = times(cur, metric)
+
+    for d in context_diffs(base, cur):
+        print('WARNING: context differs, %s' % d, file=out)
+
+    rows = []
+    for name in sorted(set(bt) & set(ct)):
+        ratio = ct[name] / bt[name] if bt[name] > 0 else float('inf')
+        rows.append((ratio, name, bt[name], ct[name]))
+    rows.sort(reverse=True)
+
+    regressed = [r for r in rows if r[0] > 1. + threshold]
+    improved = [r for r in rows if r[0] < 1. / (1. + threshold)]
+
+    def table(title, rs):
+        if not rs:
+            return
+        print('\n%s (%d):' % (title, len(rs)), file=out)
+        width = max(len(r[1]) for r in rs)
+        for ratio, name, b, c in rs:
+            print('  %-*s  %12.1f ns -> %12.1f ns  %+7.1f%%'
+                % (width, name, b, c, 100. * (ratio - 1.)), file=out)
+
+    table('Regressions beyond %.0f%%' % (100. * threshold), regressed)
+    table('Improvements', improved)
+
+    missing = sorted(set(bt) - set(ct))
+    added = sorted(set(ct) - set(bt))
+    if missing:
+        print('\nIn baseline only: %s' % ', '.join(missing), file=out)
+    if added:
+        print('\nNew (no baseline): %s' % ', '.join(added), file=out)
+
+    print('\n%d compared, %d regressed, %d improved (metric %s, threshold %.0f%%)'
+        % (len(rows), len(regressed), len(improved), metric, 100. * threshold), file=out)
+    return [r[1] for r in regressed]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='cmd', required=True)
+
+    def run_args(p):
+        p.add_argument('binary', help='blitz11_bench executable')
+        p.add_argument('--filter', help='--benchmark_filter regex')
+        p.add_argument('--min-time', type=float, help='--benchmark_min_time, seconds')
+        p.add_argument('--repetitions', type=int, default=1)
+
+    def compare_args(p):
+        p.add_argument('--threshold', type=float, default=0.10,
+            help='relative slowdown counted as a regression (default 0.10)')
+        p.add_argument('--metric', default='cpu_time', choices=('cpu_time', 'real_time'))
+
+    p = sub.add_parser('run', help='run and write JSON results')
+    run_args(p)
+    p.add_argument('-o', '--out', required=True)
+
+    p = sub.add_parser('check', help='run and compare against a baseline')
+    run_args(p)
+    compare_args(p)
+    p.add_argument('baseline')
+    p.add_argument('-o', '--out', help='also keep the new results here')
+
+    p = sub.add_parser('compare', help='compare two result files')
+    compare_args(p)
+    p.add_argument('baseline')
+    p.add_argument('current')
+
+    args = parser.parse_args()
+
+    if args.cmd == 'run':
+        run(args.binary, args.out, args.filter, args.min_time, args.repetitions)
+        return 0
+
+    with open(args.baseline) as fin:
+        base = json.load(fin)
+    if args.cmd == 'compare':
+        with open(args.current) as fin:
+            cur = json.load(fin)
+    else:
+        out = args.out
+        if out is None:
+            fd, out = tempfile.mkstemp(suffix='.json')
+            os.close(fd)
+        try:
+            cur = run(args.binary, out, args.filter, args.min_time, args.repetitions)
+        finally:
+            if args.out is None:
+                os.remove(out)
+
+    regressed = compare(base, cur, args.threshold, args.metric)
+    return 1 if regressed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -37,7 +37,32 @@ Nice-To-Have Features
 */
 
 
+#pragma once
+
 #include <type_traits>
+#include <functional>
+#include <string>
+#include <memory>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm>
+
+#if !defined(BLITZ11_NO_BACKTRACE) && defined(__has_include)
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#include <cstdlib>
+#define BLITZ11_HAVE_BACKTRACE 1
+#endif
+#endif
+
+#ifdef BLITZ11_MEMSTATS
+#include "blitz11_memstats.hpp"
+#endif
+#ifdef BLITZ11_ACCESS_PROFILE
+#include "blitz11_profile.hpp"
+#endif
 
 /** Transfers const qualification (if any) from DestT to SrcT;
 Eg:  transfer_const<double, char const>::type == double const
@@ -45,15 +70,98 @@ Eg:  transfer_const<double, char const>::type == double const
 */
 template<class DestT, class SrcT>
 struct transfer_const {
-    typedef std::conditional<
+    typedef typename std::conditional<
         std::is_const<SrcT>::value,
-            std::add_const<DestT>::type
-            std::remove_const<DestT>::type
-    > type;
+            typename std::add_const<DestT>::type,
+            typename std::remove_const<DestT>::type
+    >::type type;
 };
 
 typedef std::function<void (std::string const &type, int idim, long low, long high, long index)> RangeErrorFn;
 
+#if defined(__GNUC__)
+#define BLITZ11_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define BLITZ11_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define BLITZ11_UNLIKELY(x) (x)
+#define BLITZ11_COLD __declspec(noinline)
+#else
+#define BLITZ11_UNLIKELY(x) (x)
+#define BLITZ11_COLD
+#endif
+
+/** True if i is outside [low, high): one compare, predicted false */
+template<class T>
+inline bool out_of_bounds(T const i, T const low, T const high)
+{
+    typedef typename std::make_unsigned<T>::type U;
+    return BLITZ11_UNLIKELY((U)i - (U)low >= (U)std::max<T>(high - low, 0));
+}
+
+/**
+Bounds errors are raised through range_error_detail::raise(), which is
+kept out of line and marked cold, so a checked access costs one
+predicted branch per test and none of the std::function / std::string
+machinery unless it fails.  raise() records the calling thread's stack
+(where execinfo.h backtrace() is available; define BLITZ11_NO_BACKTRACE
+to skip it) before calling the RangeErrorFn, which can fetch it with
+range_error_backtrace().  throw_range_error() is a ready-made
+RangeErrorFn that throws std::out_of_range carrying the trace.
+*/
+namespace range_error_detail {
+
+inline std::vector<void *> &frames()
+{
+    static thread_local std::vector<void *> f;
+    return f;
+}
+
+BLITZ11_COLD inline void raise(RangeErrorFn const &fn,
+    char const *type, int idim, long low, long high, long index)
+{
+    std::vector<void *> &f(frames());
+#ifdef BLITZ11_HAVE_BACKTRACE
+    f.resize(64);
+    f.resize(::backtrace(&f[0], (int)f.size()));
+    if (!f.empty()) f.erase(f.begin());    // raise() itself
+#else
+    f.clear();
+#endif
+    fn(type, idim, low, high, index);
+}
+
+}    // namespace range_error_detail
+
+/** Stack at the calling thread's last bounds error, one frame per line
+(symbolized if possible); empty if backtraces are unavailable */
+inline std::string range_error_backtrace()
+{
+    std::string ret;
+#ifdef BLITZ11_HAVE_BACKTRACE
+    std::vector<void *> const &f(range_error_detail::frames());
+    if (f.empty()) return ret;
+    char ** const syms = ::backtrace_symbols(&f[0], (int)f.size());
+    for (size_t i=0; i<f.size(); ++i) {
+        if (syms) ret += syms[i];
+        ret += '\n';
+    }
+    std::free(syms);
+#endif
+    return ret;
+}
+
+/** RangeErrorFn that throws std::out_of_range, with the backtrace
+appended to what() */
+inline RangeErrorFn const *throw_range_error()
+{
+    static RangeErrorFn const fn([](std::string const &type, int idim, long low, long high, long index) {
+        throw std::out_of_range(type + " error: dimension " + std::to_string(idim)
+            + ", index " + std::to_string(index) + " outside [" + std::to_string(low)
+            + ", " + std::to_string(high) + ")\n" + range_error_backtrace());
+    });
+    return &fn;
+}
+
 // https://stackoverflow.com/questions/13061979/shared-ptr-to-an-array-should-it-be-used
 template< typename T >
 struct array_deleter
@@ -68,43 +176,94 @@ struct array_deleter
 /**
 Const handling: CharT is either char or const char.
 
+Copy-on-write: a block with copy_on_write() set clones its memory in
+detach() if that memory is shared with another MemoryBlock (or
+borrowed).  Code that may write into an array it was handed calls
+detach() once first, instead of defensively deep-copying.  Copies made
+after set_copy_on_write() inherit the flag; for full COW semantics,
+set it before sharing.  Detection is by shared_ptr::use_count(), so
+blocks shared across threads must be detached before they are shared.
+
 TODO: Add STL-standard Allocator support.
 TODO: char->std::byte for C++17 */
 template<class CharT>
 class MemoryBlock {
-    typedef transfer_const<char,ValueT>::type CharT;
-
     std::shared_ptr<CharT> _held;    // Memory we hold
 
-    CharT * _base;
+    CharT * _data;    // Start of the memory
+    CharT * _base;    // Origin (index diff 0); need not lie inside the memory
     size_t _size_bytes;
+    bool _cow;        // Copy-on-write
 
 public:
-    size_t const size_bytes() { return size_bytes; }
-    CharT *base() { return base(); }
+    size_t size_bytes() const { return _size_bytes; }
+    CharT *data() const { return _data; }
+    CharT *base() const { return _base; }
+    ptrdiff_t origin_bytes() const { return _base - _data; }
 
     /** Allocate our own memory to a particular size */
     MemoryBlock(size_t size_bytes) :
-        held(new CharT[size_bytes], array_deleter<CharT>()),
-        _base(held.get()),
-        _size_bytes(size_bytes) {}
+#ifdef BLITZ11_MEMSTATS
+        _held(memstats_detail::allocate<CharT>(size_bytes)),
+#else
+        _held(new typename std::remove_const<CharT>::type[size_bytes], array_deleter<CharT>()),
+#endif
+        _data(_held.get()), _base(_data),
+        _size_bytes(size_bytes), _cow(false) {}
 
     /** Use someone else's memory of a particular size */
     MemoryBlock(
         CharT * const base,
-        CharT const size_bytes)
-    : _base(base), _size_bytes(size_bytes) {}
+        size_t const size_bytes)
+    : _data(base), _base(base), _size_bytes(size_bytes), _cow(false) {}
 
+    /** Share memory already held by a shared_ptr with its own deleter
+    (eg: an mmap()ed file, or a boost::interprocess segment). */
+    MemoryBlock(
+        std::shared_ptr<CharT> const &held,
+        CharT * const base,
+        size_t const size_bytes)
+    : _held(held), _data(base), _base(base), _size_bytes(size_bytes), _cow(false) {}
+
+    /** Same memory, with the origin moved to data() + origin_bytes.
+    Used for arrays whose lowest index diff is not 0 (non-zero bases,
+    negative strides). */
+    MemoryBlock rebased(ptrdiff_t const origin_bytes) const
+    {
+        MemoryBlock ret(*this);
+        ret._base = _data + origin_bytes;
+        return ret;
+    }
+
+    bool copy_on_write() const { return _cow; }
+    void set_copy_on_write(bool const cow = true) { _cow = cow; }
+
+    /** True if detach() would clone */
+    bool needs_detach() const
+        { return _cow && (!_held || _held.use_count() > 1); }
+
+    /** In copy-on-write mode, replaces shared or borrowed memory with a
+    private clone (once; later calls are no-ops).  Returns true if it cloned. */
+    bool detach()
+    {
+        if (!needs_detach()) return false;
+        ptrdiff_t const origin = origin_bytes();
+        MemoryBlock clone(_size_bytes);
+        std::copy(_data, _data + _size_bytes, const_cast<char *>(clone._data));
+        clone._cow = true;
+        *this = clone.rebased(origin);
+        return true;
+    }
 
-private:
     /** Index into the MemoryBlock, by bytes, and possibly check ranges */
     inline CharT *index_bytes(ptrdiff_t const diff_bytes, RangeErrorFn const *range_error = nullptr) const
     {
         if (range_error) {
-            if (diff_bytes < 0 || diff_bytes >= size_bytes)
-                (*range_error)("Memory", 0, diff_bytes, 0, size_bytes);
+            ptrdiff_t const offset = origin_bytes() + diff_bytes;
+            if (BLITZ11_UNLIKELY((size_t)offset >= _size_bytes))    // Also catches offset < 0
+                range_error_detail::raise(*range_error, "Memory", 0, 0, _size_bytes, offset);
         }
-        return base + diff_bytes;
+        return _base + diff_bytes;
     }
 
 };
@@ -114,11 +273,11 @@ template<class IndexT>
 struct Dope {
     std::array<IndexT,2> range;    // [low, high)
     ptrdiff_t stride;
-}
+};
 
 template<class IndexT>
 inline ptrdiff_t index_diff(
-    Dope const * const dopes,
+    Dope<IndexT> const * const dopes,
     IndexT const * const index,
     int const rank,
     RangeErrorFn const * const range_error = nullptr)
@@ -126,47 +285,217 @@ inline ptrdiff_t index_diff(
     ptrdiff_t diff = 0;
     for (int i=0; i<rank; ++i) {
         if (range_error) {
-            if ((index[i] < dopes[i].range[0]) || (index[i] >= dopes[i].range[1]))
-                (*range_error)("Indexing", i, index[i], range[0], range[1]);
+            if (out_of_bounds(index[i], dopes[i].range[0], dopes[i].range[1]))
+                range_error_detail::raise(*range_error, "Indexing", i, dopes[i].range[0], dopes[i].range[1], index[i]);
         }
         diff += index[i] * dopes[i].stride;
     }
     return diff;
 }
 
+/** Smallest and largest index diffs reachable through a dope vector.
+Returns {0,-1} if any dimension is empty. */
+template<class IndexT>
+std::array<ptrdiff_t,2> diff_range(Dope<IndexT> const * const dopes, int const rank)
+{
+    std::array<ptrdiff_t,2> ret = {{0, 0}};
+    for (int i=0; i<rank; ++i) {
+        if (dopes[i].range[1] <= dopes[i].range[0]) return {{0, -1}};
+        ptrdiff_t const a = dopes[i].range[0] * dopes[i].stride;
+        ptrdiff_t const b = (dopes[i].range[1]-1) * dopes[i].stride;
+        ret[0] += std::min(a, b);
+        ret[1] += std::max(a, b);
+    }
+    return ret;
+}
+
+/** Dopes for a dense array over [low, high), last dimension varying
+fastest (C order). */
+template<class IndexT>
+std::vector<Dope<IndexT>> row_major_dopes(IndexT const * const low, IndexT const * const high, int const rank)
+{
+    std::vector<Dope<IndexT>> dopes(rank);
+    ptrdiff_t stride = 1;
+    for (int i=rank-1; i>=0; --i) {
+        dopes[i].range[0] = low[i];
+        dopes[i].range[1] = high[i];
+        dopes[i].stride = stride;
+        stride *= std::max<ptrdiff_t>(0, high[i] - low[i]);
+    }
+    return dopes;
+}
+
+/** Maps positions to index diffs.  An element's position is its rank
+in row-major order over the array's index box (position 0 is the
+element at the lower bounds), whatever the array's Dope layout.  This
+reduces to one multiply when the layout is affine in position (dense
+row-major, or any 1-D stride); otherwise the position is decomposed
+dimension by dimension. */
+template<class IndexT>
+class PositionMap {
+    std::vector<ptrdiff_t> _extent, _stride;
+    ptrdiff_t _low_diff;    // Index diff of position 0
+    size_t _size;
+    bool _affine;           // diff(pos) == _low_diff + pos*_affine_stride
+    ptrdiff_t _affine_stride;
+
+public:
+    PositionMap(std::vector<Dope<IndexT>> const &dopes)
+        : _low_diff(0), _size(1), _affine(true), _affine_stride(1)
+    {
+        for (auto const &d : dopes) {
+            ptrdiff_t const n = std::max<ptrdiff_t>(0, d.range[1] - d.range[0]);
+            _extent.push_back(n);
+            _stride.push_back(d.stride);
+            _low_diff += d.range[0] * d.stride;
+            _size *= n;
+        }
+
+        // Affine if the non-trivial dimensions nest like row-major
+        int inner = -1;
+        for (int k=(int)dopes.size()-1; k>=0; --k) {
+            if (_extent[k] == 1) continue;
+            if (inner < 0) _affine_stride = _stride[k];
+            else if (_stride[k] != _stride[inner] * _extent[inner]) _affine = false;
+            inner = k;
+        }
+    }
+
+    size_t size() const { return _size; }
+    bool affine() const { return _affine; }
+    ptrdiff_t affine_stride() const { return _affine_stride; }
+    ptrdiff_t low_diff() const { return _low_diff; }
+
+    ptrdiff_t diff(size_t pos) const
+    {
+        if (_affine) return _low_diff + (ptrdiff_t)pos * _affine_stride;
+        ptrdiff_t d = _low_diff;
+        for (int k=(int)_extent.size()-1; k>=0; --k) {
+            d += (ptrdiff_t)(pos % _extent[k]) * _stride[k];
+            pos /= _extent[k];
+        }
+        return d;
+    }
+};
+
+/** Allocates a MemoryBlock just big enough for the elements reachable
+through dopes, with its origin set accordingly. */
+template<class ValueT, class IndexT>
+MemoryBlock<typename transfer_const<char, ValueT>::type> allocate_block(
+    Dope<IndexT> const * const dopes, int const rank)
+{
+    std::array<ptrdiff_t,2> const diffs(diff_range(dopes, rank));
+    MemoryBlock<typename transfer_const<char, ValueT>::type> memory(
+        (diffs[1] - diffs[0] + 1) * sizeof(ValueT));
+    return memory.rebased(-diffs[0] * (ptrdiff_t)sizeof(ValueT));
+}
+
+/** Copies a box of extent[] elements between two strided layouts.
+dst and src point at the first element of the box; strides are in
+elements.  Dimension rank-1 is the inner loop. */
+template<class DestT, class SrcT, class IndexT>
+void copy_strided(
+    int const rank,
+    IndexT const * const extent,
+    DestT * const dst, ptrdiff_t const * const dst_strides,
+    SrcT * const src, ptrdiff_t const * const src_strides)
+{
+    if (rank == 0) {
+        *dst = *src;
+        return;
+    }
+    for (int i=0; i<rank; ++i) if (extent[i] <= 0) return;
+
+    std::vector<IndexT> ix(rank, 0);
+    DestT *d = dst;
+    SrcT *s = src;
+    IndexT const n = extent[rank-1];
+    ptrdiff_t const ds = dst_strides[rank-1];
+    ptrdiff_t const ss = src_strides[rank-1];
+    for (;;) {
+        if (ss == 0) {    // Broadcast source: one load per row
+            SrcT const v = *s;
+            for (IndexT j=0; j<n; ++j) d[j*ds] = v;
+        } else {
+            for (IndexT j=0; j<n; ++j) d[j*ds] = s[j*ss];
+        }
+
+        // Odometer over the outer dimensions
+        int k = rank-2;
+        for (; k >= 0; --k) {
+            d += dst_strides[k];
+            s += src_strides[k];
+            if (++ix[k] < extent[k]) break;
+            d -= extent[k] * dst_strides[k];
+            s -= extent[k] * src_strides[k];
+            ix[k] = 0;
+        }
+        if (k < 0) break;
+    }
+}
+
 template<class ValueT, class IndexT>
 inline ValueT &index(
     MemoryBlock<typename transfer_const<char, ValueT>::type> const &memory,
-    Dope const * const dopes,
+    Dope<IndexT> const * const dopes,
     IndexT const * const index,
     int const rank,
     RangeErrorFn const * const range_error = nullptr)
 {
     typedef typename transfer_const<char, ValueT>::type CharT;
 
+#ifdef BLITZ11_ACCESS_PROFILE
+    profile_detail::record(memory.data(), dopes, index, rank, sizeof(ValueT));
+#endif
     ptrdiff_t const diff = index_diff(dopes, index, rank, range_error);
-    CharT * const loc = memory.index_bytes(diff*sizeof(ValueT), range_error);
+    CharT * const loc = memory.index_bytes(diff*(ptrdiff_t)sizeof(ValueT), range_error);
     ValueT * const vloc = reinterpret_cast<ValueT *>(loc);    // same constness
     return *vloc;
 }
 
 
 // ---------------------------------------------------------------
+template<class ValueT, int RANK, class IndexT>
+class Array;
+
 template<class ValueT, class IndexT=int>    // ValueT = double, const double, etc.
 class GeneralArray {
-    typedef transfer_const<char, ValueT>::type CharT;
+    typedef typename transfer_const<char, ValueT>::type CharT;
+    template<class V, int R, class I> friend class Array;
 
     MemoryBlock<CharT> _memory;    // Like a shared_ptr
     std::vector<Dope<IndexT>> _dopes;
 
 public:
+    GeneralArray(MemoryBlock<CharT> const &memory, std::vector<Dope<IndexT>> const &dopes)
+        : _memory(memory), _dopes(dopes) {}
+
+    /** Same array, rank known only at runtime; shares the memory block.
+    The dope vector is copied, which allocates; convert from an rvalue
+    to avoid that. */
+    template<int RANK>
+    GeneralArray(Array<ValueT, RANK, IndexT> const &arr)
+        : _memory(arr._memory), _dopes(arr._dopes) {}
+
+    /** Takes over an Array's memory and dope storage; no allocation */
+    template<int RANK>
+    GeneralArray(Array<ValueT, RANK, IndexT> &&arr)
+        : _memory(std::move(arr._memory)), _dopes(std::move(arr._dopes)) {}
+
+    MemoryBlock<CharT> const &memory() const { return _memory; }
+    std::vector<Dope<IndexT>> const &dopes() const { return _dopes; }
+
     int rank() const { return _dopes.size(); }
 
-    ValueT &operator[](IndexT const *index, RangeErrorFn const * const range_error=nullptr) const
-        { return index(_memory, &_dopes[0], index, rank(), range_error); }
+    /** See MemoryBlock::detach() */
+    bool detach() { return _memory.detach(); }
+    void set_copy_on_write(bool const cow = true) { _memory.set_copy_on_write(cow); }
+
+    ValueT &operator()(IndexT const *ix, RangeErrorFn const * const range_error=nullptr) const
+        { return index<ValueT>(_memory, &_dopes[0], ix, rank(), range_error); }
 
-    ValueT &operator[](std::vector<IndexT> const &index, RangeErrorFn const * const range_error=nullptr) const
-        { return index(_memory, &_dopes[0], &index[0], rank(), range_error); }
+    ValueT &operator()(std::vector<IndexT> const &ix, RangeErrorFn const * const range_error=nullptr) const
+        { return index<ValueT>(_memory, &_dopes[0], &ix[0], rank(), range_error); }
 
 
 };
@@ -175,26 +504,292 @@ public:
 template<class ValueT, int RANK, class IndexT=int>    // ValueT = double, const double, etc.
 class Array {
     typedef typename transfer_const<char, ValueT>::type CharT;
+    friend class GeneralArray<ValueT, IndexT>;
 
     MemoryBlock<CharT> _memory;    // Like a shared_ptr
     std::vector<Dope<IndexT>> _dopes;
 
+    static GeneralArray<ValueT, IndexT> &checked_rank(GeneralArray<ValueT, IndexT> &arr)
+    {
+        if (arr._dopes.size() != RANK)
+            throw std::invalid_argument("Array: GeneralArray has the wrong rank");
+        return arr;
+    }
+
 public:
+    Array(MemoryBlock<CharT> const &memory, std::vector<Dope<IndexT>> const &dopes)
+        : _memory(memory), _dopes(dopes)
+    {
+        if (_dopes.size() != RANK)
+            throw std::invalid_argument("Array: wrong number of dopes for RANK");
+    }
+
+    /** Same array with its rank checked against RANK; shares the memory
+    block.  Throws std::invalid_argument if the ranks differ.  The dope
+    vector is copied, which allocates; convert from an rvalue to avoid
+    that. */
+    explicit Array(GeneralArray<ValueT, IndexT> const &arr)
+        : Array(arr._memory, arr._dopes) {}
+
+    /** Takes over a GeneralArray's memory and dope storage; no
+    allocation.  On a rank mismatch arr is left unchanged. */
+    explicit Array(GeneralArray<ValueT, IndexT> &&arr)
+        : _memory(std::move(checked_rank(arr)._memory)), _dopes(std::move(arr._dopes)) {}
+
+    MemoryBlock<CharT> const &memory() const { return _memory; }
+    std::vector<Dope<IndexT>> const &dopes() const { return _dopes; }
+
     int rank() const { return RANK; }
 
-    ValueT &operator[](IndexT const * const index, RangeErrorFn const * const range_error=nullptr) const
-        { return index(_memory, &_dopes[0], index, rank(), range_error); }
+    /** See MemoryBlock::detach() */
+    bool detach() { return _memory.detach(); }
+    void set_copy_on_write(bool const cow = true) { _memory.set_copy_on_write(cow); }
+
+    ValueT &operator()(IndexT const * const ix, RangeErrorFn const * const range_error=nullptr) const
+        { return index<ValueT>(_memory, &_dopes[0], ix, rank(), range_error); }
 
 };
 
 
+// ---------------------------------------------------------------
+// Broadcasting (stride-0 dimensions)
+
+/** Dopes of a broadcast view over [low, high) (out_rank dimensions).
+Dimension k of the source becomes dimension axes[k] of the view; if
+axes is nullptr, the source's dimensions are aligned with the view's
+trailing dimensions (as in NumPy).  A source dimension must have the
+view's extent or extent 1; extent-1 and new dimensions get stride 0.
+Index low[j] of the view maps to the source's lower bound.
+
+@param shift_diff Returns the index diff to add to the source's origin
+@return Dopes of the view */
+template<class IndexT>
+std::vector<Dope<IndexT>> broadcast_dopes(
+    Dope<IndexT> const * const dopes, int const rank,
+    IndexT const * const low, IndexT const * const high, int const out_rank,
+    int const * const axes, ptrdiff_t &shift_diff)
+{
+    if (rank > out_rank)
+        throw std::invalid_argument("broadcast: view has lower rank than the array");
+
+    std::vector<Dope<IndexT>> out(out_rank);
+    for (int j=0; j<out_rank; ++j) {
+        out[j].range = {{low[j], high[j]}};
+        out[j].stride = 0;
+    }
+
+    shift_diff = 0;
+    std::vector<bool> used(out_rank, false);
+    for (int k=0; k<rank; ++k) {
+        int const j = (axes ? axes[k] : out_rank - rank + k);
+        if (j < 0 || j >= out_rank || used[j])
+            throw std::invalid_argument("broadcast: bad axis mapping");
+        used[j] = true;
+
+        IndexT const extent = dopes[k].range[1] - dopes[k].range[0];
+        if (extent == high[j] - low[j]) {
+            out[j].stride = dopes[k].stride;
+            shift_diff += (dopes[k].range[0] - low[j]) * dopes[k].stride;
+        } else if (extent == 1) {
+            shift_diff += dopes[k].range[0] * dopes[k].stride;
+        } else {
+            throw std::invalid_argument("broadcast: dimension " + std::to_string(k)
+                + " has extent " + std::to_string(extent) + ", not 1 or "
+                + std::to_string(high[j] - low[j]));
+        }
+    }
+    return out;
+}
+
+/** Read view of arr broadcast to [low, high); no data is copied.  See
+broadcast_dopes().  Many view elements share one memory location, so
+writing through the view writes the source element. */
+template<int OUT_RANK, class ValueT, int RANK, class IndexT>
+Array<ValueT, OUT_RANK, IndexT> broadcast(
+    Array<ValueT, RANK, IndexT> const &arr,
+    IndexT const * const low, IndexT const * const high,
+    int const * const axes = nullptr)
+{
+    ptrdiff_t shift_diff;
+    std::vector<Dope<IndexT>> dopes(broadcast_dopes(
+        &arr.dopes()[0], RANK, low, high, OUT_RANK, axes, shift_diff));
+    return Array<ValueT, OUT_RANK, IndexT>(arr.memory().rebased(
+        arr.memory().origin_bytes() + shift_diff * (ptrdiff_t)sizeof(ValueT)), dopes);
+}
+
+template<class ValueT, class IndexT>
+GeneralArray<ValueT, IndexT> broadcast(
+    GeneralArray<ValueT, IndexT> const &arr,
+    IndexT const * const low, IndexT const * const high, int const out_rank,
+    int const * const axes = nullptr)
+{
+    ptrdiff_t shift_diff;
+    std::vector<Dope<IndexT>> dopes(broadcast_dopes(
+        &arr.dopes()[0], arr.rank(), low, high, out_rank, axes, shift_diff));
+    return GeneralArray<ValueT, IndexT>(arr.memory().rebased(
+        arr.memory().origin_bytes() + shift_diff * (ptrdiff_t)sizeof(ValueT)), dopes);
+}
+
 
 // ---------------------------------------------------------------
+// Compile-time layouts (mdspan-style static extents and strides)
+
+/** A dimension whose range [LOW, HIGH) and stride are compile-time
+constants; it takes no dope storage, and its term of index_diff()
+constant-folds. */
+template<long LOW, long HIGH, ptrdiff_t STRIDE>
+struct StaticDim {
+    static constexpr bool is_static = true;
+};
+
+/** A dimension whose layout is only known at runtime, held in a Dope */
+struct DynamicDim {
+    static constexpr bool is_static = false;
+};
+
+template<class... DimTs>
+struct count_dynamic;
+
+template<>
+struct count_dynamic<> { static constexpr int value = 0; };
+
+template<class DimT, class... Rest>
+struct count_dynamic<DimT, Rest...> {
+    static constexpr int value = (DimT::is_static ? 0 : 1) + count_dynamic<Rest...>::value;
+};
 
+/** index_diff() unrolled over a list of StaticDim / DynamicDim.
+I = current dimension; D = next slot in the dynamic dopes. */
+template<class IndexT, int I, int D, class... DimTs>
+struct static_layout;
 
+template<class IndexT, int I, int D>
+struct static_layout<IndexT, I, D> {
+    static ptrdiff_t index_diff(Dope<IndexT> const *, IndexT const *, RangeErrorFn const *)
+        { return 0; }
+
+    static void dopes(Dope<IndexT> const *, Dope<IndexT> *) {}
+};
+
+template<class IndexT, int I, int D, long LOW, long HIGH, ptrdiff_t STRIDE, class... Rest>
+struct static_layout<IndexT, I, D, StaticDim<LOW, HIGH, STRIDE>, Rest...> {
+    static ptrdiff_t index_diff(Dope<IndexT> const *dynamic, IndexT const *index, RangeErrorFn const *range_error)
+    {
+        if (range_error) {
+            if (out_of_bounds<long>(index[I], LOW, HIGH))
+                range_error_detail::raise(*range_error, "Indexing", I, LOW, HIGH, index[I]);
+        }
+        return index[I] * STRIDE
+            + static_layout<IndexT, I+1, D, Rest...>::index_diff(dynamic, index, range_error);
+    }
+
+    static void dopes(Dope<IndexT> const *dynamic, Dope<IndexT> *out)
+    {
+        out[I].range[0] = LOW;
+        out[I].range[1] = HIGH;
+        out[I].stride = STRIDE;
+        static_layout<IndexT, I+1, D, Rest...>::dopes(dynamic, out);
+    }
+};
+
+template<class IndexT, int I, int D, class... Rest>
+struct static_layout<IndexT, I, D, DynamicDim, Rest...> {
+    static ptrdiff_t index_diff(Dope<IndexT> const *dynamic, IndexT const *index, RangeErrorFn const *range_error)
+    {
+        if (range_error) {
+            if (out_of_bounds(index[I], dynamic[D].range[0], dynamic[D].range[1]))
+                range_error_detail::raise(*range_error, "Indexing", I, dynamic[D].range[0], dynamic[D].range[1], index[I]);
+        }
+        return index[I] * dynamic[D].stride
+            + static_layout<IndexT, I+1, D+1, Rest...>::index_diff(dynamic, index, range_error);
+    }
+
+    static void dopes(Dope<IndexT> const *dynamic, Dope<IndexT> *out)
+    {
+        out[I] = dynamic[D];
+        static_layout<IndexT, I+1, D+1, Rest...>::dopes(dynamic, out);
+    }
+};
+
+/** Dopes of the dynamic dimensions; empty (via EBO) if there are none */
+template<class IndexT, int N>
+struct DynamicDopes {
+    std::array<Dope<IndexT>, N> _dynamic;
+
+    DynamicDopes(std::array<Dope<IndexT>, N> const &dynamic) : _dynamic(dynamic) {}
+    Dope<IndexT> const *dynamic_dopes() const { return &_dynamic[0]; }
+};
+
+template<class IndexT>
+struct DynamicDopes<IndexT, 0> {
+    DynamicDopes(std::array<Dope<IndexT>, 0> const &) {}
+    Dope<IndexT> const *dynamic_dopes() const { return nullptr; }
+};
+
+/** Array whose layout is given per dimension as StaticDim (compile-time,
+no storage) or DynamicDim (runtime Dope).  Eg, a 4x4 row-major stencil:
+    StaticArray<double, int, StaticDim<0,4,4>, StaticDim<0,4,1>>
+or a field of 3-vectors with a runtime-sized outer dimension:
+    StaticArray<double, int, DynamicDim, StaticDim<0,3,1>> */
+template<class ValueT, class IndexT, class... DimTs>    // ValueT = double, const double, etc.
+class StaticArray : private DynamicDopes<IndexT, count_dynamic<DimTs...>::value> {
+    typedef typename transfer_const<char, ValueT>::type CharT;
+    typedef static_layout<IndexT, 0, 0, DimTs...> Layout;
+
+public:
+    static constexpr int RANK = sizeof...(DimTs);
+    static constexpr int NDYNAMIC = count_dynamic<DimTs...>::value;
+
+private:
+    typedef DynamicDopes<IndexT, NDYNAMIC> Dynamic;
+    MemoryBlock<CharT> _memory;    // Like a shared_ptr
+
+public:
+    /** @param dynamic Dopes of the DynamicDim dimensions, in order */
+    StaticArray(MemoryBlock<CharT> const &memory,
+        std::array<Dope<IndexT>, NDYNAMIC> const &dynamic = std::array<Dope<IndexT>, NDYNAMIC>())
+    : Dynamic(dynamic), _memory(memory) {}
+
+    /** Allocates a dense block for this layout */
+    static StaticArray allocate(
+        std::array<Dope<IndexT>, NDYNAMIC> const &dynamic = std::array<Dope<IndexT>, NDYNAMIC>())
+    {
+        std::array<Dope<IndexT>, RANK> all;
+        Layout::dopes(dynamic.data(), all.data());
+        return StaticArray(allocate_block<ValueT>(all.data(), RANK), dynamic);
+    }
+
+    MemoryBlock<CharT> const &memory() const { return _memory; }
+
+    /** Full dope vector, static dimensions included */
+    std::vector<Dope<IndexT>> dopes() const
+    {
+        std::vector<Dope<IndexT>> ret(RANK);
+        Layout::dopes(this->dynamic_dopes(), ret.data());
+        return ret;
+    }
+
+    int rank() const { return RANK; }
+
+    /** The same data as an ordinary (runtime-layout) Array */
+    Array<ValueT, RANK, IndexT> array() const
+        { return Array<ValueT, RANK, IndexT>(_memory, dopes()); }
+
+    ValueT &operator()(IndexT const * const ix, RangeErrorFn const * const range_error=nullptr) const
+    {
+        ptrdiff_t const diff = Layout::index_diff(this->dynamic_dopes(), ix, range_error);
+        CharT * const loc = _memory.index_bytes(diff*(ptrdiff_t)sizeof(ValueT), range_error);
+        return *reinterpret_cast<ValueT *>(loc);
+    }
+};
+
+
+
+// ---------------------------------------------------------------
 
 
 
+#if 0    // Earlier sketch
 class Dim {
     std::array<int,2> bound;
     size_t stride;
@@ -205,3 +800,4 @@ template<class TypeT, int RANK>
 class Array {
     std::shared_ptr<> mem;
 };
+#endif
@@ -0,0 +1,80 @@
+/**
+Zero-copy adapters between blitz11 arrays and Blitz++ arrays.
+
+to_blitz() wraps an Array's memory in a blitz::Array with
+neverDeleteData, keeping bases and strides (negative included).  The
+blitz::Array does not keep the memory alive; the Array's memory must
+outlive it.  Blitz++ has no const element type, so only arrays of
+non-const ValueT can be wrapped.
+
+from_blitz() borrows a blitz::Array's storage as an Array, likewise
+keeping bases and strides.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <blitz/array.h>
+
+
+/** Wraps an Array as a blitz::Array over the same memory */
+template<class ValueT, int RANK, class IndexT>
+blitz::Array<ValueT, RANK> to_blitz(Array<ValueT, RANK, IndexT> const &arr)
+{
+    static_assert(!std::is_const<ValueT>::value,
+        "to_blitz: Blitz++ arrays cannot hold const elements");
+
+    std::vector<Dope<IndexT>> const &dopes(arr.dopes());
+    blitz::TinyVector<int, RANK> shape, base;
+    blitz::TinyVector<blitz::diffType, RANK> stride;
+    ptrdiff_t low_diff = 0;
+    for (int k=0; k<RANK; ++k) {
+        base(k) = dopes[k].range[0];
+        shape(k) = std::max<IndexT>(0, dopes[k].range[1] - dopes[k].range[0]);
+        stride(k) = dopes[k].stride;
+        low_diff += dopes[k].range[0] * dopes[k].stride;
+    }
+
+    // With the default (ascending, 0-based) storage, dataFirst is the
+    // element at index 0; reindexSelf() then moves the bases.
+    ValueT * const first = reinterpret_cast<ValueT *>(arr.memory().base()) + low_diff;
+    blitz::Array<ValueT, RANK> ret(first, shape, stride, blitz::neverDeleteData);
+    ret.reindexSelf(base);
+    return ret;
+}
+
+
+namespace blitz_detail {
+
+template<class ElementT, int RANK, class IndexT, class T>
+Array<ElementT, RANK, IndexT> from_blitz(blitz::Array<T, RANK> const &b)
+{
+    typedef typename transfer_const<char, ElementT>::type CharT;
+
+    std::vector<Dope<IndexT>> dopes(RANK);
+    for (int k=0; k<RANK; ++k) {
+        dopes[k].range = {{(IndexT)b.lbound(k), (IndexT)(b.ubound(k) + 1)}};
+        dopes[k].stride = b.stride(k);
+    }
+
+    // dataZero() is the (possibly out-of-bounds) address of index 0
+    ElementT * const origin = const_cast<T *>(b.dataZero());
+    std::array<ptrdiff_t,2> const diffs(diff_range(&dopes[0], RANK));
+    ptrdiff_t const first = diffs[0] * (ptrdiff_t)sizeof(ElementT);
+    MemoryBlock<CharT> memory(reinterpret_cast<CharT *>(origin) + first,
+        (diffs[1] - diffs[0] + 1) * sizeof(ElementT));
+    return Array<ElementT, RANK, IndexT>(memory.rebased(-first), dopes);
+}
+
+}    // namespace blitz_detail
+
+/** Borrows a blitz::Array's storage as an Array */
+template<class IndexT = int, class T, int RANK>
+Array<T, RANK, IndexT> from_blitz(blitz::Array<T, RANK> &b)
+    { return blitz_detail::from_blitz<T, RANK, IndexT>(b); }
+
+/** Borrows a const blitz::Array's storage as a read-only Array */
+template<class IndexT = int, class T, int RANK>
+Array<T const, RANK, IndexT> from_blitz(blitz::Array<T, RANK> const &b)
+    { return blitz_detail::from_blitz<T const, RANK, IndexT>(b); }
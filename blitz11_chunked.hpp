@@ -0,0 +1,551 @@
+/**
+Chunked, compressed array storage.
+
+An array is tiled by a user-chosen chunk shape; each chunk is stored
+row-major, optionally byte-shuffled, and compressed independently.
+Chunks are compressed and decompressed in parallel (parallel_for(),
+which starts its threads for each call; there is no persistent pool),
+and a partial read only decompresses the chunks intersecting the
+requested slab.
+
+File format (native byte order):
+
+    ChunkedFileHeader           64 bytes
+    ChunkedFileDim[rank]        24 bytes each
+    chunk data                  in whatever order the writers finished
+    ChunkEntry[nchunks]         at table_offset; chunks in row-major order
+
+Codecs are optional libraries, enabled by defining BLITZ11_USE_ZSTD
+and/or BLITZ11_USE_LZ4 (and linking -lzstd / -llz4).  ChunkCodec::NONE
+(shuffle only) is always available.  A chunk that does not compress is
+stored raw; that is recognized on read by nbytes == uncompressed size.
+*/
+
+#pragma once
+
+#include "blitz11_io.hpp"
+#include "blitz11_parallel.hpp"
+
+#ifdef BLITZ11_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef BLITZ11_USE_LZ4
+#include <lz4.h>
+#endif
+
+
+enum class ChunkCodec : uint8_t { NONE = 0, ZSTD = 1, LZ4 = 2 };
+
+inline bool codec_available(ChunkCodec const codec)
+{
+    switch(codec) {
+        case ChunkCodec::NONE : return true;
+#ifdef BLITZ11_USE_ZSTD
+        case ChunkCodec::ZSTD : return true;
+#endif
+#ifdef BLITZ11_USE_LZ4
+        case ChunkCodec::LZ4 : return true;
+#endif
+        default : return false;
+    }
+}
+
+/** Best codec compiled in */
+inline ChunkCodec default_chunk_codec()
+{
+#if defined(BLITZ11_USE_ZSTD)
+    return ChunkCodec::ZSTD;
+#elif defined(BLITZ11_USE_LZ4)
+    return ChunkCodec::LZ4;
+#else
+    return ChunkCodec::NONE;
+#endif
+}
+
+struct ChunkOptions {
+    ChunkCodec codec;
+    int level;       // Codec-specific compression level; 0 = codec default
+    bool shuffle;    // Byte-shuffle each chunk before compressing
+    int nthreads;    // <= 0: default_nthreads()
+
+    ChunkOptions() :
+        codec(default_chunk_codec()), level(0), shuffle(true), nthreads(0) {}
+};
+
+
+uint32_t const CHUNKEDFILE_VERSION = 1;
+
+struct ChunkedFileHeader {
+    char magic[8];          // "BLITZ11C"
+    uint32_t byte_order;    // BLOCKFILE_BYTE_ORDER
+    uint32_t version;
+    char dtype_kind;        // See dtype_traits
+    uint8_t codec;          // ChunkCodec
+    uint8_t shuffle;
+    uint8_t pad0;
+    uint32_t dtype_size;
+    uint32_t rank;
+    uint32_t pad1;
+    uint64_t nchunks;
+    uint64_t table_offset;  // Location of ChunkEntry[nchunks]
+    uint64_t reserved[2];
+};
+static_assert(sizeof(ChunkedFileHeader) == 64, "ChunkedFileHeader must be 64 bytes");
+
+struct ChunkedFileDim {
+    int64_t low, high;      // Index range of the whole array
+    int64_t chunk;          // Chunk extent in this dimension
+};
+static_assert(sizeof(ChunkedFileDim) == 24, "ChunkedFileDim must be 24 bytes");
+
+struct ChunkEntry {
+    uint64_t offset;        // Start of the compressed chunk in the file
+    uint64_t nbytes;        // Compressed size
+};
+
+
+/** Header, dimensions and chunk table of a chunked file */
+struct ChunkedFileInfo {
+    ChunkedFileHeader header;
+    std::vector<ChunkedFileDim> dims;
+    std::vector<ChunkEntry> table;
+
+    int rank() const { return dims.size(); }
+
+    /** Number of chunks along dimension i */
+    int64_t nchunks(int const i) const
+    {
+        int64_t const n = dims[i].high - dims[i].low;
+        return n / dims[i].chunk + (n % dims[i].chunk != 0);
+    }
+
+    /** Index box [low, high) covered by the chunk at chunk-grid position cix */
+    void chunk_box(int64_t const *cix, int64_t *low, int64_t *high) const
+    {
+        for (int i=0; i<rank(); ++i) {
+            low[i] = dims[i].low + cix[i] * dims[i].chunk;
+            high[i] = low[i] + std::min(dims[i].chunk, dims[i].high - low[i]);
+        }
+    }
+
+    /** Row-major linear chunk number of chunk-grid position cix */
+    size_t chunk_number(int64_t const *cix) const
+    {
+        size_t n = 0;
+        for (int i=0; i<rank(); ++i) n = n*nchunks(i) + cix[i];
+        return n;
+    }
+};
+
+
+namespace chunked_detail {
+
+/** Byte-shuffle filter: groups byte k of every element together, which
+makes slowly-varying floating point fields far more compressible. */
+inline void shuffle(char const *src, char *dst, size_t const elt_size, size_t const n)
+{
+    for (size_t i=0; i<n; ++i)
+        for (size_t b=0; b<elt_size; ++b)
+            dst[b*n + i] = src[i*elt_size + b];
+}
+
+inline void unshuffle(char const *src, char *dst, size_t const elt_size, size_t const n)
+{
+    for (size_t b=0; b<elt_size; ++b)
+        for (size_t i=0; i<n; ++i)
+            dst[i*elt_size + b] = src[b*n + i];
+}
+
+/** Compresses src; returns an empty vector if the codec did not help. */
+inline std::vector<char> compress(ChunkCodec const codec, int const level, char const *src, size_t const n)
+{
+    (void)level; (void)src;    // Unused if no codecs are compiled in
+    std::vector<char> dst;
+    switch(codec) {
+#ifdef BLITZ11_USE_ZSTD
+        case ChunkCodec::ZSTD : {
+            dst.resize(ZSTD_compressBound(n));
+            size_t const nc = ZSTD_compress(&dst[0], dst.size(), src, n,
+                level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+            if (ZSTD_isError(nc)) throw std::runtime_error(
+                std::string("ZSTD_compress: ") + ZSTD_getErrorName(nc));
+            dst.resize(nc);
+        } break;
+#endif
+#ifdef BLITZ11_USE_LZ4
+        case ChunkCodec::LZ4 : {
+            if (n > (size_t)LZ4_MAX_INPUT_SIZE)
+                throw std::runtime_error("Chunk too large for LZ4");
+            dst.resize(LZ4_compressBound((int)n));
+            // For LZ4, level is the "acceleration" (higher = faster)
+            int const nc = LZ4_compress_fast(src, &dst[0], (int)n, (int)dst.size(),
+                level <= 0 ? 1 : level);
+            if (nc <= 0) throw std::runtime_error("LZ4_compress_fast failed");
+            dst.resize(nc);
+        } break;
+#endif
+        case ChunkCodec::NONE :
+            break;
+        default :
+            throw std::runtime_error("Chunk codec not compiled in");
+    }
+    if (dst.size() >= n) dst.clear();
+    return dst;
+}
+
+inline void decompress(ChunkCodec const codec, char const *src, size_t const nsrc, char *dst, size_t const ndst)
+{
+    if (nsrc == ndst) {    // Stored raw
+        std::memcpy(dst, src, ndst);
+        return;
+    }
+    switch(codec) {
+#ifdef BLITZ11_USE_ZSTD
+        case ChunkCodec::ZSTD : {
+            size_t const nd = ZSTD_decompress(dst, ndst, src, nsrc);
+            if (ZSTD_isError(nd) || nd != ndst) throw std::runtime_error("ZSTD_decompress failed");
+        } break;
+#endif
+#ifdef BLITZ11_USE_LZ4
+        case ChunkCodec::LZ4 : {
+            int const nd = LZ4_decompress_safe(src, dst, (int)nsrc, (int)ndst);
+            if (nd < 0 || (size_t)nd != ndst) throw std::runtime_error("LZ4_decompress_safe failed");
+        } break;
+#endif
+        default :
+            throw std::runtime_error("Chunk codec not compiled in");
+    }
+}
+
+/** Row-major strides of a dense box with the given extents */
+inline std::vector<ptrdiff_t> dense_strides(int64_t const *low, int64_t const *high, int const rank)
+{
+    std::vector<ptrdiff_t> strides(rank);
+    ptrdiff_t stride = 1;
+    for (int i=rank-1; i>=0; --i) {
+        strides[i] = stride;
+        stride *= (high[i] - low[i]);
+    }
+    return strides;
+}
+
+template<class ValueT, class CharT, class IndexT>
+void save_chunked(
+    std::string const &fname,
+    MemoryBlock<CharT> const &memory,
+    std::vector<Dope<IndexT>> const &dopes,
+    std::vector<IndexT> const &chunk_shape,
+    ChunkOptions const &opt)
+{
+    using namespace blockfile_detail;
+    typedef typename std::remove_const<ValueT>::type T;
+    int const rank = dopes.size();
+
+    if ((int)chunk_shape.size() != rank)
+        throw std::invalid_argument("save_chunked: chunk_shape must have one entry per dimension");
+    if (!codec_available(opt.codec))
+        throw std::invalid_argument("save_chunked: chunk codec not compiled in");
+
+    ChunkedFileInfo info;
+    std::memset(&info.header, 0, sizeof(info.header));
+    ChunkedFileHeader &h(info.header);
+    std::memcpy(h.magic, "BLITZ11C", 8);
+    h.byte_order = BLOCKFILE_BYTE_ORDER;
+    h.version = CHUNKEDFILE_VERSION;
+    h.dtype_kind = dtype_traits<ValueT>::kind;
+    h.codec = (uint8_t)opt.codec;
+    h.shuffle = opt.shuffle;
+    h.dtype_size = sizeof(T);
+    h.rank = rank;
+
+    info.dims.resize(rank);
+    h.nchunks = 1;
+    for (int i=0; i<rank; ++i) {
+        if (chunk_shape[i] <= 0)
+            throw std::invalid_argument("save_chunked: chunk extents must be positive");
+        info.dims[i].low = dopes[i].range[0];
+        info.dims[i].high = std::max(dopes[i].range[0], dopes[i].range[1]);
+        info.dims[i].chunk = chunk_shape[i];
+        h.nchunks *= info.nchunks(i);
+    }
+    info.table.resize(h.nchunks);
+
+    std::vector<ptrdiff_t> src_strides(rank);
+    for (int i=0; i<rank; ++i) src_strides[i] = dopes[i].stride;
+    T const * const src_base = reinterpret_cast<T const *>(memory.base());
+
+    int const fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw io_error("Cannot open", fname);
+    FdCloser closer(fd);
+
+    std::atomic<uint64_t> next_offset(sizeof(ChunkedFileHeader) + rank*sizeof(ChunkedFileDim));
+
+    parallel_for(h.nchunks, opt.nthreads, [&](size_t const c) {
+        // Chunk-grid position of chunk number c
+        std::vector<int64_t> cix(rank), low(rank), high(rank);
+        size_t rem = c;
+        for (int i=rank-1; i>=0; --i) {
+            cix[i] = rem % info.nchunks(i);
+            rem /= info.nchunks(i);
+        }
+        info.chunk_box(&cix[0], &low[0], &high[0]);
+
+        // Gather the chunk into a dense row-major buffer
+        std::vector<ptrdiff_t> const buf_strides(dense_strides(&low[0], &high[0], rank));
+        size_t n = 1;
+        ptrdiff_t src_off = 0;
+        for (int i=0; i<rank; ++i) {
+            n *= (high[i] - low[i]);
+            src_off += low[i] * src_strides[i];
+        }
+        std::vector<int64_t> extent(rank);
+        for (int i=0; i<rank; ++i) extent[i] = high[i] - low[i];
+        std::vector<T> buf(n);
+        copy_strided(rank, &extent[0], &buf[0], &buf_strides[0], src_base + src_off, &src_strides[0]);
+
+        size_t const raw_bytes = n * sizeof(T);
+        char const *raw = reinterpret_cast<char const *>(&buf[0]);
+        std::vector<char> shuffled;
+        if (opt.shuffle) {
+            shuffled.resize(raw_bytes);
+            shuffle(raw, &shuffled[0], sizeof(T), n);
+            raw = &shuffled[0];
+        }
+
+        std::vector<char> const packed(compress(opt.codec, opt.level, raw, raw_bytes));
+        char const *out = packed.empty() ? raw : &packed[0];
+        size_t const out_bytes = packed.empty() ? raw_bytes : packed.size();
+
+        uint64_t const offset = next_offset.fetch_add(out_bytes);
+        pwrite_all(fd, out, out_bytes, offset, fname);
+        info.table[c].offset = offset;
+        info.table[c].nbytes = out_bytes;
+    });
+
+    // Table, then dims and header last: a truncated file has no magic
+    h.table_offset = next_offset;
+    if (h.nchunks > 0)
+        pwrite_all(fd, &info.table[0], h.nchunks*sizeof(ChunkEntry), h.table_offset, fname);
+    if (rank > 0)
+        pwrite_all(fd, &info.dims[0], rank*sizeof(ChunkedFileDim), sizeof(ChunkedFileHeader), fname);
+    pwrite_all(fd, &h, sizeof(h), 0, fname);
+}
+
+}    // namespace chunked_detail
+
+
+/** Writes an array as independently compressed chunks.
+@param chunk_shape Extent of a chunk in each dimension; edge chunks may be smaller. */
+template<class ValueT, class IndexT>
+void save_chunked(
+    std::string const &fname,
+    GeneralArray<ValueT, IndexT> const &arr,
+    std::vector<IndexT> const &chunk_shape,
+    ChunkOptions const &opt = ChunkOptions())
+{
+    chunked_detail::save_chunked<ValueT>(fname, arr.memory(), arr.dopes(), chunk_shape, opt);
+}
+
+template<class ValueT, int RANK, class IndexT>
+void save_chunked(
+    std::string const &fname,
+    Array<ValueT, RANK, IndexT> const &arr,
+    std::vector<IndexT> const &chunk_shape,
+    ChunkOptions const &opt = ChunkOptions())
+{
+    chunked_detail::save_chunked<ValueT>(fname, arr.memory(), arr.dopes(), chunk_shape, opt);
+}
+
+
+namespace chunked_detail {
+
+/** Throws unless the dims describe a chunk grid of h.nchunks chunks
+whose elements can be counted in bytes without overflow (the values
+come straight from the file). */
+inline void check_chunk_grid(ChunkedFileInfo const &info, std::string const &fname)
+{
+    std::runtime_error const bad("Corrupt chunked file dimensions in " + fname);
+    int64_t nchunks = 1, nbytes = info.header.dtype_size;
+    for (int i=0; i<info.rank(); ++i) {
+        ChunkedFileDim const &d(info.dims[i]);
+        int64_t extent;
+        if (d.chunk <= 0
+            || __builtin_sub_overflow(d.high, d.low, &extent) || extent < 0
+            || __builtin_mul_overflow(nbytes, extent, &nbytes))
+            throw bad;
+        if (__builtin_mul_overflow(nchunks, info.nchunks(i), &nchunks)) throw bad;
+    }
+    if ((uint64_t)nchunks != info.header.nchunks)
+        throw std::runtime_error("Chunk count does not match chunk grid in " + fname);
+}
+
+/** Throws unless every chunk lies between the dims and the table */
+inline void check_chunk_table(ChunkedFileInfo const &info, std::string const &fname)
+{
+    uint64_t const data_begin = sizeof(ChunkedFileHeader) + info.rank()*sizeof(ChunkedFileDim);
+    uint64_t const data_end = info.header.table_offset;
+    for (ChunkEntry const &e : info.table) {
+        if (e.nbytes == 0 || e.offset < data_begin || e.offset > data_end
+            || e.nbytes > data_end - e.offset)
+            throw std::runtime_error("Chunk table entry outside the chunk data in " + fname);
+    }
+}
+
+}    // namespace chunked_detail
+
+/** Reads and validates the header, dimensions and chunk table of a
+chunked file */
+inline ChunkedFileInfo read_chunked_info(int const fd, std::string const &fname)
+{
+    using namespace blockfile_detail;
+
+    ChunkedFileInfo info;
+    ChunkedFileHeader &h(info.header);
+    pread_all(fd, &h, sizeof(h), 0, fname);
+    if (std::memcmp(h.magic, "BLITZ11C", 8) != 0)
+        throw std::runtime_error("Not a blitz11 chunked file: " + fname);
+    if (h.byte_order != BLOCKFILE_BYTE_ORDER)
+        throw std::runtime_error("Chunked file of foreign byte order: " + fname);
+    if (h.version > CHUNKEDFILE_VERSION)
+        throw std::runtime_error("Unsupported chunked file version in " + fname);
+    if (h.rank > BLOCKFILE_MAX_RANK)
+        throw std::runtime_error("Corrupt chunked file header in " + fname);
+
+    // The table must be all there before we size anything by nchunks
+    struct stat st;
+    if (::fstat(fd, &st) < 0) throw io_error("Cannot stat", fname);
+    uint64_t const file_bytes = st.st_size;
+    uint64_t const dims_end = sizeof(h) + h.rank*sizeof(ChunkedFileDim);
+    if (h.table_offset < dims_end || h.table_offset > file_bytes
+        || h.nchunks > (file_bytes - h.table_offset) / sizeof(ChunkEntry))
+        throw std::runtime_error("Truncated chunked file: " + fname);
+
+    info.dims.resize(h.rank);
+    if (h.rank > 0)
+        pread_all(fd, &info.dims[0], h.rank*sizeof(ChunkedFileDim), sizeof(h), fname);
+    chunked_detail::check_chunk_grid(info, fname);
+
+    info.table.resize(h.nchunks);
+    if (h.nchunks > 0)
+        pread_all(fd, &info.table[0], h.nchunks*sizeof(ChunkEntry), h.table_offset, fname);
+    chunked_detail::check_chunk_table(info, fname);
+    return info;
+}
+
+inline ChunkedFileInfo read_chunked_info(std::string const &fname)
+{
+    int const fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) throw blockfile_detail::io_error("Cannot open", fname);
+    blockfile_detail::FdCloser closer(fd);
+    return read_chunked_info(fd, fname);
+}
+
+
+/** Reads the slab [low, high) of a chunked file into a new dense
+(row-major) array indexed the same as the stored array.  Only chunks
+intersecting the slab are read and decompressed, in parallel. */
+template<class ValueT, class IndexT=int>
+GeneralArray<ValueT, IndexT> load_chunked(
+    std::string const &fname,
+    std::vector<IndexT> const &low,
+    std::vector<IndexT> const &high,
+    int const nthreads = 0)
+{
+    using namespace blockfile_detail;
+    using namespace chunked_detail;
+    typedef typename std::remove_const<ValueT>::type T;
+    typedef typename transfer_const<char, ValueT>::type CharT;
+
+    int const fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) throw io_error("Cannot open", fname);
+    FdCloser closer(fd);
+
+    ChunkedFileInfo const info(read_chunked_info(fd, fname));
+    ChunkedFileHeader const &h(info.header);
+    int const rank = info.rank();
+
+    if (h.dtype_kind != dtype_traits<ValueT>::kind || h.dtype_size != sizeof(T))
+        throw std::runtime_error("Element type mismatch loading " + fname);
+    if ((int)low.size() != rank || (int)high.size() != rank)
+        throw std::invalid_argument("load_chunked: slab rank does not match " + fname);
+    for (int i=0; i<rank; ++i) {
+        if (low[i] < info.dims[i].low || high[i] > info.dims[i].high || low[i] > high[i])
+            throw std::invalid_argument("load_chunked: slab out of range for " + fname);
+    }
+
+    std::vector<Dope<IndexT>> const dopes(row_major_dopes(&low[0], &high[0], rank));
+    MemoryBlock<CharT> const memory(allocate_block<ValueT>(&dopes[0], rank));
+    T * const dst_base = reinterpret_cast<T *>(const_cast<char *>(memory.base()));
+    std::vector<ptrdiff_t> dst_strides(rank);
+    for (int i=0; i<rank; ++i) dst_strides[i] = dopes[i].stride;
+
+    // Range of chunk-grid positions [clow, chigh) intersecting the slab
+    std::vector<int64_t> clow(rank), chigh(rank);
+    size_t nchunks = 1;
+    for (int i=0; i<rank; ++i) {
+        ChunkedFileDim const &d(info.dims[i]);
+        int64_t const hi = high[i] - d.low;
+        clow[i] = (low[i] - d.low) / d.chunk;
+        chigh[i] = hi / d.chunk + (hi % d.chunk != 0);
+        if (high[i] == low[i]) chigh[i] = clow[i];
+        nchunks *= (chigh[i] - clow[i]);
+    }
+
+    parallel_for(nchunks, nthreads, [&](size_t const k) {
+        std::vector<int64_t> cix(rank), cbox_low(rank), cbox_high(rank);
+        size_t rem = k;
+        for (int i=rank-1; i>=0; --i) {
+            int64_t const n = chigh[i] - clow[i];
+            cix[i] = clow[i] + rem % n;
+            rem /= n;
+        }
+        info.chunk_box(&cix[0], &cbox_low[0], &cbox_high[0]);
+        ChunkEntry const &entry(info.table[info.chunk_number(&cix[0])]);
+
+        size_t n = 1;
+        for (int i=0; i<rank; ++i) n *= (cbox_high[i] - cbox_low[i]);
+        size_t const raw_bytes = n * sizeof(T);
+
+        std::vector<char> packed(entry.nbytes);
+        if (entry.nbytes > 0) pread_all(fd, &packed[0], entry.nbytes, entry.offset, fname);
+        std::vector<T> buf(n);
+        char * const braw = reinterpret_cast<char *>(&buf[0]);
+        if (h.shuffle) {
+            std::vector<char> shuffled(raw_bytes);
+            decompress((ChunkCodec)h.codec, &packed[0], packed.size(), &shuffled[0], raw_bytes);
+            unshuffle(&shuffled[0], braw, sizeof(T), n);
+        } else {
+            decompress((ChunkCodec)h.codec, &packed[0], packed.size(), braw, raw_bytes);
+        }
+
+        // Copy the intersection of chunk and slab
+        std::vector<ptrdiff_t> const buf_strides(dense_strides(&cbox_low[0], &cbox_high[0], rank));
+        std::vector<int64_t> extent(rank);
+        ptrdiff_t src_off = 0, dst_off = 0;
+        for (int i=0; i<rank; ++i) {
+            int64_t const lo = std::max<int64_t>(low[i], cbox_low[i]);
+            int64_t const hi = std::min<int64_t>(high[i], cbox_high[i]);
+            extent[i] = hi - lo;
+            src_off += (lo - cbox_low[i]) * buf_strides[i];
+            dst_off += lo * dst_strides[i];
+        }
+        copy_strided(rank, &extent[0], dst_base + dst_off, &dst_strides[0], &buf[0] + src_off, &buf_strides[0]);
+    });
+
+    return GeneralArray<ValueT, IndexT>(memory, dopes);
+}
+
+/** Reads an entire chunked file */
+template<class ValueT, class IndexT=int>
+GeneralArray<ValueT, IndexT> load_chunked(std::string const &fname, int const nthreads = 0)
+{
+    ChunkedFileInfo const info(read_chunked_info(fname));
+    std::vector<IndexT> low(info.rank()), high(info.rank());
+    for (int i=0; i<info.rank(); ++i) {
+        low[i] = info.dims[i].low;
+        high[i] = info.dims[i].high;
+        if (low[i] != info.dims[i].low || high[i] != info.dims[i].high)
+            throw std::runtime_error("Dimension range does not fit in IndexT loading " + fname);
+    }
+    return load_chunked<ValueT, IndexT>(fname, low, high, nthreads);
+}
@@ -0,0 +1,179 @@
+/**
+Zero-copy DLPack export/import for Array and GeneralArray.
+
+to_dlpack() hands out a DLManagedTensor pointing at the array's memory.
+The tensor holds a copy of the array's MemoryBlock, so shared memory
+stays alive until the consumer calls the tensor's deleter.  (Borrowed
+memory is not owned; its owner must outlive the tensor.)  DLPack has
+no read-only flag in DLManagedTensor, so const arrays are exported as
+if writable.
+
+from_dlpack() takes ownership of a DLManagedTensor: the returned array's
+MemoryBlock calls the tensor's deleter once the last copy of the block
+is gone.
+
+DLPack indices start at 0, so index j of dimension k in the tensor is
+index dopes[k].range[0] + j of the array.  Strides (in elements) map
+one-to-one, negative strides included.  Only kDLCPU tensors are accepted.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <complex>
+#include <cstdint>
+#include <dlpack/dlpack.h>
+
+
+/** DLPack type code of ValueT */
+template<class ValueT>
+struct dlpack_dtype {
+    typedef typename std::remove_const<ValueT>::type T;
+    static DLDataType get()
+    {
+        static_assert(std::is_arithmetic<T>::value, "No DLPack dtype for this element type");
+        DLDataType dt;
+        dt.code = std::is_same<T, bool>::value ? kDLBool
+            : std::is_floating_point<T>::value ? kDLFloat
+            : std::is_signed<T>::value ? kDLInt : kDLUInt;
+        dt.bits = 8 * sizeof(T);
+        dt.lanes = 1;
+        return dt;
+    }
+};
+
+template<class RealT>
+struct dlpack_dtype<std::complex<RealT>> {
+    static DLDataType get()
+    {
+        DLDataType dt;
+        dt.code = kDLComplex;
+        dt.bits = 8 * sizeof(std::complex<RealT>);
+        dt.lanes = 1;
+        return dt;
+    }
+};
+
+template<class RealT>
+struct dlpack_dtype<std::complex<RealT> const> : public dlpack_dtype<std::complex<RealT>> {};
+
+
+namespace dlpack_detail {
+
+/** manager_ctx of tensors made by to_dlpack() */
+template<class CharT>
+struct ExportContext {
+    DLManagedTensor tensor;
+    MemoryBlock<CharT> memory;    // Keeps shared memory alive
+    std::vector<int64_t> shape;
+    std::vector<int64_t> strides;
+
+    ExportContext(MemoryBlock<CharT> const &_memory) : memory(_memory) {}
+
+    static void deleter(DLManagedTensor *self)
+        { delete static_cast<ExportContext *>(self->manager_ctx); }
+};
+
+template<class ValueT, class CharT, class IndexT>
+DLManagedTensor *to_dlpack(MemoryBlock<CharT> const &memory, std::vector<Dope<IndexT>> const &dopes)
+{
+    std::unique_ptr<ExportContext<CharT>> ctx(new ExportContext<CharT>(memory));
+    int const rank = dopes.size();
+    ctx->shape.resize(rank);
+    ctx->strides.resize(rank);
+    ptrdiff_t low_diff = 0;    // Index diff of element (low, low, ...)
+    for (int k=0; k<rank; ++k) {
+        ctx->shape[k] = std::max<int64_t>(0, dopes[k].range[1] - dopes[k].range[0]);
+        ctx->strides[k] = dopes[k].stride;
+        low_diff += dopes[k].range[0] * dopes[k].stride;
+    }
+
+    DLTensor &t(ctx->tensor.dl_tensor);
+    t.data = const_cast<char *>(memory.base()) + low_diff * (ptrdiff_t)sizeof(ValueT);
+    t.device.device_type = kDLCPU;
+    t.device.device_id = 0;
+    t.ndim = rank;
+    t.dtype = dlpack_dtype<ValueT>::get();
+    t.shape = ctx->shape.data();
+    t.strides = ctx->strides.data();
+    t.byte_offset = 0;
+    ctx->tensor.manager_ctx = ctx.get();
+    ctx->tensor.deleter = &ExportContext<CharT>::deleter;
+    return &ctx.release()->tensor;
+}
+
+/** Checks a tensor against ValueT and builds 0-based dopes for it */
+template<class ValueT, class IndexT>
+std::vector<Dope<IndexT>> import_dopes(DLTensor const &t)
+{
+    if (t.device.device_type != kDLCPU)
+        throw std::invalid_argument("from_dlpack: only kDLCPU tensors can be imported");
+    DLDataType const dt(dlpack_dtype<ValueT>::get());
+    if (t.dtype.code != dt.code || t.dtype.bits != dt.bits || t.dtype.lanes != dt.lanes)
+        throw std::invalid_argument("from_dlpack: tensor dtype does not match ValueT");
+
+    std::vector<Dope<IndexT>> dopes(t.ndim);
+    ptrdiff_t stride = 1;    // For compact row-major tensors (strides == NULL)
+    for (int k=t.ndim-1; k>=0; --k) {
+        dopes[k].range[0] = 0;
+        dopes[k].range[1] = t.shape[k];
+        if (dopes[k].range[1] != t.shape[k])
+            throw std::invalid_argument("from_dlpack: shape does not fit in IndexT");
+        dopes[k].stride = (t.strides ? t.strides[k] : stride);
+        stride *= t.shape[k];
+    }
+    return dopes;
+}
+
+template<class ValueT, class IndexT>
+MemoryBlock<typename transfer_const<char, ValueT>::type> import_memory(
+    DLManagedTensor *tensor, std::vector<Dope<IndexT>> const &dopes)
+{
+    typedef typename transfer_const<char, ValueT>::type CharT;
+    DLTensor const &t(tensor->dl_tensor);
+    CharT * const origin = static_cast<CharT *>(t.data) + t.byte_offset;
+
+    std::array<ptrdiff_t,2> const diffs(diff_range(dopes.data(), (int)dopes.size()));
+    std::shared_ptr<CharT> held(origin, [tensor](CharT *) {
+        if (tensor->deleter) tensor->deleter(tensor);
+    });
+    ptrdiff_t const first = diffs[0] * (ptrdiff_t)sizeof(ValueT);
+    MemoryBlock<CharT> memory(held, origin + first,
+        (diffs[1] - diffs[0] + 1) * sizeof(ValueT));
+    return memory.rebased(-first);
+}
+
+}    // namespace dlpack_detail
+
+
+/** Exports an Array as a DLManagedTensor, with no copy */
+template<class ValueT, int RANK, class IndexT>
+DLManagedTensor *to_dlpack(Array<ValueT, RANK, IndexT> const &arr)
+    { return dlpack_detail::to_dlpack<ValueT>(arr.memory(), arr.dopes()); }
+
+template<class ValueT, class IndexT>
+DLManagedTensor *to_dlpack(GeneralArray<ValueT, IndexT> const &arr)
+    { return dlpack_detail::to_dlpack<ValueT>(arr.memory(), arr.dopes()); }
+
+
+/** Imports a DLManagedTensor as an Array, taking ownership of it.  On
+error the tensor is not consumed; the caller still owns it. */
+template<class ValueT, int RANK, class IndexT=int>
+Array<ValueT, RANK, IndexT> from_dlpack(DLManagedTensor * const tensor)
+{
+    if (tensor->dl_tensor.ndim != RANK)
+        throw std::invalid_argument("from_dlpack: tensor has the wrong rank");
+    std::vector<Dope<IndexT>> const dopes(dlpack_detail::import_dopes<ValueT, IndexT>(tensor->dl_tensor));
+    return Array<ValueT, RANK, IndexT>(
+        dlpack_detail::import_memory<ValueT>(tensor, dopes), dopes);
+}
+
+/** Imports a DLManagedTensor of any rank as a GeneralArray */
+template<class ValueT, class IndexT=int>
+GeneralArray<ValueT, IndexT> from_dlpack(DLManagedTensor * const tensor)
+{
+    std::vector<Dope<IndexT>> const dopes(dlpack_detail::import_dopes<ValueT, IndexT>(tensor->dl_tensor));
+    return GeneralArray<ValueT, IndexT>(
+        dlpack_detail::import_memory<ValueT>(tensor, dopes), dopes);
+}
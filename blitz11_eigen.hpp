@@ -0,0 +1,116 @@
+/**
+Zero-copy adapters between blitz11 arrays and Eigen.
+
+to_eigen() views a rank-1 or rank-2 Array as an Eigen::Map with
+dynamic strides, which may be negative.  Eigen indices start at 0, so
+index j of dimension k in the Map is index dopes[k].range[0] + j of
+the Array.  The Map does not own anything; the Array's memory must
+outlive it.
+
+from_eigen() borrows the storage of any Eigen expression with direct
+access (Matrix, Map, Ref, Block, ...) as a rank-2 Array (rows, cols).
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <Eigen/Core>
+
+
+/** Map types produced by to_eigen(); const-qualified if ValueT is */
+template<class ValueT>
+struct eigen_map {
+    typedef typename std::remove_const<ValueT>::type T;
+    typedef typename transfer_const<
+        Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>, ValueT>::type MatrixT;
+    typedef typename transfer_const<
+        Eigen::Matrix<T, Eigen::Dynamic, 1>, ValueT>::type VectorT;
+
+    typedef Eigen::Map<MatrixT, Eigen::Unaligned,
+        Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>> matrix;
+    typedef Eigen::Map<VectorT, Eigen::Unaligned,
+        Eigen::InnerStride<Eigen::Dynamic>> vector;
+};
+
+namespace eigen_detail {
+
+/** Address of the element at the Array's lower bounds */
+template<class ValueT, int RANK, class IndexT>
+ValueT *low_element(Array<ValueT, RANK, IndexT> const &arr)
+{
+    std::vector<Dope<IndexT>> const &dopes(arr.dopes());
+    ptrdiff_t low_diff = 0;
+    for (int k=0; k<RANK; ++k) low_diff += dopes[k].range[0] * dopes[k].stride;
+    return reinterpret_cast<ValueT *>(arr.memory().base()) + low_diff;
+}
+
+template<class ValueT, class IndexT>
+IndexT extent(Array<ValueT, 2, IndexT> const &arr, int const k)
+    { return std::max<IndexT>(0, arr.dopes()[k].range[1] - arr.dopes()[k].range[0]); }
+
+template<class ElementT, class IndexT, class Derived>
+Array<ElementT, 2, IndexT> from_eigen(ElementT * const data, Eigen::DenseBase<Derived> const &m)
+{
+    typedef typename transfer_const<char, ElementT>::type CharT;
+    Derived const &d(m.derived());
+
+    std::vector<Dope<IndexT>> dopes(2);
+    dopes[0].range = {{0, (IndexT)d.rows()}};
+    dopes[1].range = {{0, (IndexT)d.cols()}};
+    dopes[0].stride = (Derived::IsRowMajor ? d.outerStride() : d.innerStride());
+    dopes[1].stride = (Derived::IsRowMajor ? d.innerStride() : d.outerStride());
+
+    std::array<ptrdiff_t,2> const diffs(diff_range(&dopes[0], 2));
+    ptrdiff_t const first = diffs[0] * (ptrdiff_t)sizeof(ElementT);
+    MemoryBlock<CharT> memory(reinterpret_cast<CharT *>(data) + first,
+        (diffs[1] - diffs[0] + 1) * sizeof(ElementT));
+    return Array<ElementT, 2, IndexT>(memory.rebased(-first), dopes);
+}
+
+}    // namespace eigen_detail
+
+
+/** Views a rank-2 Array as an Eigen matrix, with no copy */
+template<class ValueT, class IndexT>
+typename eigen_map<ValueT>::matrix to_eigen(Array<ValueT, 2, IndexT> const &arr)
+{
+    return typename eigen_map<ValueT>::matrix(
+        eigen_detail::low_element(arr),
+        eigen_detail::extent(arr, 0), eigen_detail::extent(arr, 1),
+        Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(
+            arr.dopes()[1].stride,      // Outer (column-to-column)
+            arr.dopes()[0].stride));    // Inner (row-to-row)
+}
+
+/** Views a rank-1 Array as an Eigen column vector, with no copy */
+template<class ValueT, class IndexT>
+typename eigen_map<ValueT>::vector to_eigen(Array<ValueT, 1, IndexT> const &arr)
+{
+    return typename eigen_map<ValueT>::vector(
+        eigen_detail::low_element(arr),
+        std::max<IndexT>(0, arr.dopes()[0].range[1] - arr.dopes()[0].range[0]),
+        Eigen::InnerStride<Eigen::Dynamic>(arr.dopes()[0].stride));
+}
+
+
+/** Borrows the storage of a writable Eigen expression as an Array(rows, cols) */
+template<class IndexT = int, class Derived>
+Array<typename std::conditional<(Derived::Flags & Eigen::LvalueBit) != 0,
+        typename Derived::Scalar, typename Derived::Scalar const>::type, 2, IndexT>
+from_eigen(Eigen::DenseBase<Derived> &m)
+{
+    static_assert((Derived::Flags & Eigen::DirectAccessBit) != 0,
+        "from_eigen: expression has no direct access to its storage");
+    return eigen_detail::from_eigen<typename std::conditional<(Derived::Flags & Eigen::LvalueBit) != 0,
+        typename Derived::Scalar, typename Derived::Scalar const>::type, IndexT>(m.derived().data(), m);
+}
+
+/** Borrows the storage of a const Eigen expression as a read-only Array(rows, cols) */
+template<class IndexT = int, class Derived>
+Array<typename Derived::Scalar const, 2, IndexT> from_eigen(Eigen::DenseBase<Derived> const &m)
+{
+    static_assert((Derived::Flags & Eigen::DirectAccessBit) != 0,
+        "from_eigen: expression has no direct access to its storage");
+    return eigen_detail::from_eigen<typename Derived::Scalar const, IndexT>(m.derived().data(), m);
+}
@@ -0,0 +1,655 @@
+/**
+Native binary save/load of MemoryBlocks and dope vectors (Features #6, #7).
+
+File format (all integers in the byte order of the machine that wrote it,
+recorded in BlockFileHeader::byte_order):
+
+    BlockFileHeader             64 bytes
+    BlockFileDope[rank]         24 bytes each
+    zero padding                up to data_offset (a multiple of alignment)
+    data section                data_bytes, the raw bytes of the MemoryBlock
+
+Because the data section is aligned (by default to a page), it may be
+mmap()ed directly, so reopening a checkpoint costs O(1) rather than
+O(bytes).
+
+save_async() / CheckpointWriter snapshot a block and write it on a
+background thread, so a model can keep integrating while a checkpoint
+drains.  Checkpoints replace their target atomically (temporary file,
+fsync(), rename()).  Define BLITZ11_USE_IO_URING (and link -luring) to issue the
+writes through io_uring; otherwise plain pwrite() is used.
+
+POSIX only.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <future>
+#include <atomic>
+
+#ifdef BLITZ11_USE_IO_URING
+#include <liburing.h>
+#endif
+
+
+/** Describes the element type stored in a file, numpy-style.
+    kind = 'f' (floating point), 'i' (signed int), 'u' (unsigned int),
+           'b' (bool), 'c' (complex), 'V' (anything else; opaque bytes) */
+template<class ValueT>
+struct dtype_traits {
+    typedef typename std::remove_const<ValueT>::type T;
+    static constexpr char kind =
+        std::is_same<T, bool>::value ? 'b' :
+        std::is_floating_point<T>::value ? 'f' :
+        std::is_integral<T>::value ? (std::is_signed<T>::value ? 'i' : 'u') :
+        'V';
+    static constexpr uint32_t size = sizeof(T);
+};
+
+template<class RealT>
+struct dtype_traits<std::complex<RealT>> {
+    static constexpr char kind = 'c';
+    static constexpr uint32_t size = sizeof(std::complex<RealT>);
+};
+
+template<class RealT>
+struct dtype_traits<std::complex<RealT> const> : public dtype_traits<std::complex<RealT>> {};
+
+
+uint32_t const BLOCKFILE_BYTE_ORDER = 0x01020304;
+/** Version 2 added origin_bytes; version 1 files have 0 there (it was
+reserved), which is their origin. */
+uint32_t const BLOCKFILE_VERSION = 2;
+uint32_t const BLOCKFILE_MAX_RANK = 64;    // Larger ranks mean a corrupt header
+
+struct BlockFileHeader {
+    char magic[8];          // "BLITZ11\0"
+    uint32_t byte_order;    // BLOCKFILE_BYTE_ORDER, as written by the saving machine
+    uint32_t version;
+    char dtype_kind;        // See dtype_traits
+    char pad0[3];
+    uint32_t dtype_size;    // sizeof(ValueT)
+    uint32_t rank;
+    uint32_t pad1;
+    uint64_t data_offset;   // Start of the data section, from the start of file
+    uint64_t data_bytes;    // Size of the data section (== MemoryBlock::size_bytes())
+    int64_t origin_bytes;   // MemoryBlock::origin_bytes() (version >= 2)
+    uint64_t reserved;
+};
+static_assert(sizeof(BlockFileHeader) == 64, "BlockFileHeader must be 64 bytes");
+
+struct BlockFileDope {
+    int64_t low, high;      // Dope::range
+    int64_t stride;
+};
+static_assert(sizeof(BlockFileDope) == 24, "BlockFileDope must be 24 bytes");
+
+
+/** Everything about a block file except its data; see read_block_info() */
+struct BlockFileInfo {
+    BlockFileHeader header;
+    std::vector<BlockFileDope> dopes;
+    bool swapped;           // File was written with the opposite byte order
+};
+
+
+namespace blockfile_detail {
+
+inline void swap_bytes(void *p, size_t n)
+{
+    char *c = static_cast<char *>(p);
+    for (size_t i=0; i<n/2; ++i) std::swap(c[i], c[n-1-i]);
+}
+
+/** Byte-swaps an array of elements, each of size elt_size bytes */
+inline void swap_elements(void *p, size_t elt_size, size_t n)
+{
+    char *c = static_cast<char *>(p);
+    for (size_t i=0; i<n; ++i) swap_bytes(c + i*elt_size, elt_size);
+}
+
+/** Byte-swaps n elements of a file's dtype.  Complex numbers are
+swapped as their two real components. */
+inline void swap_dtype(void *p, char const kind, size_t const elt_size, size_t const n)
+{
+    if (kind == 'c') swap_elements(p, elt_size/2, 2*n);
+    else swap_elements(p, elt_size, n);
+}
+
+inline std::runtime_error io_error(std::string const &what, std::string const &fname)
+{
+    return std::runtime_error(what + " " + fname + ": " + std::strerror(errno));
+}
+
+/** Closes a file descriptor on scope exit */
+struct FdCloser {
+    int fd;
+    explicit FdCloser(int _fd) : fd(_fd) {}
+    ~FdCloser() { if (fd >= 0) ::close(fd); }
+};
+
+inline void pwrite_all(int fd, void const *buf, size_t n, off_t offset, std::string const &fname)
+{
+    char const *c = static_cast<char const *>(buf);
+    while (n > 0) {
+        ssize_t const nw = ::pwrite(fd, c, n, offset);
+        if (nw < 0) {
+            if (errno == EINTR) continue;
+            throw io_error("Error writing", fname);
+        }
+        c += nw; n -= nw; offset += nw;
+    }
+}
+
+inline void pread_all(int fd, void *buf, size_t n, off_t offset, std::string const &fname)
+{
+    char *c = static_cast<char *>(buf);
+    while (n > 0) {
+        ssize_t const nr = ::pread(fd, c, n, offset);
+        if (nr < 0) {
+            if (errno == EINTR) continue;
+            throw io_error("Error reading", fname);
+        }
+        if (nr == 0) throw std::runtime_error("Unexpected end of file in " + fname);
+        c += nr; n -= nr; offset += nr;
+    }
+}
+
+inline uint64_t round_up(uint64_t n, uint64_t alignment)
+    { return ((n + alignment - 1) / alignment) * alignment; }
+
+/** Builds the header + dopes (+ padding) that precede the data section */
+template<class ValueT, class IndexT>
+std::vector<char> make_preamble(
+    std::vector<Dope<IndexT>> const &dopes,
+    size_t const data_bytes,
+    ptrdiff_t const origin_bytes,
+    size_t const alignment)
+{
+    if (alignment == 0 || (alignment & (alignment-1)) != 0)
+        throw std::invalid_argument("Block file alignment must be a power of 2");
+
+    BlockFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "BLITZ11", 8);
+    header.byte_order = BLOCKFILE_BYTE_ORDER;
+    header.version = BLOCKFILE_VERSION;
+    header.dtype_kind = dtype_traits<ValueT>::kind;
+    header.dtype_size = dtype_traits<ValueT>::size;
+    header.rank = dopes.size();
+    header.data_offset = round_up(sizeof(BlockFileHeader) + dopes.size()*sizeof(BlockFileDope), alignment);
+    header.data_bytes = data_bytes;
+    header.origin_bytes = origin_bytes;
+
+    std::vector<char> preamble(header.data_offset, 0);
+    std::memcpy(&preamble[0], &header, sizeof(header));
+    BlockFileDope *fdopes = reinterpret_cast<BlockFileDope *>(&preamble[sizeof(header)]);
+    for (size_t i=0; i<dopes.size(); ++i) {
+        fdopes[i].low = dopes[i].range[0];
+        fdopes[i].high = dopes[i].range[1];
+        fdopes[i].stride = dopes[i].stride;
+    }
+    return preamble;
+}
+
+}    // namespace blockfile_detail
+
+
+/** Writes a MemoryBlock plus the dope vector used to access it.
+@param alignment Alignment of the data section within the file.  Use
+    (a multiple of) the page size to make the data section mmap()able
+    on its own. */
+template<class ValueT, class CharT, class IndexT>
+void save_block(
+    std::string const &fname,
+    MemoryBlock<CharT> const &memory,
+    std::vector<Dope<IndexT>> const &dopes,
+    size_t const alignment = 4096)
+{
+    using namespace blockfile_detail;
+
+    std::vector<char> const preamble(
+        make_preamble<ValueT>(dopes, memory.size_bytes(), memory.origin_bytes(), alignment));
+
+    int const fd = ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw io_error("Cannot open", fname);
+    FdCloser closer(fd);
+
+    pwrite_all(fd, &preamble[0], preamble.size(), 0, fname);
+    pwrite_all(fd, memory.data(), memory.size_bytes(), preamble.size(), fname);
+}
+
+template<class ValueT, class IndexT>
+void save(std::string const &fname, GeneralArray<ValueT, IndexT> const &arr, size_t const alignment = 4096)
+    { save_block<ValueT>(fname, arr.memory(), arr.dopes(), alignment); }
+
+template<class ValueT, int RANK, class IndexT>
+void save(std::string const &fname, Array<ValueT, RANK, IndexT> const &arr, size_t const alignment = 4096)
+    { save_block<ValueT>(fname, arr.memory(), arr.dopes(), alignment); }
+
+
+/** Reads just the header and dope vector of a block file, converted
+to native byte order. */
+inline BlockFileInfo read_block_info(int const fd, std::string const &fname)
+{
+    using namespace blockfile_detail;
+
+    BlockFileInfo info;
+    pread_all(fd, &info.header, sizeof(info.header), 0, fname);
+    BlockFileHeader &h(info.header);
+
+    if (std::memcmp(h.magic, "BLITZ11", 8) != 0)
+        throw std::runtime_error("Not a blitz11 block file: " + fname);
+
+    info.swapped = (h.byte_order != BLOCKFILE_BYTE_ORDER);
+    if (info.swapped) {
+        swap_bytes(&h.byte_order, sizeof(h.byte_order));
+        if (h.byte_order != BLOCKFILE_BYTE_ORDER)
+            throw std::runtime_error("Unrecognized byte order in " + fname);
+        swap_bytes(&h.version, sizeof(h.version));
+        swap_bytes(&h.dtype_size, sizeof(h.dtype_size));
+        swap_bytes(&h.rank, sizeof(h.rank));
+        swap_bytes(&h.data_offset, sizeof(h.data_offset));
+        swap_bytes(&h.data_bytes, sizeof(h.data_bytes));
+        swap_bytes(&h.origin_bytes, sizeof(h.origin_bytes));
+    }
+    if (h.version < 1 || h.version > BLOCKFILE_VERSION)
+        throw std::runtime_error("Unsupported block file version in " + fname);
+    if (h.version < 2) h.origin_bytes = 0;
+    if (h.rank > BLOCKFILE_MAX_RANK
+        || h.data_offset < sizeof(BlockFileHeader) + h.rank*sizeof(BlockFileDope))
+        throw std::runtime_error("Corrupt block file header in " + fname);
+
+    // The data section must be all there, or mmap()ed access would SIGBUS
+    struct stat st;
+    if (::fstat(fd, &st) < 0) throw io_error("Cannot stat", fname);
+    uint64_t const file_bytes = st.st_size;
+    if (h.data_offset > file_bytes || h.data_bytes > file_bytes - h.data_offset)
+        throw std::runtime_error("Truncated block file: " + fname);
+
+    info.dopes.resize(h.rank);
+    if (h.rank > 0)
+        pread_all(fd, &info.dopes[0], h.rank*sizeof(BlockFileDope), sizeof(BlockFileHeader), fname);
+    if (info.swapped)
+        swap_elements(&info.dopes[0], sizeof(int64_t), 3*h.rank);
+
+    return info;
+}
+
+inline BlockFileInfo read_block_info(std::string const &fname)
+{
+    int const fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) throw blockfile_detail::io_error("Cannot open", fname);
+    blockfile_detail::FdCloser closer(fd);
+    return read_block_info(fd, fname);
+}
+
+namespace blockfile_detail {
+
+/** Throws unless every element reachable through the file's dopes
+lies inside its data section, with overflow-checked arithmetic
+(the values come straight from the file). */
+inline void check_data_bounds(BlockFileInfo const &info, std::string const &fname)
+{
+    BlockFileHeader const &h(info.header);
+    for (auto const &d : info.dopes) if (d.high <= d.low) return;    // Nothing reachable
+
+    std::runtime_error const bad("Block file dopes reach outside its data section: " + fname);
+    int64_t const size = h.dtype_size;
+    int64_t lo = h.origin_bytes, hi = h.origin_bytes;    // Byte offsets of the extreme elements
+    for (auto const &d : info.dopes) {
+        int64_t a, b;
+        if (__builtin_mul_overflow(d.low, d.stride, &a)
+            || __builtin_mul_overflow(d.high - 1, d.stride, &b)
+            || __builtin_mul_overflow(a, size, &a)
+            || __builtin_mul_overflow(b, size, &b)
+            || __builtin_add_overflow(lo, std::min(a, b), &lo)
+            || __builtin_add_overflow(hi, std::max(a, b), &hi))
+            throw bad;
+    }
+    if (lo < 0 || hi > (int64_t)h.data_bytes - size) throw bad;
+}
+
+}    // namespace blockfile_detail
+
+/** Checks a file's dtype against ValueT, checks its dopes against its
+data section, and converts them to IndexT */
+template<class ValueT, class IndexT>
+std::vector<Dope<IndexT>> check_block_info(BlockFileInfo const &info, std::string const &fname)
+{
+    if (info.header.dtype_kind != dtype_traits<ValueT>::kind
+        || info.header.dtype_size != dtype_traits<ValueT>::size)
+    {
+        throw std::runtime_error("Element type mismatch loading " + fname);
+    }
+
+    std::vector<Dope<IndexT>> dopes(info.dopes.size());
+    for (size_t i=0; i<dopes.size(); ++i) {
+        BlockFileDope const &fd(info.dopes[i]);
+        dopes[i].range[0] = fd.low;
+        dopes[i].range[1] = fd.high;
+        dopes[i].stride = fd.stride;
+        if (dopes[i].range[0] != fd.low || dopes[i].range[1] != fd.high)
+            throw std::runtime_error("Dope range does not fit in IndexT loading " + fname);
+    }
+    blockfile_detail::check_data_bounds(info, fname);
+    return dopes;
+}
+
+
+enum class LoadMode {
+    READ,            // Read into a freshly allocated MemoryBlock; O(bytes)
+    MMAP_PRIVATE,    // mmap() the data section; writes stay in memory.  O(1)
+    MMAP_SHARED      // mmap() the data section; writes go back to the file.  O(1)
+};
+
+/** Loads a block file written by save() or save_block().
+Files of the opposite byte order can only be loaded with LoadMode::READ. */
+template<class ValueT, class IndexT=int>
+GeneralArray<ValueT, IndexT> load(std::string const &fname, LoadMode const mode = LoadMode::READ)
+{
+    using namespace blockfile_detail;
+    typedef typename transfer_const<char, ValueT>::type CharT;
+
+    bool const writable = !std::is_const<ValueT>::value;
+    int const fd = ::open(fname.c_str(),
+        (mode == LoadMode::MMAP_SHARED && writable) ? O_RDWR : O_RDONLY);
+    if (fd < 0) throw io_error("Cannot open", fname);
+    FdCloser closer(fd);
+
+    BlockFileInfo const info(read_block_info(fd, fname));
+    std::vector<Dope<IndexT>> const dopes(check_block_info<ValueT, IndexT>(info, fname));
+    size_t const data_bytes = info.header.data_bytes;
+
+    if (mode == LoadMode::READ) {
+        MemoryBlock<CharT> memory(data_bytes);
+        char *buf = const_cast<char *>(memory.data());
+        pread_all(fd, buf, data_bytes, info.header.data_offset, fname);
+        if (info.swapped)
+            swap_dtype(buf, info.header.dtype_kind, info.header.dtype_size, data_bytes / info.header.dtype_size);
+        return GeneralArray<ValueT, IndexT>(memory.rebased(info.header.origin_bytes), dopes);
+    }
+
+    if (info.swapped)
+        throw std::runtime_error("Cannot mmap a file of foreign byte order: " + fname);
+
+    // Map the whole file, so data_offset need not be page-aligned
+    size_t const map_bytes = info.header.data_offset + data_bytes;
+    int const prot = PROT_READ | (writable ? PROT_WRITE : 0);
+    int const flags = (mode == LoadMode::MMAP_SHARED ? MAP_SHARED : MAP_PRIVATE);
+    void * const addr = ::mmap(nullptr, map_bytes, prot, flags, fd, 0);
+    if (addr == MAP_FAILED) throw io_error("Cannot mmap", fname);
+
+    std::shared_ptr<CharT> held(static_cast<CharT *>(addr),
+        [map_bytes](CharT *p) { ::munmap(const_cast<char *>(p), map_bytes); });
+    return GeneralArray<ValueT, IndexT>(
+        MemoryBlock<CharT>(held, held.get() + info.header.data_offset, data_bytes)
+            .rebased(info.header.origin_bytes),
+        dopes);
+}
+
+
+// ---------------------------------------------------------------
+// Asynchronous (write-behind) checkpoints
+
+namespace blockfile_detail {
+
+#ifdef BLITZ11_USE_IO_URING
+/** Writes buf to fd at offset 0, keeping up to queue_depth writes of
+write_bytes each in flight.  On an error, stops submitting but reaps
+every write still in flight before throwing, so the kernel is done
+with buf (and the ring) once this returns or throws. */
+inline void uring_write_all(int const fd, char const *buf, size_t const n, std::string const &fname,
+    unsigned const queue_depth = 16, size_t const write_bytes = 1 << 20)
+{
+    struct io_uring ring;
+    int err = io_uring_queue_init(queue_depth, &ring, 0);
+    if (err < 0) {    // Eg: kernel without io_uring; fall back
+        pwrite_all(fd, buf, n, 0, fname);
+        return;
+    }
+    std::shared_ptr<struct io_uring> ring_closer(&ring, io_uring_queue_exit);
+
+    std::string error;        // First error; thrown once nothing is in flight
+    auto const fail = [&](char const *what, int const e) {
+        if (!error.empty()) return;
+        errno = e;
+        error = io_error(what, fname).what();
+    };
+
+    size_t next = 0;          // Next byte to queue
+    unsigned queued = 0;      // Prepared, not yet submitted
+    unsigned inflight = 0;    // Submitted, not yet reaped
+    while (inflight > 0 || (error.empty() && next < n)) {
+        if (error.empty()) {
+            while (next < n && queued + inflight < queue_depth) {
+                struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+                if (!sqe) break;
+                size_t const len = std::min(write_bytes, n - next);
+                io_uring_prep_write(sqe, fd, buf + next, len, next);
+                io_uring_sqe_set_data(sqe, (void *)next);
+                next += len;
+                ++queued;
+            }
+            if (queued + inflight == 0) {    // No sqe to be had, and nothing to wait for
+                pwrite_all(fd, buf + next, n - next, next, fname);
+                break;
+            }
+            if (queued > 0) {
+                err = io_uring_submit(&ring);
+                if (err < 0) fail("io_uring_submit failed writing", -err);
+                else {
+                    queued -= err;
+                    inflight += err;
+                }
+            }
+        }
+        if (inflight == 0) break;    // Submit failed with nothing in flight
+
+        struct io_uring_cqe *cqe;
+        err = io_uring_wait_cqe(&ring, &cqe);
+        if (err < 0) {
+            if (err != -EINTR) fail("io_uring_wait_cqe failed writing", -err);
+            continue;    // Writes are still in flight; keep waiting for them
+        }
+        size_t const offset = (size_t)io_uring_cqe_get_data(cqe);
+        int const res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        --inflight;
+
+        if (res < 0) fail("Error writing", -res);
+        else if (error.empty()) {
+            size_t const len = std::min(write_bytes, n - offset);
+            if ((size_t)res < len) {    // Short write: finish this piece synchronously
+                try {
+                    pwrite_all(fd, buf + offset + res, len - res, offset + res, fname);
+                } catch (std::runtime_error const &e) {
+                    error = e.what();
+                }
+            }
+        }
+    }
+    if (!error.empty()) throw std::runtime_error(error);
+}
+#endif
+
+inline void fsync_dir_of(std::string const &fname)
+{
+    size_t const slash = fname.rfind('/');
+    std::string const dir(slash == std::string::npos ? "." : slash == 0 ? "/" : fname.substr(0, slash));
+    int const fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) throw io_error("Cannot open directory", dir);
+    FdCloser closer(fd);
+    if (::fsync(fd) < 0) throw io_error("Cannot fsync directory", dir);
+}
+
+/** Writes a whole file from one buffer; used by the async paths.
+Replaces fname atomically: the data goes to a temporary file, which is
+fsync()ed and then renamed over fname.  After a crash or I/O error,
+fname holds either its old contents or the new ones.
+@param before If valid, an earlier write to fname; the rename waits
+    for it, so the later write is the one left on disk. */
+inline void write_file(std::string const &fname, char const *buf, size_t const n,
+    std::shared_future<void> const &before = std::shared_future<void>())
+{
+    // Unique per call: one CheckpointWriter may be draining two
+    // checkpoints to the same name.
+    static std::atomic<unsigned long> serial(0);
+    std::string const tmp(fname + ".tmp" + std::to_string(::getpid()) + "." + std::to_string(serial++));
+
+    int const fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw io_error("Cannot open", tmp);
+    try {
+        FdCloser closer(fd);
+#ifdef BLITZ11_USE_IO_URING
+        uring_write_all(fd, buf, n, tmp);
+#else
+        pwrite_all(fd, buf, n, 0, tmp);
+#endif
+        if (::fsync(fd) < 0) throw io_error("Cannot fsync", tmp);
+        if (before.valid()) before.wait();    // Its errors are reported by its own future
+        if (::rename(tmp.c_str(), fname.c_str()) < 0) throw io_error("Cannot rename to", fname);
+    } catch(...) {
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    fsync_dir_of(fname);
+}
+
+/** Serializes a complete block file (preamble + data) into buf */
+template<class ValueT, class CharT, class IndexT>
+void snapshot_block(
+    std::vector<char> &buf,
+    MemoryBlock<CharT> const &memory,
+    std::vector<Dope<IndexT>> const &dopes,
+    size_t const alignment)
+{
+    std::vector<char> const preamble(
+        make_preamble<ValueT>(dopes, memory.size_bytes(), memory.origin_bytes(), alignment));
+    buf.resize(preamble.size() + memory.size_bytes());
+    std::memcpy(&buf[0], &preamble[0], preamble.size());
+    std::memcpy(&buf[preamble.size()], memory.data(), memory.size_bytes());
+}
+
+}    // namespace blockfile_detail
+
+
+/** Snapshots a MemoryBlock and writes it as a block file in the
+background.  The block may be modified as soon as this returns; the
+future reports completion (or rethrows the I/O error).
+
+The future comes from std::async, so its destructor blocks until the
+write is done: discarding it makes the save synchronous.  Nothing
+orders two outstanding saves to the same name; wait for the first
+before starting the second, or use CheckpointWriter. */
+template<class ValueT, class CharT, class IndexT>
+std::future<void> save_block_async(
+    std::string const &fname,
+    MemoryBlock<CharT> const &memory,
+    std::vector<Dope<IndexT>> const &dopes,
+    size_t const alignment = 4096)
+{
+    std::shared_ptr<std::vector<char>> buf(new std::vector<char>);
+    blockfile_detail::snapshot_block<ValueT>(*buf, memory, dopes, alignment);
+    return std::async(std::launch::async, [fname, buf]() {
+        blockfile_detail::write_file(fname, &(*buf)[0], buf->size());
+    });
+}
+
+template<class ValueT, class IndexT>
+std::future<void> save_async(std::string const &fname, GeneralArray<ValueT, IndexT> const &arr, size_t const alignment = 4096)
+    { return save_block_async<ValueT>(fname, arr.memory(), arr.dopes(), alignment); }
+
+template<class ValueT, int RANK, class IndexT>
+std::future<void> save_async(std::string const &fname, Array<ValueT, RANK, IndexT> const &arr, size_t const alignment = 4096)
+    { return save_block_async<ValueT>(fname, arr.memory(), arr.dopes(), alignment); }
+
+
+/** Multi-buffered write-behind checkpointing for a timestep loop.
+Snapshot buffers are reused between checkpoints rather than
+reallocated.  With nbuffers=2, checkpoint N+1 may be taken while
+checkpoint N is still draining; checkpoint N+2 waits for N.  Checkpoints
+to the same name replace it in the order they were saved. */
+class CheckpointWriter {
+    struct Slot {
+        std::string fname;
+        std::vector<char> buf;
+        std::shared_future<void> done;
+    };
+    std::vector<Slot> _slots;
+    size_t _next;
+
+public:
+    CheckpointWriter(int const nbuffers = 2) : _slots(std::max(1, nbuffers)), _next(0) {}
+
+    ~CheckpointWriter()
+    {
+        for (auto &slot : _slots)
+            if (slot.done.valid()) slot.done.wait();
+    }
+
+    CheckpointWriter(CheckpointWriter const &) = delete;
+    CheckpointWriter &operator=(CheckpointWriter const &) = delete;
+
+    template<class ValueT, class CharT, class IndexT>
+    std::shared_future<void> save_block(
+        std::string const &fname,
+        MemoryBlock<CharT> const &memory,
+        std::vector<Dope<IndexT>> const &dopes,
+        size_t const alignment = 4096)
+    {
+        size_t const n = _slots.size();
+
+        // Latest pending checkpoint to the same name (it in turn
+        // follows any earlier ones); ours is renamed after it.
+        std::shared_future<void> before;
+        for (size_t k=1; k<=n; ++k) {
+            Slot const &s(_slots[(_next + n - k) % n]);
+            if (s.done.valid() && s.fname == fname) {
+                before = s.done;
+                break;
+            }
+        }
+
+        Slot &slot(_slots[_next]);
+        _next = (_next + 1) % n;
+
+        // Wait for this buffer's previous checkpoint; its errors are
+        // reported through the future returned back then.
+        if (slot.done.valid()) slot.done.wait();
+
+        slot.fname = fname;
+        blockfile_detail::snapshot_block<ValueT>(slot.buf, memory, dopes, alignment);
+        std::vector<char> const *buf = &slot.buf;
+        slot.done = std::async(std::launch::async, [fname, buf, before]() {
+            blockfile_detail::write_file(fname, &(*buf)[0], buf->size(), before);
+        }).share();
+        return slot.done;
+    }
+
+    template<class ValueT, class IndexT>
+    std::shared_future<void> save(std::string const &fname, GeneralArray<ValueT, IndexT> const &arr, size_t const alignment = 4096)
+        { return save_block<ValueT>(fname, arr.memory(), arr.dopes(), alignment); }
+
+    template<class ValueT, int RANK, class IndexT>
+    std::shared_future<void> save(std::string const &fname, Array<ValueT, RANK, IndexT> const &arr, size_t const alignment = 4096)
+        { return save_block<ValueT>(fname, arr.memory(), arr.dopes(), alignment); }
+
+    /** Blocks until every outstanding checkpoint has been written;
+    rethrows the first error. */
+    void wait_all()
+    {
+        for (auto &slot : _slots)
+            if (slot.done.valid()) slot.done.get();
+    }
+};
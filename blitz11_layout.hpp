@@ -0,0 +1,479 @@
+/**
+Non-strided memory layouts, with the same indexing API as Array.
+
+TiledArray stores an index box as fixed-shape tiles: tiles are laid out
+row-major over the tile grid, and elements row-major within each tile,
+so a tile's 2-D/3-D neighbourhood is contiguous in memory.  Tile
+extents must be powers of two, so indexing is shifts and masks.  Edge
+tiles are padded to the full tile shape.
+
+Each tile is an ordinary dense strided box, so tile() and
+for_each_tile() hand tiles out as Array views sharing the tiled
+memory; the elementwise kernels (blitz11_ops.hpp) then run on each tile
+with unit inner stride.  Stencils do not: a tile view holds no halo, so
+apply_stencil() on one treats the tile's edges as the array boundary;
+run stencils on to_strided() data instead.  to_tiled() / to_strided() and
+copy() convert between layouts tile by tile.
+
+MortonArray stores an index box in Morton (Z) order: the bits of the
+coordinates (relative to the lower bounds) are interleaved, so elements
+close in any direction tend to share cache lines.  Each dimension is
+padded to a power of two; when extents differ, the shorter dimensions
+simply run out of bits first.  Coordinates are spread with BMI2 pdep
+(and gathered back with pext) when compiled for BMI2, otherwise with
+per-byte lookup tables.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+#include "blitz11_ops.hpp"
+
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+
+namespace layout_detail {
+
+/** log2(n) if n is a power of two, else -1 */
+template<class IndexT>
+int log2_exact(IndexT const n)
+{
+    if (n <= 0 || (n & (n-1)) != 0) return -1;
+    int s = 0;
+    while ((IndexT(1) << s) < n) ++s;
+    return s;
+}
+
+}    // namespace layout_detail
+
+
+template<class ValueT, int RANK, class IndexT=int>    // ValueT = double, const double, etc.
+class TiledArray {
+    typedef typename transfer_const<char, ValueT>::type CharT;
+
+    MemoryBlock<CharT> _memory;                   // Element (low, ..., low) at base()
+    std::array<std::array<IndexT,2>, RANK> _range;
+    std::array<IndexT, RANK> _tile;               // Tile shape
+    std::array<IndexT, RANK> _ntiles;             // Tiles in each dimension
+    std::array<int, RANK> _shift;                 // log2(_tile[k])
+    std::array<ptrdiff_t, RANK> _tile_stride;     // Elements between tiles
+    std::array<ptrdiff_t, RANK> _in_stride;       // Elements within a tile
+
+public:
+    /** Elements needed for [low, high) in tiles of shape tile.
+    Throws std::invalid_argument unless the tile extents are powers of two. */
+    static size_t size(IndexT const * const low, IndexT const * const high, IndexT const * const tile)
+    {
+        size_t n = 1;
+        for (int k=0; k<RANK; ++k) {
+            if (layout_detail::log2_exact(tile[k]) < 0)
+                throw std::invalid_argument("TiledArray: tile extents must be powers of two");
+            n *= (size_t)((std::max<IndexT>(0, high[k] - low[k]) + tile[k] - 1) / tile[k]) * tile[k];
+        }
+        return n;
+    }
+
+    TiledArray(MemoryBlock<CharT> const &memory,
+        IndexT const * const low, IndexT const * const high, IndexT const * const tile)
+        : _memory(memory)
+    {
+        ptrdiff_t in = 1;
+        for (int k=RANK-1; k>=0; --k) {
+            _shift[k] = layout_detail::log2_exact(tile[k]);
+            if (_shift[k] < 0)
+                throw std::invalid_argument("TiledArray: tile extents must be powers of two");
+            _range[k] = {{low[k], std::max(low[k], high[k])}};
+            _tile[k] = tile[k];
+            _ntiles[k] = (_range[k][1] - _range[k][0] + tile[k] - 1) / tile[k];
+            _in_stride[k] = in;
+            in *= tile[k];
+        }
+        ptrdiff_t t = in;    // Elements per tile
+        for (int k=RANK-1; k>=0; --k) {
+            _tile_stride[k] = t;
+            t *= _ntiles[k];
+        }
+        if (_memory.size_bytes() < (size_t)t * sizeof(ValueT))
+            throw std::invalid_argument("TiledArray: memory block too small");
+    }
+
+    static TiledArray allocate(IndexT const * const low, IndexT const * const high, IndexT const * const tile)
+    {
+        MemoryBlock<CharT> memory(size(low, high, tile) * sizeof(ValueT));
+        return TiledArray(memory, low, high, tile);
+    }
+
+    MemoryBlock<CharT> const &memory() const { return _memory; }
+    int rank() const { return RANK; }
+    std::array<IndexT,2> const &range(int const k) const { return _range[k]; }
+    IndexT tile_extent(int const k) const { return _tile[k]; }
+    IndexT ntiles(int const k) const { return _ntiles[k]; }
+
+    ValueT &operator()(IndexT const * const ix, RangeErrorFn const * const range_error=nullptr) const
+    {
+        ptrdiff_t off = 0;
+        for (int k=0; k<RANK; ++k) {
+            if (range_error && out_of_bounds(ix[k], _range[k][0], _range[k][1]))
+                range_error_detail::raise(*range_error, "Indexing", k, _range[k][0], _range[k][1], ix[k]);
+            IndexT const rel = ix[k] - _range[k][0];
+            off += (rel >> _shift[k]) * _tile_stride[k] + (rel & (_tile[k]-1)) * _in_stride[k];
+        }
+        return *reinterpret_cast<ValueT *>(_memory.index_bytes(off * (ptrdiff_t)sizeof(ValueT), range_error));
+    }
+
+    /** Tile t (t[k] in [0, ntiles(k))) as an Array view over its part of
+    the index box (edge tiles are clipped to it) */
+    Array<ValueT, RANK, IndexT> tile(IndexT const * const t) const
+    {
+        std::vector<Dope<IndexT>> dopes(RANK);
+        ptrdiff_t origin = 0;    // Elements from base() to the view's index (0, ..., 0)
+        for (int k=0; k<RANK; ++k) {
+            IndexT const lo = _range[k][0] + t[k] * _tile[k];
+            dopes[k].range = {{lo, std::min<IndexT>(lo + _tile[k], _range[k][1])}};
+            dopes[k].stride = _in_stride[k];
+            origin += t[k] * _tile_stride[k] - lo * _in_stride[k];
+        }
+        return Array<ValueT, RANK, IndexT>(
+            _memory.rebased(_memory.origin_bytes() + origin * (ptrdiff_t)sizeof(ValueT)), dopes);
+    }
+
+    /** Calls fn(tile(t)) for every tile, in memory order */
+    template<class FnT>
+    void for_each_tile(FnT &&fn) const
+    {
+        std::array<IndexT, RANK> t;
+        t.fill(0);
+        for (int k=0; k<RANK; ++k) if (_ntiles[k] == 0) return;
+        for (;;) {
+            fn(tile(&t[0]));
+            int k = RANK-1;
+            for (; k >= 0; --k) {
+                if (++t[k] < _ntiles[k]) break;
+                t[k] = 0;
+            }
+            if (k < 0) break;
+        }
+    }
+};
+
+
+namespace layout_detail {
+
+/** arr narrowed to the index box of view */
+template<class ValueT, int RANK, class IndexT, class ViewT>
+Array<ValueT, RANK, IndexT> sub_box(Array<ValueT, RANK, IndexT> const &arr, Array<ViewT, RANK, IndexT> const &view)
+{
+    std::vector<Dope<IndexT>> dopes(arr.dopes());
+    for (int k=0; k<RANK; ++k) dopes[k].range = view.dopes()[k].range;
+    return Array<ValueT, RANK, IndexT>(arr.memory(), dopes);
+}
+
+template<class ValueT, int RANK, class IndexT>
+void check_box(std::vector<Dope<IndexT>> const &dopes, TiledArray<ValueT, RANK, IndexT> const &tiled)
+{
+    for (int k=0; k<RANK; ++k)
+        if (dopes[k].range != tiled.range(k))
+            throw std::invalid_argument("Tiled copy: arrays cover different index boxes");
+}
+
+}    // namespace layout_detail
+
+
+/** Copies a strided array into a tiled one over the same index box */
+template<class DestT, class SrcT, int RANK, class IndexT>
+void copy(TiledArray<DestT, RANK, IndexT> const &dst, Array<SrcT, RANK, IndexT> const &src)
+{
+    layout_detail::check_box(src.dopes(), dst);
+    dst.for_each_tile([&src](Array<DestT, RANK, IndexT> const &t)
+        { copy(t, layout_detail::sub_box(src, t)); });
+}
+
+/** Copies a tiled array into a strided one over the same index box */
+template<class DestT, class SrcT, int RANK, class IndexT>
+void copy(Array<DestT, RANK, IndexT> const &dst, TiledArray<SrcT, RANK, IndexT> const &src)
+{
+    layout_detail::check_box(dst.dopes(), src);
+    src.for_each_tile([&dst](Array<SrcT, RANK, IndexT> const &t)
+        { copy(layout_detail::sub_box(dst, t), t); });
+}
+
+/** Tiled copy of arr */
+template<class ValueT, int RANK, class IndexT>
+TiledArray<typename std::remove_const<ValueT>::type, RANK, IndexT> to_tiled(
+    Array<ValueT, RANK, IndexT> const &arr, IndexT const * const tile)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    std::array<IndexT, RANK> low, high;
+    for (int k=0; k<RANK; ++k) {
+        low[k] = arr.dopes()[k].range[0];
+        high[k] = arr.dopes()[k].range[1];
+    }
+    TiledArray<T, RANK, IndexT> ret(TiledArray<T, RANK, IndexT>::allocate(&low[0], &high[0], tile));
+    copy(ret, arr);
+    return ret;
+}
+
+/** Dense row-major copy of a tiled array */
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK, IndexT> to_strided(
+    TiledArray<ValueT, RANK, IndexT> const &tiled)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    std::array<IndexT, RANK> low, high;
+    for (int k=0; k<RANK; ++k) {
+        low[k] = tiled.range(k)[0];
+        high[k] = tiled.range(k)[1];
+    }
+    std::vector<Dope<IndexT>> const dopes(row_major_dopes(&low[0], &high[0], RANK));
+    Array<T, RANK, IndexT> ret(allocate_block<T>(&dopes[0], RANK), dopes);
+    copy(ret, tiled);
+    return ret;
+}
+
+
+// ---------------------------------------------------------------
+// Morton (Z-order) layout
+
+namespace layout_detail {
+
+/** Software pdep: deposits the low bits of x into the set bits of mask */
+inline uint64_t deposit_bits(uint64_t const x, uint64_t mask)
+{
+    uint64_t ret = 0;
+    for (uint64_t bit=1; mask; bit <<= 1) {
+        if (x & bit) ret |= mask & (~mask + 1);
+        mask &= mask - 1;
+    }
+    return ret;
+}
+
+/** Software pext: gathers the bits of x under mask into the low bits */
+inline uint64_t extract_bits(uint64_t const x, uint64_t mask)
+{
+    uint64_t ret = 0;
+    for (uint64_t bit=1; mask; bit <<= 1) {
+        if (x & mask & (~mask + 1)) ret |= bit;
+        mask &= mask - 1;
+    }
+    return ret;
+}
+
+}    // namespace layout_detail
+
+
+template<class ValueT, int RANK, class IndexT=int>    // ValueT = double, const double, etc.
+class MortonArray {
+    typedef typename transfer_const<char, ValueT>::type CharT;
+
+    MemoryBlock<CharT> _memory;                   // Element (low, ..., low) at base()
+    std::array<std::array<IndexT,2>, RANK> _range;
+    std::array<uint64_t, RANK> _mask;             // Code bits of each dimension
+    int _bits;                                    // Total code bits
+#if !defined(__BMI2__)
+    // _table[(k*8 + j)*256 + b] = code bits of byte j of coordinate k equal to b
+    std::shared_ptr<std::vector<uint64_t> const> _table;
+    std::array<int, RANK> _nbytes;
+#endif
+
+public:
+    /** Spreads a relative coordinate of dimension k into its code bits */
+    uint64_t spread(int const k, uint64_t const rel) const
+    {
+#if defined(__BMI2__)
+        return _pdep_u64(rel, _mask[k]);
+#else
+        uint64_t const * const t = &(*_table)[k*8*256];
+        uint64_t ret = 0;
+        for (int j=0; j<_nbytes[k]; ++j) ret |= t[j*256 + ((rel >> (8*j)) & 0xff)];
+        return ret;
+#endif
+    }
+
+    /** Morton code (element offset) of index ix */
+    uint64_t code(IndexT const * const ix) const
+    {
+        uint64_t ret = 0;
+        for (int k=0; k<RANK; ++k) ret |= spread(k, (uint64_t)(ix[k] - _range[k][0]));
+        return ret;
+    }
+
+    /** Index of the element at Morton code c */
+    void decode(uint64_t const c, IndexT * const ix) const
+    {
+        for (int k=0; k<RANK; ++k) {
+#if defined(__BMI2__)
+            ix[k] = _range[k][0] + (IndexT)_pext_u64(c, _mask[k]);
+#else
+            ix[k] = _range[k][0] + (IndexT)layout_detail::extract_bits(c, _mask[k]);
+#endif
+        }
+    }
+
+    /** c with dimension k's coordinate advanced by one */
+    uint64_t next(uint64_t const c, int const k) const
+        { return (c & ~_mask[k]) | (((c | ~_mask[k]) + 1) & _mask[k]); }
+
+    /** Elements needed for [low, high): the product of the extents, each
+    rounded up to a power of two */
+    static size_t size(IndexT const * const low, IndexT const * const high)
+    {
+        size_t n = 1;
+        for (int k=0; k<RANK; ++k) {
+            size_t p = 1;
+            while ((IndexT)p < high[k] - low[k]) p <<= 1;
+            n *= p;
+        }
+        return n;
+    }
+
+    MortonArray(MemoryBlock<CharT> const &memory, IndexT const * const low, IndexT const * const high)
+        : _memory(memory), _bits(0)
+    {
+        std::array<int, RANK> nbits;
+        int total = 0;
+        for (int k=0; k<RANK; ++k) {
+            _range[k] = {{low[k], std::max(low[k], high[k])}};
+            nbits[k] = 0;
+            while ((IndexT(1) << nbits[k]) < _range[k][1] - _range[k][0]) ++nbits[k];
+            total += nbits[k];
+            _mask[k] = 0;
+        }
+        if (total > 63) throw std::invalid_argument("MortonArray: index box too large for a 64-bit code");
+
+        // Round-robin, the last dimension taking the lowest bit
+        std::array<int, RANK> used;
+        used.fill(0);
+        while (_bits < total) {
+            for (int k=RANK-1; k>=0; --k) {
+                if (used[k] < nbits[k]) {
+                    _mask[k] |= uint64_t(1) << _bits++;
+                    ++used[k];
+                }
+            }
+        }
+        if (_memory.size_bytes() < (size_t(1) << _bits) * sizeof(ValueT))
+            throw std::invalid_argument("MortonArray: memory block too small");
+
+#if !defined(__BMI2__)
+        std::shared_ptr<std::vector<uint64_t>> table(new std::vector<uint64_t>(RANK*8*256));
+        for (int k=0; k<RANK; ++k) {
+            _nbytes[k] = (nbits[k] + 7) / 8;
+            for (int j=0; j<_nbytes[k]; ++j)
+                for (int b=0; b<256; ++b)
+                    (*table)[(k*8 + j)*256 + b] = layout_detail::deposit_bits(uint64_t(b) << (8*j), _mask[k]);
+        }
+        _table = table;
+#endif
+    }
+
+    static MortonArray allocate(IndexT const * const low, IndexT const * const high)
+    {
+        MemoryBlock<CharT> memory(size(low, high) * sizeof(ValueT));
+        return MortonArray(memory, low, high);
+    }
+
+    MemoryBlock<CharT> const &memory() const { return _memory; }
+    int rank() const { return RANK; }
+    std::array<IndexT,2> const &range(int const k) const { return _range[k]; }
+    uint64_t mask(int const k) const { return _mask[k]; }
+
+    ValueT &operator()(IndexT const * const ix, RangeErrorFn const * const range_error=nullptr) const
+    {
+        if (range_error) {
+            for (int k=0; k<RANK; ++k)
+                if (out_of_bounds(ix[k], _range[k][0], _range[k][1]))
+                    range_error_detail::raise(*range_error, "Indexing", k, _range[k][0], _range[k][1], ix[k]);
+        }
+        ptrdiff_t const off = (ptrdiff_t)code(ix);
+        return *reinterpret_cast<ValueT *>(_memory.index_bytes(off * (ptrdiff_t)sizeof(ValueT), range_error));
+    }
+};
+
+
+namespace layout_detail {
+
+/** Calls fn(morton_element, strided_element) over the index box of
+strided, rows of the last dimension stepping the code incrementally */
+template<class MT, class ST, int RANK, class IndexT, class FnT>
+void morton_rows(MortonArray<MT, RANK, IndexT> const &morton, Array<ST, RANK, IndexT> const &strided, FnT const &fn)
+{
+    std::vector<Dope<IndexT>> const &dopes(strided.dopes());
+    for (int k=0; k<RANK; ++k)
+        if (dopes[k].range != morton.range(k))
+            throw std::invalid_argument("Morton copy: arrays cover different index boxes");
+
+    PositionMap<IndexT> const pm(dopes);
+    IndexT const n = dopes[RANK-1].range[1] - dopes[RANK-1].range[0];
+    if (pm.size() == 0) return;
+    ptrdiff_t const s = dopes[RANK-1].stride;
+    MT * const mbase = reinterpret_cast<MT *>(morton.memory().base());
+    ST * const sbase = reinterpret_cast<ST *>(strided.memory().base());
+
+    std::array<IndexT, RANK> ix;
+    for (int k=0; k<RANK; ++k) ix[k] = dopes[k].range[0];
+    for (size_t row=0; row < pm.size() / n; ++row) {
+        // Row start: decompose the row number over the outer dimensions
+        size_t r = row;
+        for (int k=RANK-2; k>=0; --k) {
+            IndexT const ext = dopes[k].range[1] - dopes[k].range[0];
+            ix[k] = dopes[k].range[0] + (IndexT)(r % ext);
+            r /= ext;
+        }
+        ix[RANK-1] = dopes[RANK-1].range[0];
+        uint64_t c = morton.code(&ix[0]);
+        ST * const sp = sbase + pm.diff(row * n);
+        for (IndexT j=0; j<n; ++j) {
+            fn(mbase[c], sp[j*s]);
+            c = morton.next(c, RANK-1);
+        }
+    }
+}
+
+}    // namespace layout_detail
+
+
+/** Copies a strided array into a Morton-ordered one over the same index box */
+template<class DestT, class SrcT, int RANK, class IndexT>
+void copy(MortonArray<DestT, RANK, IndexT> const &dst, Array<SrcT, RANK, IndexT> const &src)
+    { layout_detail::morton_rows(dst, src, [](DestT &d, SrcT &s) { d = s; }); }
+
+/** Copies a Morton-ordered array into a strided one over the same index box */
+template<class DestT, class SrcT, int RANK, class IndexT>
+void copy(Array<DestT, RANK, IndexT> const &dst, MortonArray<SrcT, RANK, IndexT> const &src)
+    { layout_detail::morton_rows(src, dst, [](SrcT &s, DestT &d) { d = s; }); }
+
+/** Morton-ordered copy of arr */
+template<class ValueT, int RANK, class IndexT>
+MortonArray<typename std::remove_const<ValueT>::type, RANK, IndexT> to_morton(Array<ValueT, RANK, IndexT> const &arr)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    std::array<IndexT, RANK> low, high;
+    for (int k=0; k<RANK; ++k) {
+        low[k] = arr.dopes()[k].range[0];
+        high[k] = arr.dopes()[k].range[1];
+    }
+    MortonArray<T, RANK, IndexT> ret(MortonArray<T, RANK, IndexT>::allocate(&low[0], &high[0]));
+    copy(ret, arr);
+    return ret;
+}
+
+/** Dense row-major copy of a Morton-ordered array */
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK, IndexT> to_strided(
+    MortonArray<ValueT, RANK, IndexT> const &morton)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    std::array<IndexT, RANK> low, high;
+    for (int k=0; k<RANK; ++k) {
+        low[k] = morton.range(k)[0];
+        high[k] = morton.range(k)[1];
+    }
+    std::vector<Dope<IndexT>> const dopes(row_major_dopes(&low[0], &high[0], RANK));
+    Array<T, RANK, IndexT> ret(allocate_block<T>(&dopes[0], RANK), dopes);
+    copy(ret, morton);
+    return ret;
+}
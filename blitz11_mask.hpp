@@ -0,0 +1,270 @@
+/**
+Masked arrays: an Array plus a Mask of active cells (eg: ocean points).
+
+A Mask covers an index box and stores the active cells twice: as a
+bitmask, for O(1) membership tests, and as runs of consecutive active
+positions (see PositionMap), each within one row of the innermost
+dimension.  Masked operations walk the runs only, so inactive stretches
+are skipped wholesale, and each run is a plain strided inner loop.
+
+Masks are shared (std::shared_ptr<Mask const>) by any number of
+MaskedArrays over the same index box.  Operands of binary operations
+are Arrays over the same box, matched by position.
+
+compact() packs the active cells into a dense rank-1 Array in position
+order, for kernels that want contiguous data; expand() writes such an
+array back.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <cstdint>
+#include <memory>
+
+
+/** Consecutive active positions [pos, pos+len), all in one innermost row */
+template<class IndexT>
+struct MaskRun {
+    size_t pos;
+    IndexT len;
+};
+
+template<class IndexT=int>
+class Mask {
+    std::vector<std::array<IndexT,2>> _range;    // Index box
+    std::vector<uint64_t> _bits;                  // Bit p set if position p is active
+    std::vector<MaskRun<IndexT>> _runs;
+    size_t _size;
+    size_t _count;
+
+    /** Sets bits and runs from arr: active where is_active(value) */
+    template<class ValueT, int RANK, class FnT>
+    void build(Array<ValueT, RANK, IndexT> const &arr, FnT const &is_active)
+    {
+        std::vector<Dope<IndexT>> const &dopes(arr.dopes());
+        PositionMap<IndexT> const pm(dopes);
+        _size = pm.size();
+        _count = 0;
+        for (int k=0; k<RANK; ++k) _range.push_back(dopes[k].range);
+        _bits.assign((_size + 63) / 64, 0);
+        if (_size == 0) return;
+
+        IndexT const n = dopes[RANK-1].range[1] - dopes[RANK-1].range[0];
+        ptrdiff_t const s = dopes[RANK-1].stride;
+        ValueT const * const base = reinterpret_cast<ValueT const *>(arr.memory().base());
+        for (size_t row=0; row < _size / n; ++row) {
+            ValueT const * const p = base + pm.diff(row * n);
+            for (IndexT j=0; j<n; ++j) {
+                if (!is_active(p[j*s])) continue;
+                size_t const pos = row*n + j;
+                _bits[pos / 64] |= uint64_t(1) << (pos % 64);
+                ++_count;
+                if (j > 0 && !_runs.empty() && _runs.back().pos + _runs.back().len == pos)
+                    ++_runs.back().len;
+                else
+                    _runs.push_back(MaskRun<IndexT>{pos, 1});
+            }
+        }
+    }
+
+    Mask() {}
+
+public:
+    /** Active where m is non-zero */
+    template<class MaskT, int RANK>
+    explicit Mask(Array<MaskT, RANK, IndexT> const &m)
+        { build(m, [](MaskT const &x) { return x != MaskT(0); }); }
+
+    /** Active where pred(arr(ix)) is true */
+    template<class ValueT, int RANK, class PredT>
+    static std::shared_ptr<Mask const> where(Array<ValueT, RANK, IndexT> const &arr, PredT const &pred)
+    {
+        std::shared_ptr<Mask> mask(new Mask());
+        mask->build(arr, pred);
+        return mask;
+    }
+
+    int rank() const { return _range.size(); }
+    std::vector<std::array<IndexT,2>> const &range() const { return _range; }
+    size_t size() const { return _size; }
+    size_t count() const { return _count; }
+    std::vector<MaskRun<IndexT>> const &runs() const { return _runs; }
+
+    bool active(size_t const pos) const
+        { return (_bits[pos / 64] >> (pos % 64)) & 1; }
+
+    /** True if dopes cover exactly this mask's index box */
+    bool matches(std::vector<Dope<IndexT>> const &dopes) const
+    {
+        if (dopes.size() != _range.size()) return false;
+        for (size_t k=0; k<dopes.size(); ++k) if (dopes[k].range != _range[k]) return false;
+        return true;
+    }
+};
+
+
+template<class ValueT, int RANK, class IndexT=int>
+class MaskedArray {
+    Array<ValueT, RANK, IndexT> _array;
+    std::shared_ptr<Mask<IndexT> const> _mask;
+
+public:
+    MaskedArray(Array<ValueT, RANK, IndexT> const &array, std::shared_ptr<Mask<IndexT> const> const &mask)
+        : _array(array), _mask(mask)
+    {
+        if (!_mask->matches(_array.dopes()))
+            throw std::invalid_argument("MaskedArray: mask and array cover different index boxes");
+    }
+
+    Array<ValueT, RANK, IndexT> const &array() const { return _array; }
+    Mask<IndexT> const &mask() const { return *_mask; }
+    std::shared_ptr<Mask<IndexT> const> const &mask_ptr() const { return _mask; }
+
+    /** Calls fn(p, stride, len, pos) for each run, p pointing at the
+    run's first element in this array */
+    template<class FnT>
+    void for_each_run(FnT &&fn) const
+    {
+        PositionMap<IndexT> const pm(_array.dopes());
+        ValueT * const base = reinterpret_cast<ValueT *>(_array.memory().base());
+        ptrdiff_t const s = _array.dopes()[RANK-1].stride;
+        for (auto const &run : _mask->runs()) fn(base + pm.diff(run.pos), s, run.len, run.pos);
+    }
+};
+
+
+namespace mask_detail {
+
+/** Pointer to the first element of each run in another array over the
+same box, which need not share the masked array's layout */
+template<class ValueT, int RANK, class IndexT>
+struct RunCursor {
+    PositionMap<IndexT> const pm;
+    ValueT * const base;
+    ptrdiff_t const stride;
+
+    RunCursor(Array<ValueT, RANK, IndexT> const &arr)
+        : pm(arr.dopes()), base(reinterpret_cast<ValueT *>(arr.memory().base())),
+        stride(arr.dopes()[RANK-1].stride) {}
+
+    ValueT *at(size_t const pos) const { return base + pm.diff(pos); }
+};
+
+template<class IndexT>
+void check_box(Mask<IndexT> const &mask, std::vector<Dope<IndexT>> const &dopes)
+{
+    if (!mask.matches(dopes))
+        throw std::invalid_argument("Masked operation: operand covers a different index box");
+}
+
+}    // namespace mask_detail
+
+
+/** Sets the active cells to val */
+template<class ValueT, int RANK, class IndexT>
+void fill(MaskedArray<ValueT, RANK, IndexT> const &dst, typename std::remove_const<ValueT>::type const &val)
+{
+    dst.for_each_run([&val](ValueT * const p, ptrdiff_t const s, IndexT const n, size_t) {
+        if (s == 1) for (IndexT j=0; j<n; ++j) p[j] = val;
+        else for (IndexT j=0; j<n; ++j) p[j*s] = val;
+    });
+}
+
+/** dst = fn(src) on the active cells of dst */
+template<class DestT, class SrcT, int RANK, class IndexT, class FnT>
+void transform(MaskedArray<DestT, RANK, IndexT> const &dst, Array<SrcT, RANK, IndexT> const &src, FnT const &fn)
+{
+    mask_detail::check_box(dst.mask(), src.dopes());
+    mask_detail::RunCursor<SrcT, RANK, IndexT> const sc(src);
+    dst.for_each_run([&](DestT * const d, ptrdiff_t const ds, IndexT const n, size_t const pos) {
+        SrcT * const s = sc.at(pos);
+        ptrdiff_t const ss = sc.stride;
+        if (ds == 1 && ss == 1) for (IndexT j=0; j<n; ++j) d[j] = fn(s[j]);
+        else for (IndexT j=0; j<n; ++j) d[j*ds] = fn(s[j*ss]);
+    });
+}
+
+/** dst = fn(a, b) on the active cells of dst */
+template<class DestT, class AT, class BT, int RANK, class IndexT, class FnT>
+void transform(MaskedArray<DestT, RANK, IndexT> const &dst,
+    Array<AT, RANK, IndexT> const &a, Array<BT, RANK, IndexT> const &b, FnT const &fn)
+{
+    mask_detail::check_box(dst.mask(), a.dopes());
+    mask_detail::check_box(dst.mask(), b.dopes());
+    mask_detail::RunCursor<AT, RANK, IndexT> const ac(a);
+    mask_detail::RunCursor<BT, RANK, IndexT> const bc(b);
+    dst.for_each_run([&](DestT * const d, ptrdiff_t const ds, IndexT const n, size_t const pos) {
+        AT * const ap = ac.at(pos);
+        BT * const bp = bc.at(pos);
+        if (ds == 1 && ac.stride == 1 && bc.stride == 1)
+            for (IndexT j=0; j<n; ++j) d[j] = fn(ap[j], bp[j]);
+        else
+            for (IndexT j=0; j<n; ++j) d[j*ds] = fn(ap[j*ac.stride], bp[j*bc.stride]);
+    });
+}
+
+/** Copies src into the active cells of dst */
+template<class DestT, class SrcT, int RANK, class IndexT>
+void copy(MaskedArray<DestT, RANK, IndexT> const &dst, Array<SrcT, RANK, IndexT> const &src)
+{
+    typedef typename std::remove_const<SrcT>::type T;
+    transform(dst, src, [](T const &x) { return x; });
+}
+
+/** Folds op over the active cells, in position order */
+template<class AccT, class ValueT, int RANK, class IndexT, class OpT>
+AccT reduce(MaskedArray<ValueT, RANK, IndexT> const &arr, AccT const &init, OpT const &op)
+{
+    AccT acc(init);
+    arr.for_each_run([&](ValueT * const p, ptrdiff_t const s, IndexT const n, size_t) {
+        AccT a(acc);
+        if (s == 1) for (IndexT j=0; j<n; ++j) a = op(a, p[j]);
+        else for (IndexT j=0; j<n; ++j) a = op(a, p[j*s]);
+        acc = a;
+    });
+    return acc;
+}
+
+template<class ValueT, int RANK, class IndexT>
+typename std::remove_const<ValueT>::type sum(MaskedArray<ValueT, RANK, IndexT> const &arr)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    return reduce(arr, T(0), [](T const &a, T const &b) { return a + b; });
+}
+
+
+/** Active cells packed densely, in position order: Array over [0, count) */
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, 1, IndexT> compact(MaskedArray<ValueT, RANK, IndexT> const &arr)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    IndexT const low = 0, high = (IndexT)arr.mask().count();
+    std::vector<Dope<IndexT>> const dopes(row_major_dopes(&low, &high, 1));
+    Array<T, 1, IndexT> ret(allocate_block<T>(&dopes[0], 1), dopes);
+
+    T *out = reinterpret_cast<T *>(ret.memory().base());
+    arr.for_each_run([&out](ValueT * const p, ptrdiff_t const s, IndexT const n, size_t) {
+        if (s == 1) std::copy(p, p + n, out);
+        else for (IndexT j=0; j<n; ++j) out[j] = p[j*s];
+        out += n;
+    });
+    return ret;
+}
+
+/** Inverse of compact(): writes packed[i] to the i-th active cell of dst */
+template<class ValueT, int RANK, class IndexT, class SrcT>
+void expand(MaskedArray<ValueT, RANK, IndexT> const &dst, Array<SrcT, 1, IndexT> const &packed)
+{
+    Dope<IndexT> const &pd(packed.dopes()[0]);
+    if ((size_t)(pd.range[1] - pd.range[0]) != dst.mask().count())
+        throw std::invalid_argument("expand: packed array size differs from the mask's active count");
+
+    SrcT *in = reinterpret_cast<SrcT *>(packed.memory().base()) + pd.range[0] * pd.stride;
+    ptrdiff_t const is = pd.stride;
+    dst.for_each_run([&in, is](ValueT * const p, ptrdiff_t const s, IndexT const n, size_t) {
+        for (IndexT j=0; j<n; ++j) p[j*s] = in[j*is];
+        in += n * is;
+    });
+}
@@ -0,0 +1,291 @@
+/**
+Zero-copy interoperability between blitz11 arrays and mdspan.
+
+Uses std::mdspan where the standard library provides it (C++23),
+otherwise the reference implementation's <experimental/mdspan>.
+Requires C++17.
+
+mdspan indices always start at 0, so index j of dimension k in the
+mdspan is index dopes[k].range[0] + j of the Array.
+
+to_mdspan<layout_dope>() works for any Array: layout_dope is a custom
+layout policy whose mapping allows negative strides and folds the
+array's non-zero bases into a constant offset.  to_mdspan<layout_stride>(),
+<layout_right>() and <layout_left>() give kernels the standard layouts
+(and their compile-time optimizations) when the array's strides allow
+it, and throw std::invalid_argument otherwise.
+
+from_mdspan() borrows the storage of any strided mdspan as an Array.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <limits>
+#include <utility>
+
+#if defined(__has_include)
+#  if __has_include(<mdspan>)
+#    include <mdspan>
+#  endif
+#endif
+
+#if defined(__cpp_lib_mdspan)
+namespace blitz11_md = std;
+#else
+#  include <experimental/mdspan>
+namespace blitz11_md = std::experimental;
+#endif
+
+
+/** Layout policy for blitz11 dope vectors: arbitrary (including
+negative) strides, plus a constant offset so that every element lies
+at a non-negative offset from the mdspan's data_handle. */
+struct layout_dope {
+    template<class Extents>
+    class mapping {
+    public:
+        typedef Extents extents_type;
+        typedef typename extents_type::index_type index_type;
+        typedef typename extents_type::size_type size_type;
+        typedef typename extents_type::rank_type rank_type;
+        typedef layout_dope layout_type;
+
+        static_assert(std::is_signed<index_type>::value,
+            "layout_dope requires a signed index_type (strides may be negative)");
+
+    private:
+        static constexpr size_t RANK = extents_type::rank();
+        extents_type _extents;
+        std::array<index_type, RANK> _strides;
+        index_type _offset;    // Offset of element (0,...,0) from data_handle
+
+        template<class... Indices, size_t... Ks>
+        constexpr index_type apply(std::index_sequence<Ks...>, Indices... ix) const
+            { return (_offset + ... + (static_cast<index_type>(ix) * _strides[Ks])); }
+
+    public:
+        constexpr mapping() noexcept : _extents(), _strides(), _offset(0) {}
+
+        mapping(extents_type const &extents, std::array<index_type, RANK> const &strides, index_type const offset)
+            : _extents(extents), _strides(strides), _offset(offset) {}
+
+        constexpr extents_type const &extents() const noexcept { return _extents; }
+        constexpr std::array<index_type, RANK> strides() const noexcept { return _strides; }
+        constexpr index_type offset() const noexcept { return _offset; }
+
+        constexpr index_type required_span_size() const noexcept
+        {
+            index_type span = _offset + 1;
+            for (rank_type r=0; r<RANK; ++r) {
+                if (_extents.extent(r) == 0) return 0;
+                if (_strides[r] > 0) span += (_extents.extent(r)-1) * _strides[r];
+            }
+            return span;
+        }
+
+        template<class... Indices>
+        constexpr index_type operator()(Indices... ix) const noexcept
+        {
+            static_assert(sizeof...(Indices) == RANK, "layout_dope: wrong number of indices");
+            return apply(std::make_index_sequence<RANK>(), ix...);
+        }
+
+        // Strides may be 0 or overlap, so uniqueness is checked at runtime
+        static constexpr bool is_always_unique() noexcept { return false; }
+        static constexpr bool is_always_exhaustive() noexcept { return false; }
+        static constexpr bool is_always_strided() noexcept { return true; }
+        static constexpr bool is_strided() noexcept { return true; }
+
+        /** True if the dimensions nest: taken by increasing |stride|,
+        each stride clears the span of the ones before it.  (Sufficient,
+        not necessary, for uniqueness; the standard allows that.) */
+        constexpr bool is_unique() const noexcept
+        {
+            std::array<index_type, RANK> s{};
+            for (rank_type r=0; r<RANK; ++r) {
+                if (_extents.extent(r) == 0) return true;
+                s[r] = (_strides[r] < 0 ? -_strides[r] : _strides[r]);
+            }
+            index_type span = 1;    // Span of the dimensions nested so far
+            for (rank_type k=0; k<RANK; ++k) {
+                rank_type best = 0;
+                for (rank_type r=1; r<RANK; ++r) if (s[r] < s[best]) best = r;
+                if (_extents.extent(best) > 1) {
+                    if (s[best] < span) return false;
+                    span = s[best] * _extents.extent(best);
+                }
+                s[best] = std::numeric_limits<index_type>::max();
+            }
+            return true;
+        }
+
+        /** True if the elements exactly fill [0, required_span_size()) */
+        constexpr bool is_exhaustive() const noexcept
+        {
+            index_type n = 1;
+            for (rank_type r=0; r<RANK; ++r) n *= _extents.extent(r);
+            return n == required_span_size() && is_unique();
+        }
+
+        constexpr index_type stride(rank_type const r) const noexcept { return _strides[r]; }
+
+        friend constexpr bool operator==(mapping const &a, mapping const &b) noexcept
+            { return a._extents == b._extents && a._strides == b._strides && a._offset == b._offset; }
+    };
+};
+
+
+template<class ValueT, int RANK, class IndexT, class LayoutT>
+using array_mdspan = blitz11_md::mdspan<ValueT, blitz11_md::dextents<IndexT, RANK>, LayoutT>;
+
+namespace mdspan_detail {
+
+/** Builds the mapping for layout LayoutT from dopes; specialized per layout */
+template<class LayoutT>
+struct make_mapping;
+
+template<>
+struct make_mapping<layout_dope> {
+    template<class ExtentsT, class IndexT, size_t RANK>
+    static typename layout_dope::template mapping<ExtentsT> make(
+        ExtentsT const &extents, Dope<IndexT> const *dopes, ptrdiff_t &first_diff)
+    {
+        typedef typename ExtentsT::index_type index_type;
+        std::array<ptrdiff_t,2> const diffs(diff_range(dopes, RANK));
+        first_diff = diffs[0];
+        std::array<index_type, RANK> strides;
+        ptrdiff_t low_diff = 0;
+        for (size_t k=0; k<RANK; ++k) {
+            strides[k] = dopes[k].stride;
+            low_diff += dopes[k].range[0] * dopes[k].stride;
+        }
+        return typename layout_dope::template mapping<ExtentsT>(
+            extents, strides, low_diff - diffs[0]);
+    }
+};
+
+template<>
+struct make_mapping<blitz11_md::layout_stride> {
+    template<class ExtentsT, class IndexT, size_t RANK>
+    static typename blitz11_md::layout_stride::template mapping<ExtentsT> make(
+        ExtentsT const &extents, Dope<IndexT> const *dopes, ptrdiff_t &first_diff)
+    {
+        typedef typename ExtentsT::index_type index_type;
+        std::array<index_type, RANK> strides;
+        first_diff = 0;
+        for (size_t k=0; k<RANK; ++k) {
+            if (dopes[k].stride <= 0)
+                throw std::invalid_argument("to_mdspan<layout_stride>: strides must be positive");
+            strides[k] = dopes[k].stride;
+            first_diff += dopes[k].range[0] * dopes[k].stride;
+        }
+        return typename blitz11_md::layout_stride::template mapping<ExtentsT>(extents, strides);
+    }
+};
+
+/** layout_right / layout_left: strides must be exactly dense in that order */
+template<class LayoutT, bool RIGHT>
+struct make_dense_mapping {
+    template<class ExtentsT, class IndexT, size_t RANK>
+    static typename LayoutT::template mapping<ExtentsT> make(
+        ExtentsT const &extents, Dope<IndexT> const *dopes, ptrdiff_t &first_diff)
+    {
+        ptrdiff_t expect = 1;
+        first_diff = 0;
+        for (size_t i=0; i<RANK; ++i) {
+            size_t const k = (RIGHT ? RANK-1-i : i);
+            if (extents.extent(k) > 1 && dopes[k].stride != expect)
+                throw std::invalid_argument(RIGHT
+                    ? "to_mdspan<layout_right>: array is not dense row-major"
+                    : "to_mdspan<layout_left>: array is not dense column-major");
+            expect *= extents.extent(k);
+            first_diff += dopes[k].range[0] * dopes[k].stride;
+        }
+        return typename LayoutT::template mapping<ExtentsT>(extents);
+    }
+};
+
+template<>
+struct make_mapping<blitz11_md::layout_right>
+    : public make_dense_mapping<blitz11_md::layout_right, true> {};
+
+template<>
+struct make_mapping<blitz11_md::layout_left>
+    : public make_dense_mapping<blitz11_md::layout_left, false> {};
+
+template<class ValueT, int RANK, class IndexT, class LayoutT, class CharT>
+array_mdspan<ValueT, RANK, IndexT, LayoutT> to_mdspan(
+    MemoryBlock<CharT> const &memory, std::vector<Dope<IndexT>> const &dopes)
+{
+    typedef blitz11_md::dextents<IndexT, RANK> ExtentsT;
+    std::array<IndexT, RANK> ext;
+    for (int k=0; k<RANK; ++k)
+        ext[k] = std::max<IndexT>(0, dopes[k].range[1] - dopes[k].range[0]);
+
+    ptrdiff_t first_diff;    // Index diff of the element at data_handle
+    auto const map(make_mapping<LayoutT>::template make<ExtentsT, IndexT, RANK>(
+        ExtentsT(ext), &dopes[0], first_diff));
+    ValueT * const data = reinterpret_cast<ValueT *>(memory.base()) + first_diff;
+    return array_mdspan<ValueT, RANK, IndexT, LayoutT>(data, map);
+}
+
+template<class MappingT, size_t... Ks>
+typename MappingT::index_type map_zero(MappingT const &map, std::index_sequence<Ks...>)
+    { return map(((void)Ks, 0)...); }
+
+}    // namespace mdspan_detail
+
+
+/** Views an Array as an mdspan, with no copy */
+template<class LayoutT = layout_dope, class ValueT, int RANK, class IndexT>
+array_mdspan<ValueT, RANK, IndexT, LayoutT> to_mdspan(Array<ValueT, RANK, IndexT> const &arr)
+{
+    return mdspan_detail::to_mdspan<ValueT, RANK, IndexT, LayoutT>(arr.memory(), arr.dopes());
+}
+
+/** Views a GeneralArray of known rank as an mdspan, with no copy */
+template<int RANK, class LayoutT = layout_dope, class ValueT, class IndexT>
+array_mdspan<ValueT, RANK, IndexT, LayoutT> to_mdspan(GeneralArray<ValueT, IndexT> const &arr)
+{
+    if (arr.rank() != RANK)
+        throw std::invalid_argument("to_mdspan: GeneralArray has the wrong rank");
+    return mdspan_detail::to_mdspan<ValueT, RANK, IndexT, LayoutT>(arr.memory(), arr.dopes());
+}
+
+
+/** Borrows the storage of a strided mdspan as an Array, with no copy.
+@param low Lower bounds for the Array's dimensions; nullptr for all 0. */
+template<class IndexT = int, class ElementT, class ExtentsT, class LayoutT, class AccessorT>
+Array<ElementT, (int)ExtentsT::rank(), IndexT> from_mdspan(
+    blitz11_md::mdspan<ElementT, ExtentsT, LayoutT, AccessorT> const &md,
+    IndexT const *low = nullptr)
+{
+    static_assert(std::is_same<AccessorT, blitz11_md::default_accessor<ElementT>>::value,
+        "from_mdspan: only default_accessor can be borrowed");
+    constexpr int RANK = ExtentsT::rank();
+    typedef typename transfer_const<char, ElementT>::type CharT;
+
+    if (!md.is_strided())
+        throw std::invalid_argument("from_mdspan: mdspan layout is not strided");
+
+    std::vector<Dope<IndexT>> dopes(RANK);
+    ptrdiff_t low_diff = 0;
+    for (int k=0; k<RANK; ++k) {
+        IndexT const lo = (low ? low[k] : 0);
+        dopes[k].range[0] = lo;
+        dopes[k].range[1] = lo + (IndexT)md.extent(k);
+        dopes[k].stride = (ptrdiff_t)md.stride(k);
+        low_diff += lo * dopes[k].stride;
+    }
+
+    // Element (0,...,0) of the mdspan is at data_handle() + zero_offset
+    ptrdiff_t const zero_offset = (ptrdiff_t)mdspan_detail::map_zero(
+        md.mapping(), std::make_index_sequence<RANK>());
+    MemoryBlock<CharT> memory(
+        reinterpret_cast<CharT *>(md.data_handle()),
+        md.mapping().required_span_size() * sizeof(ElementT));
+    return Array<ElementT, RANK, IndexT>(
+        memory.rebased((zero_offset - low_diff) * (ptrdiff_t)sizeof(ElementT)), dopes);
+}
@@ -0,0 +1,253 @@
+/**
+Allocation instrumentation for MemoryBlock, enabled by defining
+BLITZ11_MEMSTATS before including blitz11.hpp.
+
+Every block MemoryBlock allocates itself (allocate_block(), detach()
+clones, etc.) is counted at allocation and at free: live and peak
+bytes, overall and per tag; allocation counts by power-of-two size
+class.  Borrowed memory and blocks wrapping someone else's shared_ptr
+are not ours and are not counted.
+
+Tags name what the memory is for (eg: a field name).  A MemTag in
+scope tags all blocks allocated by its thread until it goes out of
+scope; tags nest.
+
+    MemTag tag("temperature");
+    auto t = allocate_block<double>(...);    // Counted under "temperature"
+    ...
+    std::cout << memstats_snapshot();
+    MemStatsDumper dump(std::cerr, 10000);  // Every 10s, while in scope
+
+Without BLITZ11_MEMSTATS, MemTag, MemStatsDumper and MemStatsSnapshot
+compile to empty objects, memstats_snapshot() prints nothing and
+MemoryBlock allocates as before, so instrumented code can stay in place.
+*/
+
+#pragma once
+
+#include <string>
+
+#ifdef BLITZ11_MEMSTATS
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <type_traits>
+
+
+/** Counters for one tag, or for all allocations */
+struct MemCounts {
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t nalloc;    // Allocations so far
+    size_t nfree;     // Frees so far
+
+    MemCounts() : live_bytes(0), peak_bytes(0), nalloc(0), nfree(0) {}
+    size_t live_blocks() const { return nalloc - nfree; }
+};
+
+struct MemStatsSnapshot {
+    MemCounts total;
+    /** Size class k counts blocks of [2^(k-1), 2^k) bytes (class 0: empty blocks) */
+    std::array<size_t, 65> nalloc_by_class;
+    std::array<size_t, 65> live_by_class;
+    std::map<std::string, MemCounts> by_tag;    // "" for untagged blocks
+};
+
+
+namespace memstats_detail {
+
+inline int size_class(size_t n)
+{
+    int k = 0;
+    while (n) { ++k; n >>= 1; }
+    return k;
+}
+
+struct Registry {
+    std::mutex mutex;
+    MemStatsSnapshot stats;
+
+    Registry() {
+        stats.nalloc_by_class.fill(0);
+        stats.live_by_class.fill(0);
+    }
+
+    static Registry &instance()
+    {
+        static Registry *reg = new Registry();    // Never destroyed: frees may run at exit
+        return *reg;
+    }
+
+    static void add(MemCounts &c, size_t const n)
+    {
+        c.live_bytes += n;
+        c.peak_bytes = std::max(c.peak_bytes, c.live_bytes);
+        ++c.nalloc;
+    }
+
+    static void sub(MemCounts &c, size_t const n)
+    {
+        c.live_bytes -= n;
+        ++c.nfree;
+    }
+
+    /** Returns the tag's counters, whose address stays valid */
+    MemCounts *on_alloc(size_t const n, std::string const &tag)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        add(stats.total, n);
+        int const k = size_class(n);
+        ++stats.nalloc_by_class[k];
+        ++stats.live_by_class[k];
+        MemCounts *tc = &stats.by_tag[tag];
+        add(*tc, n);
+        return tc;
+    }
+
+    void on_free(size_t const n, MemCounts * const tc)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sub(stats.total, n);
+        --stats.live_by_class[size_class(n)];
+        sub(*tc, n);
+    }
+};
+
+/** Innermost MemTag of this thread */
+inline std::string const *&current_tag()
+{
+    static thread_local std::string const *tag = nullptr;
+    return tag;
+}
+
+template<class CharT>
+struct CountingDeleter {
+    size_t size_bytes;
+    MemCounts *tag;
+
+    void operator()(CharT const * p)
+    {
+        delete[] p;
+        Registry::instance().on_free(size_bytes, tag);
+    }
+};
+
+/** Allocation hook used by MemoryBlock(size_t) */
+template<class CharT>
+std::shared_ptr<CharT> allocate(size_t const size_bytes)
+{
+    CharT * const p = new typename std::remove_const<CharT>::type[size_bytes];
+    std::string const * const tag = current_tag();
+    MemCounts * const tc = Registry::instance().on_alloc(size_bytes, tag ? *tag : std::string());
+    return std::shared_ptr<CharT>(p, CountingDeleter<CharT>{size_bytes, tc});
+}
+
+}    // namespace memstats_detail
+
+
+/** Tags blocks allocated by this thread while in scope */
+class MemTag {
+    std::string const _tag;
+    std::string const *_outer;
+
+public:
+    explicit MemTag(std::string const &tag)
+        : _tag(tag), _outer(memstats_detail::current_tag())
+        { memstats_detail::current_tag() = &_tag; }
+    ~MemTag() { memstats_detail::current_tag() = _outer; }
+
+    MemTag(MemTag const &) = delete;
+    MemTag &operator=(MemTag const &) = delete;
+};
+
+inline MemStatsSnapshot memstats_snapshot()
+{
+    memstats_detail::Registry &reg(memstats_detail::Registry::instance());
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return reg.stats;
+}
+
+inline std::ostream &operator<<(std::ostream &os, MemStatsSnapshot const &s)
+{
+    auto const row = [&os](std::string const &name, MemCounts const &c) {
+        os << "  " << std::left << std::setw(24) << name << std::right
+            << std::setw(16) << c.live_bytes << std::setw(16) << c.peak_bytes
+            << std::setw(10) << c.live_blocks() << std::setw(10) << c.nalloc << "\n";
+    };
+
+    os << "blitz11 memory: " << std::left << std::setw(15) << "" << std::right
+        << std::setw(16) << "live bytes" << std::setw(16) << "peak bytes"
+        << std::setw(10) << "live" << std::setw(10) << "allocs" << "\n";
+    row("(total)", s.total);
+    for (auto const &t : s.by_tag) row(t.first.empty() ? "(untagged)" : t.first, t.second);
+
+    os << "  allocs/live by size, 2^k bytes up:";
+    for (int k=0; k<(int)s.nalloc_by_class.size(); ++k) {
+        if (!s.nalloc_by_class[k]) continue;
+        if (k == 0) os << " empty";
+        else os << " 2^" << k-1;
+        os << ":" << s.nalloc_by_class[k] << "/" << s.live_by_class[k];
+    }
+    return os << "\n";
+}
+
+/** Writes memstats_snapshot() to os every interval_ms, from a
+background thread, until destroyed */
+class MemStatsDumper {
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop;
+    std::thread _thread;
+
+public:
+    MemStatsDumper(std::ostream &os, long const interval_ms) : _stop(false)
+    {
+        _thread = std::thread([this, &os, interval_ms]() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (!_cv.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] { return _stop; }))
+                os << memstats_snapshot() << std::flush;
+        });
+    }
+
+    ~MemStatsDumper()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    MemStatsDumper(MemStatsDumper const &) = delete;
+    MemStatsDumper &operator=(MemStatsDumper const &) = delete;
+};
+
+#else    // BLITZ11_MEMSTATS
+
+#include <ostream>
+
+struct MemTag {
+    explicit MemTag(std::string const &) {}
+};
+
+struct MemStatsDumper {
+    MemStatsDumper(std::ostream &, long) {}
+};
+
+struct MemStatsSnapshot {};
+
+inline MemStatsSnapshot memstats_snapshot() { return MemStatsSnapshot(); }
+
+inline std::ostream &operator<<(std::ostream &os, MemStatsSnapshot const &)
+    { return os; }
+
+#endif    // BLITZ11_MEMSTATS
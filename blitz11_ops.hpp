@@ -0,0 +1,724 @@
+/**
+Whole-array operations: fill, copy, reductions and elementwise
+expression evaluation (for_each / transform).
+
+All operations run through LoopPlan, which orders the loop nest by the
+strides of the first (destination) array so the inner loop runs over
+the smallest stride, flips negative strides, and merges dimensions that
+are contiguous in every operand into one longer inner loop.  Kernels
+only see that inner loop, with a unit-stride fast path the compiler
+can vectorize.
+
+Operands are matched by position relative to their lower bounds, so
+bases may differ, but extents must agree.  Source operands may be
+broadcast views (stride 0, see broadcast()); kernels load such an
+operand once per inner loop instead of once per element.  transform()
+therefore assumes fn is a pure function of its arguments.
+
+Axis-wise reductions (sum_axis, mean_axis, min_axis, max_axis) and
+scans (cumsum_axis) return newly allocated arrays, dense in the same
+dimension order as their source.  The loop plan covers the other
+dimensions; the kernel walks the axis either innermost (one line per
+result element) or just outside the inner loop, accumulating a whole
+row of partial results, whichever follows memory.  They run in parallel
+over chunks of an outer non-reduced dimension.
+
+GeneralArray overloads switch on rank() once (ranks 1 to 8)
+into the same RANK-templated code used for
+Array<ValueT,RANK>, so their per-element cost is that of the fixed-rank
+path.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+#include "blitz11_parallel.hpp"
+
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+
+
+/** Loop nest over NARR arrays of equal extents.  Offsets and strides
+are in elements of each array. */
+template<int NARR, int RANK>
+struct LoopPlan {
+    std::array<ptrdiff_t, RANK> extent;
+    std::array<std::array<ptrdiff_t, RANK>, NARR> stride;
+    std::array<ptrdiff_t, NARR> start;    // Offset of the first element visited
+    bool empty;
+
+    /** @param dopes dopes[a] is the dope vector of operand a; operand 0 sets the loop order */
+    template<class IndexT>
+    LoopPlan(std::array<Dope<IndexT> const *, NARR> const &dopes)
+    {
+        empty = false;
+        start.fill(0);
+        for (int k=0; k<RANK; ++k) {
+            extent[k] = dopes[0][k].range[1] - dopes[0][k].range[0];
+            if (extent[k] <= 0) empty = true;
+            for (int a=0; a<NARR; ++a) {
+                if (dopes[a][k].range[1] - dopes[a][k].range[0] != dopes[0][k].range[1] - dopes[0][k].range[0])
+                    throw std::invalid_argument("Array operands have different extents");
+                stride[a][k] = dopes[a][k].stride;
+                start[a] += dopes[a][k].range[0] * dopes[a][k].stride;
+            }
+        }
+        if (empty) return;
+
+        // Flip dimensions where operand 0 runs backwards
+        for (int k=0; k<RANK; ++k) {
+            if (stride[0][k] < 0) {
+                for (int a=0; a<NARR; ++a) {
+                    start[a] += (extent[k]-1) * stride[a][k];
+                    stride[a][k] = -stride[a][k];
+                }
+            }
+        }
+
+        // Order by decreasing stride of operand 0 (insertion sort; RANK is small)
+        for (int k=1; k<RANK; ++k) {
+            for (int j=k; j>0 && outer_first(j, j-1); --j) swap_dims(j, j-1);
+        }
+
+        // Merge dimensions contiguous in every operand into the inner one
+        int j = RANK-1;
+        for (int k=RANK-2; k>=0; --k) {
+            bool mergeable = true;
+            for (int a=0; a<NARR; ++a)
+                if (stride[a][k] != stride[a][j] * extent[j]) mergeable = false;
+            if (mergeable) {
+                extent[j] *= extent[k];
+                extent[k] = 1;
+            } else {
+                j = k;
+            }
+        }
+    }
+
+    /** Calls kernel(n, off, inner_stride) once per inner loop, where
+    off[a] is the offset of the loop's first element in operand a. */
+    template<class KernelT>
+    void run(KernelT &kernel) const
+    {
+        if (empty) return;
+        std::array<ptrdiff_t, NARR> off(start);
+        std::array<ptrdiff_t, NARR> inner;
+        for (int a=0; a<NARR; ++a) inner[a] = stride[a][RANK-1];
+        std::array<ptrdiff_t, RANK> ix;
+        ix.fill(0);
+
+        for (;;) {
+            kernel(extent[RANK-1], off, inner);
+
+            int k = RANK-2;
+            for (; k >= 0; --k) {
+                for (int a=0; a<NARR; ++a) off[a] += stride[a][k];
+                if (++ix[k] < extent[k]) break;
+                for (int a=0; a<NARR; ++a) off[a] -= extent[k] * stride[a][k];
+                ix[k] = 0;
+            }
+            if (k < 0) break;
+        }
+    }
+
+private:
+    /** Loop-order key: larger goes outside.  Zero (broadcast) strides
+    go outermost, so inner loops walk real memory. */
+    ptrdiff_t order_key(int const k) const
+    {
+        return stride[0][k] == 0 ? std::numeric_limits<ptrdiff_t>::max()
+            : std::abs(stride[0][k]);
+    }
+
+    /** True if dimension j should be looped outside dimension i */
+    bool outer_first(int const j, int const i) const
+        { return order_key(j) > order_key(i); }
+
+    void swap_dims(int const i, int const j)
+    {
+        std::swap(extent[i], extent[j]);
+        for (int a=0; a<NARR; ++a) std::swap(stride[a][i], stride[a][j]);
+    }
+};
+
+
+namespace ops_detail {
+
+template<class ValueT, class CharT>
+ValueT *origin(MemoryBlock<CharT> const &memory)
+    { return reinterpret_cast<ValueT *>(memory.base()); }
+
+/** Runs kernel over NARR operands of fixed rank */
+template<int NARR, int RANK, class IndexT, class KernelT>
+void run(std::array<Dope<IndexT> const *, NARR> const &dopes, KernelT &kernel)
+{
+    LoopPlan<NARR, RANK> const plan(dopes);
+    plan.run(kernel);
+}
+
+/** Runs kernel over NARR operands of runtime rank, dispatching once
+to the fixed-rank loop. */
+template<int NARR, class IndexT, class KernelT>
+void run_dispatch(int const rank, std::array<Dope<IndexT> const *, NARR> const &dopes, KernelT &kernel)
+{
+    switch(rank) {
+        case 1 : run<NARR, 1>(dopes, kernel); break;
+        case 2 : run<NARR, 2>(dopes, kernel); break;
+        case 3 : run<NARR, 3>(dopes, kernel); break;
+        case 4 : run<NARR, 4>(dopes, kernel); break;
+        case 5 : run<NARR, 5>(dopes, kernel); break;
+        case 6 : run<NARR, 6>(dopes, kernel); break;
+        case 7 : run<NARR, 7>(dopes, kernel); break;
+        case 8 : run<NARR, 8>(dopes, kernel); break;
+        default :
+            throw std::invalid_argument("GeneralArray operation: unsupported rank " + std::to_string(rank));
+    }
+}
+
+// ---------- Kernels: each sees one inner loop
+
+template<class T>
+struct FillKernel {
+    T * const p;
+    T const val;
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,1> const &off, std::array<ptrdiff_t,1> const &s)
+    {
+        T * const q = p + off[0];
+        if (s[0] == 1) for (ptrdiff_t i=0; i<n; ++i) q[i] = val;
+        else for (ptrdiff_t i=0; i<n; ++i) q[i*s[0]] = val;
+    }
+};
+
+template<class DestT, class SrcT, class FnT>
+struct TransformKernel {
+    DestT * const d;
+    SrcT * const s;
+    FnT const &fn;
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,2> const &off, std::array<ptrdiff_t,2> const &st)
+    {
+        DestT * const dq = d + off[0];
+        SrcT * const sq = s + off[1];
+        if (st[1] == 0) {    // Broadcast source: evaluate once per row
+            DestT const v = fn(sq[0]);
+            for (ptrdiff_t i=0; i<n; ++i) dq[i*st[0]] = v;
+        } else if (st[0] == 1 && st[1] == 1) {
+            for (ptrdiff_t i=0; i<n; ++i) dq[i] = fn(sq[i]);
+        } else {
+            for (ptrdiff_t i=0; i<n; ++i) dq[i*st[0]] = fn(sq[i*st[1]]);
+        }
+    }
+};
+
+template<class DestT, class AT, class BT, class FnT>
+struct Transform2Kernel {
+    DestT * const d;
+    AT * const a;
+    BT * const b;
+    FnT const &fn;
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,3> const &off, std::array<ptrdiff_t,3> const &st)
+    {
+        DestT * const dq = d + off[0];
+        AT * const aq = a + off[1];
+        BT * const bq = b + off[2];
+        if (st[1] == 0) {    // Broadcast a: load it once per row
+            AT const av = aq[0];
+            if (st[0] == 1 && st[2] == 1) for (ptrdiff_t i=0; i<n; ++i) dq[i] = fn(av, bq[i]);
+            else for (ptrdiff_t i=0; i<n; ++i) dq[i*st[0]] = fn(av, bq[i*st[2]]);
+        } else if (st[2] == 0) {    // Broadcast b
+            BT const bv = bq[0];
+            if (st[0] == 1 && st[1] == 1) for (ptrdiff_t i=0; i<n; ++i) dq[i] = fn(aq[i], bv);
+            else for (ptrdiff_t i=0; i<n; ++i) dq[i*st[0]] = fn(aq[i*st[1]], bv);
+        } else if (st[0] == 1 && st[1] == 1 && st[2] == 1) {
+            for (ptrdiff_t i=0; i<n; ++i) dq[i] = fn(aq[i], bq[i]);
+        } else {
+            for (ptrdiff_t i=0; i<n; ++i) dq[i*st[0]] = fn(aq[i*st[1]], bq[i*st[2]]);
+        }
+    }
+};
+
+template<class ValueT, class FnT>
+struct ForEachKernel {
+    ValueT * const p;
+    FnT &fn;
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,1> const &off, std::array<ptrdiff_t,1> const &s)
+    {
+        ValueT * const q = p + off[0];
+        if (s[0] == 1) for (ptrdiff_t i=0; i<n; ++i) fn(q[i]);
+        else for (ptrdiff_t i=0; i<n; ++i) fn(q[i*s[0]]);
+    }
+};
+
+/** acc = op(acc, x) over every element */
+template<class ValueT, class AccT, class OpT>
+struct ReduceKernel {
+    ValueT * const p;
+    AccT acc;
+    OpT const &op;
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,1> const &off, std::array<ptrdiff_t,1> const &s)
+    {
+        ValueT * const q = p + off[0];
+        AccT a(acc);
+        if (s[0] == 1) for (ptrdiff_t i=0; i<n; ++i) a = op(a, q[i]);
+        else for (ptrdiff_t i=0; i<n; ++i) a = op(a, q[i*s[0]]);
+        acc = a;
+    }
+};
+
+/** Non-const element type of an Array or GeneralArray */
+template<class ArrayT>
+struct value_of;
+template<class ValueT, int RANK, class IndexT>
+struct value_of<Array<ValueT, RANK, IndexT>> { typedef typename std::remove_const<ValueT>::type type; };
+template<class ValueT, class IndexT>
+struct value_of<GeneralArray<ValueT, IndexT>> { typedef typename std::remove_const<ValueT>::type type; };
+
+template<class T>
+struct Plus { T operator()(T const &a, T const &b) const { return a + b; } };
+template<class T>
+struct Min { T operator()(T const &a, T const &b) const { return b < a ? b : a; } };
+template<class T>
+struct Max { T operator()(T const &a, T const &b) const { return a < b ? b : a; } };
+
+/** True for the ops above, which may be regrouped and reordered */
+template<class OpT>
+struct reassociable : public std::false_type {};
+template<class T>
+struct reassociable<Plus<T>> : public std::true_type {};
+template<class T>
+struct reassociable<Min<T>> : public std::true_type {};
+template<class T>
+struct reassociable<Max<T>> : public std::true_type {};
+
+}    // namespace ops_detail
+
+
+// ---------------------------------------------------------------
+// Array<ValueT,RANK>
+
+template<class ValueT, int RANK, class IndexT>
+void fill(Array<ValueT, RANK, IndexT> const &dst, typename std::remove_const<ValueT>::type const &val)
+{
+    ops_detail::FillKernel<ValueT> kernel = {ops_detail::origin<ValueT>(dst.memory()), val};
+    ops_detail::run<1, RANK>(std::array<Dope<IndexT> const *,1>{{&dst.dopes()[0]}}, kernel);
+}
+
+/** dst[i] = fn(src[i]) */
+template<class DestT, class SrcT, int RANK, class IndexT, class FnT>
+void transform(Array<DestT, RANK, IndexT> const &dst, Array<SrcT, RANK, IndexT> const &src, FnT const &fn)
+{
+    ops_detail::TransformKernel<DestT, SrcT, FnT> kernel = {
+        ops_detail::origin<DestT>(dst.memory()), ops_detail::origin<SrcT>(src.memory()), fn};
+    ops_detail::run<2, RANK>(std::array<Dope<IndexT> const *,2>{{&dst.dopes()[0], &src.dopes()[0]}}, kernel);
+}
+
+/** dst[i] = fn(a[i], b[i]) */
+template<class DestT, class AT, class BT, int RANK, class IndexT, class FnT>
+void transform(Array<DestT, RANK, IndexT> const &dst,
+    Array<AT, RANK, IndexT> const &a, Array<BT, RANK, IndexT> const &b, FnT const &fn)
+{
+    ops_detail::Transform2Kernel<DestT, AT, BT, FnT> kernel = {
+        ops_detail::origin<DestT>(dst.memory()), ops_detail::origin<AT>(a.memory()),
+        ops_detail::origin<BT>(b.memory()), fn};
+    ops_detail::run<3, RANK>(std::array<Dope<IndexT> const *,3>{{
+        &dst.dopes()[0], &a.dopes()[0], &b.dopes()[0]}}, kernel);
+}
+
+template<class DestT, class SrcT, int RANK, class IndexT>
+void copy(Array<DestT, RANK, IndexT> const &dst, Array<SrcT, RANK, IndexT> const &src)
+{
+    typedef typename std::remove_const<SrcT>::type T;
+    transform(dst, src, [](T const &x) { return x; });
+}
+
+/** Calls fn(x) on every element, in memory order */
+template<class ValueT, int RANK, class IndexT, class FnT>
+void for_each(Array<ValueT, RANK, IndexT> const &arr, FnT &&fn)
+{
+    ops_detail::ForEachKernel<ValueT, typename std::remove_reference<FnT>::type> kernel = {
+        ops_detail::origin<ValueT>(arr.memory()), fn};
+    ops_detail::run<1, RANK>(std::array<Dope<IndexT> const *,1>{{&arr.dopes()[0]}}, kernel);
+}
+
+/** Folds op over every element, starting from init, in memory order */
+template<class AccT, class ValueT, int RANK, class IndexT, class OpT>
+AccT reduce(Array<ValueT, RANK, IndexT> const &arr, AccT const &init, OpT const &op)
+{
+    ops_detail::ReduceKernel<ValueT, AccT, OpT> kernel = {ops_detail::origin<ValueT>(arr.memory()), init, op};
+    ops_detail::run<1, RANK>(std::array<Dope<IndexT> const *,1>{{&arr.dopes()[0]}}, kernel);
+    return kernel.acc;
+}
+
+
+// ---------------------------------------------------------------
+// GeneralArray: one switch on rank(), then the fixed-rank loops
+
+template<class ValueT, class IndexT>
+void fill(GeneralArray<ValueT, IndexT> const &dst, typename std::remove_const<ValueT>::type const &val)
+{
+    ops_detail::FillKernel<ValueT> kernel = {ops_detail::origin<ValueT>(dst.memory()), val};
+    ops_detail::run_dispatch<1>(dst.rank(), std::array<Dope<IndexT> const *,1>{{&dst.dopes()[0]}}, kernel);
+}
+
+template<class DestT, class SrcT, class IndexT, class FnT>
+void transform(GeneralArray<DestT, IndexT> const &dst, GeneralArray<SrcT, IndexT> const &src, FnT const &fn)
+{
+    if (dst.rank() != src.rank()) throw std::invalid_argument("transform: operands have different ranks");
+    ops_detail::TransformKernel<DestT, SrcT, FnT> kernel = {
+        ops_detail::origin<DestT>(dst.memory()), ops_detail::origin<SrcT>(src.memory()), fn};
+    ops_detail::run_dispatch<2>(dst.rank(),
+        std::array<Dope<IndexT> const *,2>{{&dst.dopes()[0], &src.dopes()[0]}}, kernel);
+}
+
+template<class DestT, class AT, class BT, class IndexT, class FnT>
+void transform(GeneralArray<DestT, IndexT> const &dst,
+    GeneralArray<AT, IndexT> const &a, GeneralArray<BT, IndexT> const &b, FnT const &fn)
+{
+    if (dst.rank() != a.rank() || dst.rank() != b.rank())
+        throw std::invalid_argument("transform: operands have different ranks");
+    ops_detail::Transform2Kernel<DestT, AT, BT, FnT> kernel = {
+        ops_detail::origin<DestT>(dst.memory()), ops_detail::origin<AT>(a.memory()),
+        ops_detail::origin<BT>(b.memory()), fn};
+    ops_detail::run_dispatch<3>(dst.rank(), std::array<Dope<IndexT> const *,3>{{
+        &dst.dopes()[0], &a.dopes()[0], &b.dopes()[0]}}, kernel);
+}
+
+template<class DestT, class SrcT, class IndexT>
+void copy(GeneralArray<DestT, IndexT> const &dst, GeneralArray<SrcT, IndexT> const &src)
+{
+    typedef typename std::remove_const<SrcT>::type T;
+    transform(dst, src, [](T const &x) { return x; });
+}
+
+template<class ValueT, class IndexT, class FnT>
+void for_each(GeneralArray<ValueT, IndexT> const &arr, FnT &&fn)
+{
+    ops_detail::ForEachKernel<ValueT, typename std::remove_reference<FnT>::type> kernel = {
+        ops_detail::origin<ValueT>(arr.memory()), fn};
+    ops_detail::run_dispatch<1>(arr.rank(), std::array<Dope<IndexT> const *,1>{{&arr.dopes()[0]}}, kernel);
+}
+
+template<class AccT, class ValueT, class IndexT, class OpT>
+AccT reduce(GeneralArray<ValueT, IndexT> const &arr, AccT const &init, OpT const &op)
+{
+    ops_detail::ReduceKernel<ValueT, AccT, OpT> kernel = {ops_detail::origin<ValueT>(arr.memory()), init, op};
+    ops_detail::run_dispatch<1>(arr.rank(), std::array<Dope<IndexT> const *,1>{{&arr.dopes()[0]}}, kernel);
+    return kernel.acc;
+}
+
+
+// ---------------------------------------------------------------
+// Common reductions, for either array type
+
+template<class ArrayT>
+typename ops_detail::value_of<ArrayT>::type sum(ArrayT const &arr)
+{
+    typedef typename ops_detail::value_of<ArrayT>::type T;
+    return reduce(arr, T(0), ops_detail::Plus<T>());
+}
+
+template<class ArrayT>
+typename ops_detail::value_of<ArrayT>::type min_value(ArrayT const &arr)
+{
+    typedef typename ops_detail::value_of<ArrayT>::type T;
+    return reduce(arr, std::numeric_limits<T>::has_infinity
+        ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(), ops_detail::Min<T>());
+}
+
+template<class ArrayT>
+typename ops_detail::value_of<ArrayT>::type max_value(ArrayT const &arr)
+{
+    typedef typename ops_detail::value_of<ArrayT>::type T;
+    return reduce(arr, std::numeric_limits<T>::has_infinity
+        ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(), ops_detail::Max<T>());
+}
+
+
+// ---------------------------------------------------------------
+// Axis-wise reductions and scans
+
+namespace ops_detail {
+
+/** Copy of dopes with dense, positive strides, the dimensions nested in
+the same order (by decreasing |stride|) as in dopes. */
+template<class IndexT>
+std::vector<Dope<IndexT>> dense_like(std::vector<Dope<IndexT>> dopes)
+{
+    int const rank = dopes.size();
+    std::vector<int> order(rank);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&dopes](int a, int b)
+        { return std::abs(dopes[a].stride) > std::abs(dopes[b].stride); });
+
+    ptrdiff_t stride = 1;
+    for (int i=rank-1; i>=0; --i) {
+        Dope<IndexT> &d(dopes[order[i]]);
+        d.stride = stride;
+        stride *= std::max<ptrdiff_t>(0, d.range[1] - d.range[0]);
+    }
+    return dopes;
+}
+
+/** Dimension to split among threads: the outermost (by stride of
+dopes) dimension other than axis with extent > 1, or -1 */
+template<class IndexT>
+int split_dim(std::vector<Dope<IndexT>> const &dopes, int const axis)
+{
+    int best = -1;
+    for (int k=0; k<(int)dopes.size(); ++k) {
+        if (k == axis || dopes[k].range[1] - dopes[k].range[0] <= 1) continue;
+        if (best < 0 || std::abs(dopes[k].stride) > std::abs(dopes[best].stride)) best = k;
+    }
+    return best;
+}
+
+/** Runs a stateless kernel over (out, src) in parallel chunks of
+dimension split (-1 for serial). */
+template<int RANK, class IndexT, class KernelT>
+void run_split(std::vector<Dope<IndexT>> out, std::vector<Dope<IndexT>> src,
+    int const split, int const nthreads, KernelT const &kernel)
+{
+    if (split < 0 || nthreads == 1) {
+        LoopPlan<2, RANK> const plan(std::array<Dope<IndexT> const *,2>{{&out[0], &src[0]}});
+        plan.run(kernel);
+        return;
+    }
+
+    IndexT const low = out[split].range[0];
+    IndexT const extent = out[split].range[1] - low;
+    int const nt = (nthreads <= 0 ? default_nthreads() : nthreads);
+    IndexT const nchunk = std::min<IndexT>(extent, 4 * nt);
+    parallel_for(nchunk, nt, [&](size_t const c) {
+        std::vector<Dope<IndexT>> o(out), s(src);
+        // In ptrdiff_t: extent*c can overflow a 32-bit IndexT
+        o[split].range = s[split].range = {{
+            (IndexT)(low + (ptrdiff_t)extent * (ptrdiff_t)c / nchunk),
+            (IndexT)(low + (ptrdiff_t)extent * (ptrdiff_t)(c+1) / nchunk)}};
+        LoopPlan<2, RANK> const plan(std::array<Dope<IndexT> const *,2>{{&o[0], &s[0]}});
+        plan.run(kernel);
+    });
+}
+
+/** out[i] = fold of op over src[i, 0..m) along the axis.  Operand 0
+is the result, operand 1 the source, with the axis collapsed. */
+template<class T, class ValueT, class OpT>
+struct ReduceAxisKernel {
+    T * const out;
+    ValueT * const src;
+    ptrdiff_t const m;          // Extent of the axis
+    ptrdiff_t const sa;         // Source stride along the axis
+    T const init;
+    OpT const &op;
+
+    /** Folds one line */
+    T line(ValueT const * const l) const
+        { return line(l, reassociable<OpT>()); }
+
+    /** Any op: one accumulator, in order from init */
+    T line(ValueT const * const l, std::false_type) const
+    {
+        T acc(init);
+        for (ptrdiff_t j=0; j<m; ++j) acc = op(acc, l[j*sa]);
+        return acc;
+    }
+
+    /** Associative, commutative op: four accumulators to break the
+    dependency chain.  Only a0 starts from init; the others start from
+    the line's next elements, so init is folded in once. */
+    T line(ValueT const * const l, std::true_type) const
+    {
+        if (m < 8) return line(l, std::false_type());
+        T a0(op(init, l[0])), a1(l[sa]), a2(l[2*sa]), a3(l[3*sa]);
+        ptrdiff_t j = 4;
+        if (sa == 1) {
+            for (; j+4 <= m; j += 4) {
+                a0 = op(a0, l[j]); a1 = op(a1, l[j+1]);
+                a2 = op(a2, l[j+2]); a3 = op(a3, l[j+3]);
+            }
+        } else {
+            for (; j+4 <= m; j += 4) {
+                a0 = op(a0, l[j*sa]); a1 = op(a1, l[(j+1)*sa]);
+                a2 = op(a2, l[(j+2)*sa]); a3 = op(a3, l[(j+3)*sa]);
+            }
+        }
+        for (; j<m; ++j) a0 = op(a0, l[j*sa]);
+        return op(op(a0, a1), op(a2, a3));
+    }
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,2> const &off, std::array<ptrdiff_t,2> const &st) const
+    {
+        T * const oq = out + off[0];
+        ValueT * const sq = src + off[1];
+        if (n == 1 || std::abs(sa) < std::abs(st[1])) {
+            // Axis is innermost in memory: one line per result
+            for (ptrdiff_t i=0; i<n; ++i) oq[i*st[0]] = line(sq + i*st[1]);
+        } else {
+            // Row of partials, swept once per position along the axis
+            for (ptrdiff_t i=0; i<n; ++i) oq[i*st[0]] = init;
+            for (ptrdiff_t j=0; j<m; ++j) {
+                ValueT * const row = sq + j*sa;
+                if (st[0] == 1 && st[1] == 1) for (ptrdiff_t i=0; i<n; ++i) oq[i] = op(oq[i], row[i]);
+                else for (ptrdiff_t i=0; i<n; ++i) oq[i*st[0]] = op(oq[i*st[0]], row[i*st[1]]);
+            }
+        }
+    }
+};
+
+/** out[j] = op(out[j-1], src[j]) along the axis */
+template<class T, class ValueT, class OpT>
+struct ScanAxisKernel {
+    T * const out;
+    ValueT * const src;
+    ptrdiff_t const m;
+    ptrdiff_t const oa, sa;     // Result and source strides along the axis
+    T const init;
+    OpT const &op;
+
+    void operator()(ptrdiff_t const n, std::array<ptrdiff_t,2> const &off, std::array<ptrdiff_t,2> const &st) const
+    {
+        T * const oq = out + off[0];
+        ValueT * const sq = src + off[1];
+        if (m == 0) return;
+        if (n == 1 || std::abs(oa) < std::abs(st[0])) {
+            for (ptrdiff_t i=0; i<n; ++i) {
+                T * const o = oq + i*st[0];
+                ValueT * const s = sq + i*st[1];
+                T acc(init);
+                for (ptrdiff_t j=0; j<m; ++j) o[j*oa] = acc = op(acc, s[j*sa]);
+            }
+        } else {
+            for (ptrdiff_t i=0; i<n; ++i) oq[i*st[0]] = op(init, sq[i*st[1]]);
+            for (ptrdiff_t j=1; j<m; ++j) {
+                T * const prev = oq + (j-1)*oa;
+                T * const o = oq + j*oa;
+                ValueT * const s = sq + j*sa;
+                if (st[0] == 1 && st[1] == 1) for (ptrdiff_t i=0; i<n; ++i) o[i] = op(prev[i], s[i]);
+                else for (ptrdiff_t i=0; i<n; ++i) o[i*st[0]] = op(prev[i*st[0]], s[i*st[1]]);
+            }
+        }
+    }
+};
+
+inline void check_axis(int const axis, int const rank)
+{
+    if (axis < 0 || axis >= rank)
+        throw std::invalid_argument("Axis " + std::to_string(axis)
+            + " out of range for rank " + std::to_string(rank));
+}
+
+}    // namespace ops_detail
+
+
+/** Folds op along dimension axis, starting each fold from init:
+acc = op(acc, x) for each x along the axis, in index order.  (The
+built-in sum, min and max folds may be regrouped for speed.)
+@param nthreads Threads to use; <= 0 for default_nthreads()
+@return Dimensions of arr other than axis, same bounds */
+template<class AccT, class ValueT, int RANK, class IndexT, class OpT>
+Array<AccT, RANK-1, IndexT> reduce_axis(Array<ValueT, RANK, IndexT> const &arr,
+    int const axis, AccT const &init, OpT const &op, int const nthreads = 0)
+{
+    static_assert(RANK >= 2, "reduce_axis: use reduce() for rank-1 arrays");
+    ops_detail::check_axis(axis, RANK);
+
+    std::vector<Dope<IndexT>> dopes(arr.dopes());
+    Dope<IndexT> const ax(dopes[axis]);
+    dopes.erase(dopes.begin() + axis);
+    std::vector<Dope<IndexT>> const rdopes(ops_detail::dense_like(dopes));
+    Array<AccT, RANK-1, IndexT> ret(allocate_block<AccT>(&rdopes[0], RANK-1), rdopes);
+
+    // Plan over all RANK dimensions, the axis collapsed to one position
+    std::vector<Dope<IndexT>> src(arr.dopes()), out(rdopes);
+    src[axis].range = {{0, 1}};
+    src[axis].stride = 0;
+    out.insert(out.begin() + axis, src[axis]);
+
+    ops_detail::ReduceAxisKernel<AccT, ValueT, OpT> const kernel = {
+        ops_detail::origin<AccT>(ret.memory()),
+        ops_detail::origin<ValueT>(arr.memory()) + ax.range[0] * ax.stride,
+        std::max<ptrdiff_t>(0, ax.range[1] - ax.range[0]), ax.stride, init, op};
+    ops_detail::run_split<RANK>(out, src, ops_detail::split_dim(arr.dopes(), axis), nthreads, kernel);
+    return ret;
+}
+
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK-1, IndexT> sum_axis(
+    Array<ValueT, RANK, IndexT> const &arr, int const axis, int const nthreads = 0)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    return reduce_axis(arr, axis, T(0), ops_detail::Plus<T>(), nthreads);
+}
+
+/** Throws std::invalid_argument if the axis is empty */
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK-1, IndexT> mean_axis(
+    Array<ValueT, RANK, IndexT> const &arr, int const axis, int const nthreads = 0)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    ops_detail::check_axis(axis, RANK);
+    IndexT const extent = arr.dopes()[axis].range[1] - arr.dopes()[axis].range[0];
+    if (extent <= 0)
+        throw std::invalid_argument("mean_axis: axis " + std::to_string(axis) + " is empty");
+    Array<T, RANK-1, IndexT> ret(sum_axis(arr, axis, nthreads));
+    T const n = extent;
+    transform(ret, ret, [n](T const &x) { return x / n; });
+    return ret;
+}
+
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK-1, IndexT> min_axis(
+    Array<ValueT, RANK, IndexT> const &arr, int const axis, int const nthreads = 0)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    return reduce_axis(arr, axis, std::numeric_limits<T>::has_infinity
+        ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(),
+        ops_detail::Min<T>(), nthreads);
+}
+
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK-1, IndexT> max_axis(
+    Array<ValueT, RANK, IndexT> const &arr, int const axis, int const nthreads = 0)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    return reduce_axis(arr, axis, std::numeric_limits<T>::has_infinity
+        ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(),
+        ops_detail::Max<T>(), nthreads);
+}
+
+/** Inclusive scan along dimension axis: ret[..j..] = op(ret[..j-1..], arr[..j..]),
+starting from init.  Same bounds as arr. */
+template<class AccT, class ValueT, int RANK, class IndexT, class OpT>
+Array<AccT, RANK, IndexT> scan_axis(Array<ValueT, RANK, IndexT> const &arr,
+    int const axis, AccT const &init, OpT const &op, int const nthreads = 0)
+{
+    ops_detail::check_axis(axis, RANK);
+
+    std::vector<Dope<IndexT>> const rdopes(ops_detail::dense_like(arr.dopes()));
+    Array<AccT, RANK, IndexT> ret(allocate_block<AccT>(&rdopes[0], RANK), rdopes);
+
+    Dope<IndexT> const ax(arr.dopes()[axis]);
+    std::vector<Dope<IndexT>> src(arr.dopes()), out(rdopes);
+    src[axis].range = out[axis].range = {{0, 1}};
+    src[axis].stride = out[axis].stride = 0;
+
+    ops_detail::ScanAxisKernel<AccT, ValueT, OpT> const kernel = {
+        ops_detail::origin<AccT>(ret.memory()) + ax.range[0] * rdopes[axis].stride,
+        ops_detail::origin<ValueT>(arr.memory()) + ax.range[0] * ax.stride,
+        std::max<ptrdiff_t>(0, ax.range[1] - ax.range[0]),
+        rdopes[axis].stride, ax.stride, init, op};
+    ops_detail::run_split<RANK>(out, src, ops_detail::split_dim(arr.dopes(), axis), nthreads, kernel);
+    return ret;
+}
+
+template<class ValueT, int RANK, class IndexT>
+Array<typename std::remove_const<ValueT>::type, RANK, IndexT> cumsum_axis(
+    Array<ValueT, RANK, IndexT> const &arr, int const axis, int const nthreads = 0)
+{
+    typedef typename std::remove_const<ValueT>::type T;
+    return scan_axis(arr, axis, T(0), ops_detail::Plus<T>(), nthreads);
+}
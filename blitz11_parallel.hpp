@@ -0,0 +1,63 @@
+/**
+Minimal thread-parallel loop used by the I/O and compute layers.
+std::thread only; no OpenMP or TBB required.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/** Number of threads to use when the caller passes nthreads <= 0 */
+inline int default_nthreads()
+{
+    unsigned const n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : (int)n;
+}
+
+/** Calls fn(i) for i in [0,n), spread dynamically over nthreads threads
+(the calling thread is one of them).  The other threads are started
+for this call and joined before it returns; there is no thread pool,
+so keep n*work per call well above thread start-up cost.  The first
+exception thrown by any fn(i) is rethrown once all threads have
+stopped. */
+template<class FnT>
+void parallel_for(size_t const n, int nthreads, FnT const &fn)
+{
+    if (nthreads <= 0) nthreads = default_nthreads();
+    if ((size_t)nthreads > n) nthreads = (int)n;
+    if (nthreads <= 1) {
+        for (size_t i=0; i<n; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        for (;;) {
+            size_t const i = next++;
+            if (i >= n || failed) return;
+            try {
+                fn(i);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t=1; t<nthreads; ++t) threads.push_back(std::thread(worker));
+    worker();
+    for (auto &th : threads) th.join();
+
+    if (error) std::rethrow_exception(error);
+}
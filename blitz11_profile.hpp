@@ -0,0 +1,321 @@
+/**
+Access-pattern profiling, enabled by defining BLITZ11_ACCESS_PROFILE
+before including blitz11.hpp.
+
+Every element access through index() (and so operator() of Array and
+GeneralArray) is recorded against the array it went through: the
+distance in bytes from that array's previous access, bucketed into a
+histogram, and which dimensions' indices changed.  The dimension that
+changes most often is the traversal's inner loop; if another dimension
+has a smaller stride, the traversal is cache-hostile, and the report
+suggests a loop order (or storage order) that fixes it.  Bulk
+operations (blitz11_ops.hpp etc.) pick their own loop order and are
+not recorded.
+
+Arrays are identified by their memory and dope vector storage; label
+them with access_profile_label() to get readable names.  Each thread
+records separately, merging into a global table when it exits.  The
+hottest arrays are summarized on std::cerr at program exit, or at any
+time with access_profile_report().
+
+Profiling costs a hash lookup per access; it is meant for diagnostic
+builds only.  Without BLITZ11_ACCESS_PROFILE the label and report
+functions are no-ops.
+*/
+
+#pragma once
+
+#include <string>
+#include <ostream>
+
+#ifdef BLITZ11_ACCESS_PROFILE
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace profile_detail {
+
+/** Byte distance between consecutive accesses */
+enum { SAME, UNIT, LINE, PAGE, FAR, NDIST };
+static char const * const dist_names[NDIST] = {"same", "unit", "<64B", "<4KiB", "far"};
+
+struct ArrayProfile {
+    size_t value_size;
+    std::vector<ptrdiff_t> stride;    // Bytes
+    std::vector<long> extent;
+    size_t naccess;
+    size_t nmismatch;                 // Steps along one dimension, not the smallest-stride one
+    std::array<size_t, NDIST> dist;
+    std::vector<size_t> nchanged;     // Accesses at which each dimension's index changed
+
+    // Previous access (per thread; not merged)
+    std::vector<long> last;
+    ptrdiff_t last_diff;
+
+    ArrayProfile() : value_size(0), naccess(0), nmismatch(0), last_diff(0)
+        { dist.fill(0); }
+
+    /** True if dopes describe the array this profile was started on */
+    template<class DopeT>
+    bool same_array(DopeT const * const dopes, int const rank, size_t const vsize) const
+    {
+        if (rank != (int)stride.size() || vsize != value_size) return false;
+        for (int k=0; k<rank; ++k) {
+            if (dopes[k].stride * (ptrdiff_t)vsize != stride[k]
+                || dopes[k].range[1] - dopes[k].range[0] != extent[k]) return false;
+        }
+        return true;
+    }
+
+    void merge(ArrayProfile const &o)
+    {
+        // Another array since reusing the same memory and dopes: keep the newer
+        if (!stride.empty() && (o.stride != stride || o.extent != extent)) *this = ArrayProfile();
+        if (stride.empty()) {
+            value_size = o.value_size;
+            stride = o.stride;
+            extent = o.extent;
+            nchanged.assign(stride.size(), 0);
+        }
+        naccess += o.naccess;
+        nmismatch += o.nmismatch;
+        for (int i=0; i<NDIST; ++i) dist[i] += o.dist[i];
+        for (size_t k=0; k<nchanged.size() && k<o.nchanged.size(); ++k) nchanged[k] += o.nchanged[k];
+    }
+
+    /** Dimension with the smallest |stride| among those of extent > 1 */
+    int fastest_dim() const
+    {
+        int best = -1;
+        for (int k=0; k<(int)stride.size(); ++k) {
+            if (extent[k] <= 1) continue;
+            if (best < 0 || std::abs(stride[k]) < std::abs(stride[best])) best = k;
+        }
+        return best;
+    }
+
+    /** Dimension whose index changes most often: the inner loop */
+    int inner_dim() const
+    {
+        if (nchanged.empty()) return -1;
+        return std::max_element(nchanged.begin(), nchanged.end()) - nchanged.begin();
+    }
+};
+
+typedef std::pair<void const *, void const *> Key;    // (memory, dopes)
+
+struct KeyHash {
+    size_t operator()(Key const &k) const
+        { return std::hash<void const *>()(k.first) * 31 + std::hash<void const *>()(k.second); }
+};
+
+typedef std::unordered_map<Key, ArrayProfile, KeyHash> ProfileMap;
+
+inline void report(std::ostream &os, ProfileMap const &profiles, size_t max_arrays);
+
+/** Merged profiles of exited threads; reports at program exit */
+struct Registry {
+    std::mutex mutex;
+    ProfileMap profiles;
+    std::map<void const *, std::string> labels;    // By memory
+
+    static Registry &instance()
+    {
+        static Registry reg;
+        return reg;
+    }
+
+    void merge(ProfileMap const &local)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const &p : local) profiles[p.first].merge(p.second);
+    }
+
+    ~Registry()
+    {
+        if (!profiles.empty()) report(std::cerr, profiles, 20);
+    }
+};
+
+struct ThreadProfiles {
+    ProfileMap profiles;
+    Key last_key;
+    ArrayProfile *last;    // Cache for runs of accesses to one array
+
+    ThreadProfiles() : last_key(nullptr, nullptr), last(nullptr)
+        { Registry::instance(); }    // Constructed first, so destroyed after us
+    ~ThreadProfiles() { Registry::instance().merge(profiles); }
+
+    void flush()
+    {
+        Registry::instance().merge(profiles);
+        profiles.clear();
+        last = nullptr;
+    }
+};
+
+inline ThreadProfiles &thread_profiles()
+{
+    static thread_local ThreadProfiles tp;
+    return tp;
+}
+
+inline int dist_bucket(ptrdiff_t const bytes, size_t const value_size)
+{
+    size_t const d = std::abs(bytes);
+    if (d == 0) return SAME;
+    if (d == value_size) return UNIT;
+    if (d < 64) return LINE;
+    if (d < 4096) return PAGE;
+    return FAR;
+}
+
+/** Called by index() for each access */
+template<class DopeT, class IndexT>
+void record(void const * const memory, DopeT const * const dopes,
+    IndexT const * const index, int const rank, size_t const value_size)
+{
+    ThreadProfiles &tp(thread_profiles());
+    Key const key(memory, dopes);
+    if (!tp.last || tp.last_key != key) {
+        tp.last_key = key;
+        tp.last = &tp.profiles[key];    // unordered_map references stay valid
+    }
+    ArrayProfile &p(*tp.last);
+    // Keys are addresses, which a later array of another shape may reuse
+    if (p.naccess > 0 && !p.same_array(dopes, rank, value_size)) p = ArrayProfile();
+
+    ptrdiff_t diff = 0;
+    for (int k=0; k<rank; ++k) diff += index[k] * dopes[k].stride;
+    diff *= (ptrdiff_t)value_size;
+
+    if (p.naccess == 0) {
+        p.value_size = value_size;
+        for (int k=0; k<rank; ++k) {
+            p.stride.push_back(dopes[k].stride * (ptrdiff_t)value_size);
+            p.extent.push_back(dopes[k].range[1] - dopes[k].range[0]);
+        }
+        p.nchanged.assign(rank, 0);
+        p.last.assign(index, index + rank);
+    } else {
+        int nchanged = 0, changed = -1;
+        for (int k=0; k<rank; ++k) {
+            if (index[k] == p.last[k]) continue;
+            ++p.nchanged[k];
+            ++nchanged;
+            changed = k;
+            p.last[k] = index[k];
+        }
+        ++p.dist[dist_bucket(diff - p.last_diff, value_size)];
+        if (nchanged == 1 && changed != p.fastest_dim()) ++p.nmismatch;
+    }
+    p.last_diff = diff;
+    ++p.naccess;
+}
+
+template<class T>
+void print_vec(std::ostream &os, std::vector<T> const &v)
+{
+    os << "[";
+    for (size_t k=0; k<v.size(); ++k) os << (k ? " " : "") << v[k];
+    os << "]";
+}
+
+inline void report(std::ostream &os, ProfileMap const &profiles, size_t const max_arrays)
+{
+    std::map<void const *, std::string> labels;
+    {
+        Registry &reg(Registry::instance());
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        labels = reg.labels;
+    }
+
+    std::vector<std::pair<Key, ArrayProfile const *>> hot;
+    for (auto const &p : profiles) hot.push_back(std::make_pair(p.first, &p.second));
+    std::sort(hot.begin(), hot.end(), [](
+        std::pair<Key, ArrayProfile const *> const &a, std::pair<Key, ArrayProfile const *> const &b)
+        { return a.second->naccess > b.second->naccess; });
+
+    os << "blitz11 access profile: " << hot.size() << " arrays\n";
+    for (size_t i=0; i<hot.size() && i<max_arrays; ++i) {
+        ArrayProfile const &p(*hot[i].second);
+        auto const label(labels.find(hot[i].first.first));
+        os << "  " << (label == labels.end() ? "(unlabeled)" : label->second)
+            << " @" << hot[i].first.first << ": " << p.naccess << " accesses, extent ";
+        print_vec(os, p.extent);
+        os << ", stride bytes ";
+        print_vec(os, p.stride);
+        os << "\n    steps:";
+        for (int d=0; d<NDIST; ++d) os << " " << dist_names[d] << "=" << p.dist[d];
+        os << "\n    index changes by dim ";
+        print_vec(os, p.nchanged);
+        os << "\n";
+
+        int const inner = p.inner_dim(), fastest = p.fastest_dim();
+        if (inner < 0 || fastest < 0 || inner == fastest || p.nmismatch == 0) continue;
+
+        int const rank = p.stride.size();
+        std::vector<int> loops(rank), layout(rank);
+        std::iota(loops.begin(), loops.end(), 0);
+        std::iota(layout.begin(), layout.end(), 0);
+        // Loop outermost to innermost by decreasing |stride|...
+        std::stable_sort(loops.begin(), loops.end(), [&p](int a, int b)
+            { return std::abs(p.stride[a]) > std::abs(p.stride[b]); });
+        // ...or store with the most-changing dimension fastest
+        std::stable_sort(layout.begin(), layout.end(), [&p](int a, int b)
+            { return p.nchanged[a] < p.nchanged[b]; });
+
+        os << "    MISMATCH: inner loop runs over dim " << inner << " (stride "
+            << p.stride[inner] << "B) but dim " << fastest << " has stride "
+            << p.stride[fastest] << "B; " << p.nmismatch << " mismatched steps\n"
+            << "    suggest loop order (outer to inner) ";
+        print_vec(os, loops);
+        os << ", or storage order (slowest to fastest) ";
+        print_vec(os, layout);
+        os << "\n";
+    }
+}
+
+}    // namespace profile_detail
+
+
+/** Names the array (all views of its memory) in profile reports */
+template<class ArrayT>
+void access_profile_label(ArrayT const &arr, std::string const &name)
+{
+    profile_detail::Registry &reg(profile_detail::Registry::instance());
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.labels[arr.memory().data()] = name;
+}
+
+/** Reports the profiles gathered so far: exited threads plus the
+calling thread */
+inline void access_profile_report(std::ostream &os, size_t const max_arrays = 20)
+{
+    profile_detail::thread_profiles().flush();
+    profile_detail::Registry &reg(profile_detail::Registry::instance());
+    profile_detail::ProfileMap profiles;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        profiles = reg.profiles;
+    }
+    profile_detail::report(os, profiles, max_arrays);
+}
+
+#else    // BLITZ11_ACCESS_PROFILE
+
+template<class ArrayT>
+void access_profile_label(ArrayT const &, std::string const &) {}
+
+inline void access_profile_report(std::ostream &, size_t = 20) {}
+
+#endif    // BLITZ11_ACCESS_PROFILE
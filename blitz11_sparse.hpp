@@ -0,0 +1,243 @@
+/**
+Gather/scatter with index arrays, and sparse matrix (CSR) times array
+kernels for regridding.
+
+Elements are addressed by position (see PositionMap), whatever the
+array's Dope layout.  Indices are not range-checked in the
+gather/scatter loops; CsrMatrix checks its own.
+
+spmv() partitions rows among threads by non-zero count; each thread
+owns its output rows, so no atomics are needed.  scatter_add() gets the
+same conflict-free parallelism by first sorting its triplets into a
+CsrMatrix keyed on the output position.  With AVX2, double-precision
+rows over a unit-stride input use hardware gathers.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+#include "blitz11_parallel.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+namespace sparse_detail {
+
+template<class ValueT, int RANK, class IndexT>
+ValueT *origin(Array<ValueT, RANK, IndexT> const &arr)
+    { return reinterpret_cast<ValueT *>(arr.memory().base()); }
+
+}    // namespace sparse_detail
+
+
+/** out[i] = in[idx[i]] for each position i of out */
+template<class OutT, int ROUT, class InT, int RIN, class IndexT, class IdxT>
+void gather(Array<OutT, ROUT, IndexT> const &out, Array<InT, RIN, IndexT> const &in, IdxT const * const idx)
+{
+    PositionMap<IndexT> const om(out.dopes()), im(in.dopes());
+    OutT * const o = sparse_detail::origin(out);
+    InT * const x = sparse_detail::origin(in);
+    size_t const n = om.size();
+
+    if (om.affine() && im.affine()) {
+        OutT * const o0 = o + om.low_diff();
+        InT * const x0 = x + im.low_diff();
+        ptrdiff_t const os = om.affine_stride(), is = im.affine_stride();
+        if (os == 1 && is == 1) for (size_t i=0; i<n; ++i) o0[i] = x0[idx[i]];
+        else for (size_t i=0; i<n; ++i) o0[i*os] = x0[idx[i]*is];
+    } else {
+        for (size_t i=0; i<n; ++i) o[om.diff(i)] = x[im.diff(idx[i])];
+    }
+}
+
+/** out[idx[i]] = in[i] for each position i of in */
+template<class OutT, int ROUT, class InT, int RIN, class IndexT, class IdxT>
+void scatter(Array<OutT, ROUT, IndexT> const &out, IdxT const * const idx, Array<InT, RIN, IndexT> const &in)
+{
+    PositionMap<IndexT> const om(out.dopes()), im(in.dopes());
+    OutT * const o = sparse_detail::origin(out);
+    InT * const x = sparse_detail::origin(in);
+    for (size_t i=0; i<im.size(); ++i) o[om.diff(idx[i])] = x[im.diff(i)];
+}
+
+
+/** Sparse matrix in compressed sparse row form.  Rows index output
+positions, columns input positions. */
+template<class ValueT, class IdxT=int>
+struct CsrMatrix {
+    size_t nrows, ncols;
+    std::vector<size_t> row_ptr;    // Row r is [row_ptr[r], row_ptr[r+1])
+    std::vector<IdxT> col;
+    std::vector<ValueT> val;
+
+    CsrMatrix() : nrows(0), ncols(0), row_ptr(1, 0) {}
+
+    size_t nnz() const { return col.size(); }
+
+    /** Builds from (row, col, value) triplets, in any order.  Duplicates
+    are kept; their products add up in spmv(). */
+    static CsrMatrix from_triplets(size_t const nrows, size_t const ncols,
+        IdxT const * const rows, IdxT const * const cols, ValueT const * const vals, size_t const n)
+    {
+        CsrMatrix A;
+        A.nrows = nrows;
+        A.ncols = ncols;
+        A.row_ptr.assign(nrows + 1, 0);
+        for (size_t i=0; i<n; ++i) {
+            if (rows[i] < 0 || (size_t)rows[i] >= nrows || cols[i] < 0 || (size_t)cols[i] >= ncols)
+                throw std::invalid_argument("CsrMatrix: triplet index out of range");
+            ++A.row_ptr[rows[i] + 1];
+        }
+        std::partial_sum(A.row_ptr.begin(), A.row_ptr.end(), A.row_ptr.begin());
+
+        // Counting sort by row, stable within a row
+        std::vector<size_t> next(A.row_ptr.begin(), A.row_ptr.end() - 1);
+        A.col.resize(n);
+        A.val.resize(n);
+        for (size_t i=0; i<n; ++i) {
+            size_t const k = next[rows[i]]++;
+            A.col[k] = cols[i];
+            A.val[k] = vals[i];
+        }
+        return A;
+    }
+
+    CsrMatrix transpose() const
+    {
+        std::vector<IdxT> rows(nnz());
+        for (size_t r=0; r<nrows; ++r)
+            for (size_t k=row_ptr[r]; k<row_ptr[r+1]; ++k) rows[k] = (IdxT)r;
+        return from_triplets(ncols, nrows, col.data(), rows.data(), val.data(), nnz());
+    }
+};
+
+
+namespace sparse_detail {
+
+/** sum_k val[k] * x[col[k]*stride], k in [k0, k1) */
+template<class AccT, class ValueT, class IdxT, class InT>
+inline AccT row_dot(ValueT const * const val, IdxT const * const col,
+    InT const * const x, ptrdiff_t const stride, size_t const k0, size_t const k1)
+{
+    AccT a0(0), a1(0);
+    size_t k = k0;
+    for (; k+2 <= k1; k += 2) {
+        a0 += val[k] * x[col[k]*stride];
+        a1 += val[k+1] * x[col[k+1]*stride];
+    }
+    if (k < k1) a0 += val[k] * x[col[k]*stride];
+    return a0 + a1;
+}
+
+#if defined(__AVX2__)
+inline double row_dot(double const * const val, int const * const col,
+    double const * const x, size_t const k0, size_t const k1)
+{
+    __m256d const zero = _mm256_setzero_pd();
+    __m256d const all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    __m256d acc = zero;
+    size_t k = k0;
+    for (; k+4 <= k1; k += 4) {
+        __m128i const ix = _mm_loadu_si128(reinterpret_cast<__m128i const *>(col + k));
+        __m256d const xv = _mm256_mask_i32gather_pd(zero, x, ix, all, 8);
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(val + k), xv));
+    }
+    __m128d const h = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; k<k1; ++k) sum += val[k] * x[col[k]];
+    return sum;
+}
+
+template<class T>
+struct use_avx2_gather : public std::false_type {};
+template<>
+struct use_avx2_gather<std::tuple<double, int, double>> : public std::true_type {};
+#endif
+
+}    // namespace sparse_detail
+
+
+/** out = A * in (or out += A * in if accumulate), out and in addressed
+by position.  Rows are split among threads by non-zero count.
+@param nthreads <= 0: default_nthreads() */
+template<class OutT, int ROUT, class InT, int RIN, class IndexT, class ValueT, class IdxT>
+void spmv(Array<OutT, ROUT, IndexT> const &out, CsrMatrix<ValueT, IdxT> const &A,
+    Array<InT, RIN, IndexT> const &in, int nthreads = 0, bool const accumulate = false)
+{
+    typedef typename std::remove_const<OutT>::type AccT;
+    PositionMap<IndexT> const om(out.dopes()), im(in.dopes());
+    if (om.size() != A.nrows || im.size() != A.ncols)
+        throw std::invalid_argument("spmv: array sizes do not match the matrix");
+
+    OutT * const o = sparse_detail::origin(out);
+    InT * const x = sparse_detail::origin(in);
+
+    // Non-affine inputs: translate columns to index diffs once
+    std::vector<ptrdiff_t> cdiff;
+    if (!im.affine()) {
+        cdiff.resize(A.nnz());
+        for (size_t k=0; k<A.nnz(); ++k) cdiff[k] = im.diff(A.col[k]);
+    }
+    InT * const x0 = x + im.low_diff();
+    ptrdiff_t const xs = im.affine_stride();
+
+    if (nthreads <= 0) nthreads = default_nthreads();
+    size_t const nchunk = std::min<size_t>(A.nrows, 4 * (size_t)nthreads);
+    parallel_for(nchunk, nthreads, [&](size_t const c) {
+        // Rows [r0, r1) hold about nnz/nchunk non-zeros
+        size_t const r0 = std::upper_bound(A.row_ptr.begin(), A.row_ptr.end(),
+            A.nnz() * c / nchunk) - A.row_ptr.begin() - 1;
+        size_t const r1 = (c == nchunk-1 ? A.nrows : std::upper_bound(A.row_ptr.begin(), A.row_ptr.end(),
+            A.nnz() * (c+1) / nchunk) - A.row_ptr.begin() - 1);
+
+        for (size_t r = (c == 0 ? 0 : r0); r<r1; ++r) {
+            size_t const k0 = A.row_ptr[r], k1 = A.row_ptr[r+1];
+            AccT sum;
+            if (!cdiff.empty()) {
+                sum = sparse_detail::row_dot<AccT>(A.val.data(), cdiff.data(), x, 1, k0, k1);
+            } else {
+#if defined(__AVX2__)
+                if (sparse_detail::use_avx2_gather<std::tuple<
+                    ValueT, IdxT, typename std::remove_const<InT>::type>>::value && xs == 1) {
+                    sum = sparse_detail::row_dot(
+                        reinterpret_cast<double const *>(A.val.data()),
+                        reinterpret_cast<int const *>(A.col.data()),
+                        reinterpret_cast<double const *>(x0), k0, k1);
+                } else
+#endif
+                sum = sparse_detail::row_dot<AccT>(A.val.data(), A.col.data(), x0, xs, k0, k1);
+            }
+            OutT &dst(o[om.diff(r)]);
+            dst = (accumulate ? dst + sum : sum);
+        }
+    });
+}
+
+/** out[out_idx[i]] += w[i] * in[in_idx[i]] for i in [0, n).  With more
+than one thread, the triplets are first sorted by output position so
+each thread owns whole output elements. */
+template<class OutT, int ROUT, class InT, int RIN, class IndexT, class WeightT, class IdxT>
+void scatter_add(Array<OutT, ROUT, IndexT> const &out, IdxT const * const out_idx,
+    WeightT const * const w, Array<InT, RIN, IndexT> const &in, IdxT const * const in_idx,
+    size_t const n, int nthreads = 1)
+{
+    if (nthreads <= 0) nthreads = default_nthreads();
+    if (nthreads == 1) {
+        PositionMap<IndexT> const om(out.dopes()), im(in.dopes());
+        OutT * const o = sparse_detail::origin(out);
+        InT * const x = sparse_detail::origin(in);
+        for (size_t i=0; i<n; ++i) o[om.diff(out_idx[i])] += w[i] * x[im.diff(in_idx[i])];
+        return;
+    }
+
+    PositionMap<IndexT> const om(out.dopes()), im(in.dopes());
+    CsrMatrix<WeightT, IdxT> const A(CsrMatrix<WeightT, IdxT>::from_triplets(
+        om.size(), im.size(), out_idx, in_idx, w, n));
+    spmv(out, A, in, nthreads, true);
+}
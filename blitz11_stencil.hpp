@@ -0,0 +1,262 @@
+/**
+Stencil operators on 3-D arrays.
+
+A stencil kernel is any functor taking a StencilView (the source
+around the current point, addressed by relative offsets) and returning
+the new value:
+
+    auto lap = [](StencilView<double> const &u) {
+        return u(-1,0,0) + u(1,0,0) + u(0,-1,0) + u(0,1,0)
+             + u(0,0,-1) + u(0,0,1) - 6*u(0,0,0);
+    };
+    apply_stencil(out, in, {{1,1,1}}, lap);
+
+Source and destination share one index space.  Halos are simply the
+part of the source's Dope::range outside the interior: with a radius of
+r[k], points within r[k] of either end of dimension k are not written,
+so an array over [-1, n+1) with radius 1 updates [0, n).  Bases may
+start anywhere.  Offsets beyond the radius are not checked.  The source
+and destination must not overlap.
+
+Traversal follows the source's strides: the inner loop runs over the
+smallest stride, the two outer loops are cut into blocks for cache
+reuse, and blocks are spread over threads.  When the inner dimension is
+dimension 2 and both arrays are unit-stride there, the view's inner
+stride is the constant 1, so inlined kernels vectorize along it.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+#include "blitz11_parallel.hpp"
+
+#include <cmath>
+#include <cstdlib>
+
+
+/** The source array seen from one stencil point */
+template<class ValueT>
+class StencilView {
+    ValueT const *_p;
+    ptrdiff_t _s0, _s1, _s2;
+
+public:
+    StencilView(ValueT const * const p, ptrdiff_t const s0, ptrdiff_t const s1, ptrdiff_t const s2)
+        : _p(p), _s0(s0), _s1(s1), _s2(s2) {}
+
+    /** Source value at offset (d0, d1, d2) from the current point */
+    ValueT const &operator()(int const d0, int const d1, int const d2) const
+        { return _p[d0*_s0 + d1*_s1 + d2*_s2]; }
+};
+
+
+struct StencilOptions {
+    std::array<int,3> block;    // Block size per dimension; 0 = automatic
+    int nthreads;               // <= 0: default_nthreads()
+
+    StencilOptions() : block({{0,0,0}}), nthreads(0) {}
+};
+
+
+/** View of the points of arr at least radius[k] from the edges of
+dimension k; shares arr's memory. */
+template<class ValueT, class IndexT>
+Array<ValueT, 3, IndexT> interior(Array<ValueT, 3, IndexT> const &arr, std::array<int,3> const &radius)
+{
+    std::vector<Dope<IndexT>> dopes(arr.dopes());
+    for (int k=0; k<3; ++k) {
+        dopes[k].range[0] += radius[k];
+        dopes[k].range[1] -= radius[k];
+        if (dopes[k].range[1] < dopes[k].range[0]) dopes[k].range[1] = dopes[k].range[0];
+    }
+    return Array<ValueT, 3, IndexT>(arr.memory(), dopes);
+}
+
+
+namespace stencil_detail {
+
+/** Box [lo, hi) of points to update, and the loop order */
+template<class IndexT>
+struct Region {
+    std::array<IndexT,3> lo, hi;
+    std::array<int,3> order;    // order[0] outermost ... order[2] innermost
+
+    bool empty() const
+    {
+        for (int k=0; k<3; ++k) if (hi[k] <= lo[k]) return true;
+        return false;
+    }
+};
+
+template<class IndexT>
+Region<IndexT> region(std::vector<Dope<IndexT>> const &dst, std::vector<Dope<IndexT>> const &src,
+    std::array<int,3> const &radius)
+{
+    Region<IndexT> r;
+    for (int k=0; k<3; ++k) {
+        r.lo[k] = std::max<IndexT>(src[k].range[0] + radius[k], dst[k].range[0]);
+        r.hi[k] = std::min<IndexT>(src[k].range[1] - radius[k], dst[k].range[1]);
+        r.order[k] = k;
+    }
+    // Stable: row-major arrays keep dimension 2 innermost
+    std::stable_sort(r.order.begin(), r.order.end(), [&src](int a, int b)
+        { return std::abs(src[a].stride) > std::abs(src[b].stride); });
+    return r;
+}
+
+}    // namespace stencil_detail
+
+
+/** dst(ix) = kernel(StencilView of src at ix) for every ix of src's
+interior (see interior()) that is also in dst. */
+template<class DestT, class SrcT, class IndexT, class KernelT>
+void apply_stencil(
+    Array<DestT, 3, IndexT> const &dst,
+    Array<SrcT, 3, IndexT> const &src,
+    std::array<int,3> const &radius,
+    KernelT const &kernel,
+    StencilOptions const &opt = StencilOptions())
+{
+    typedef typename std::remove_const<SrcT>::type T;
+    std::vector<Dope<IndexT>> const &dd(dst.dopes());
+    std::vector<Dope<IndexT>> const &sd(src.dopes());
+    stencil_detail::Region<IndexT> const r(stencil_detail::region(dd, sd, radius));
+    if (r.empty()) return;
+
+    int const o = r.order[0], m = r.order[1], i = r.order[2];
+    IndexT const bo = (opt.block[o] > 0 ? opt.block[o] : 32);
+    IndexT const bm = (opt.block[m] > 0 ? opt.block[m] : 16);
+    IndexT const bi = (opt.block[i] > 0 ? opt.block[i] : r.hi[i] - r.lo[i]);
+    size_t const no = (r.hi[o] - r.lo[o] + bo - 1) / bo;
+    size_t const nm = (r.hi[m] - r.lo[m] + bm - 1) / bm;
+    size_t const ni = (r.hi[i] - r.lo[i] + bi - 1) / bi;
+
+    DestT * const dbase = reinterpret_cast<DestT *>(dst.memory().base());
+    T const * const sbase = reinterpret_cast<T const *>(src.memory().base());
+    ptrdiff_t const ss0 = sd[0].stride, ss1 = sd[1].stride, ss2 = sd[2].stride;
+    bool const unit = (i == 2 && dd[2].stride == 1 && ss2 == 1);
+
+    parallel_for(no * nm * ni, opt.nthreads, [&](size_t const b) {
+        IndexT const o0 = r.lo[o] + (IndexT)(b / (nm * ni)) * bo;
+        IndexT const m0 = r.lo[m] + (IndexT)(b / ni % nm) * bm;
+        IndexT const i0 = r.lo[i] + (IndexT)(b % ni) * bi;
+        IndexT const o1 = std::min<IndexT>(o0 + bo, r.hi[o]);
+        IndexT const m1 = std::min<IndexT>(m0 + bm, r.hi[m]);
+        ptrdiff_t const n = std::min<IndexT>(i0 + bi, r.hi[i]) - i0;
+
+        for (IndexT a=o0; a<o1; ++a) {
+            for (IndexT c=m0; c<m1; ++c) {
+                ptrdiff_t const dro = a*dd[o].stride + c*dd[m].stride + i0*dd[i].stride;
+                ptrdiff_t const sro = a*sd[o].stride + c*sd[m].stride + i0*sd[i].stride;
+                DestT * const d = dbase + dro;
+                T const * const s = sbase + sro;
+                if (unit) {
+                    for (ptrdiff_t j=0; j<n; ++j)
+                        d[j] = kernel(StencilView<T>(s + j, ss0, ss1, 1));
+                } else {
+                    ptrdiff_t const ds = dd[i].stride, ssi = sd[i].stride;
+                    for (ptrdiff_t j=0; j<n; ++j)
+                        d[j*ds] = kernel(StencilView<T>(s + j*ssi, ss0, ss1, ss2));
+                }
+            }
+        }
+    });
+}
+
+
+// ---------------------------------------------------------------
+// Temporal blocking
+
+struct SweepOptions {
+    std::array<int,2> tile;    // Tile size in the two outer loop dimensions; 0 = automatic
+    int steps_per_tile;        // Sweeps done per tile before moving on; 0 = automatic
+    size_t cache_bytes;        // Working set to aim for when sizing tiles automatically
+    int nthreads;              // <= 0: default_nthreads()
+
+    SweepOptions() : tile({{0,0}}), steps_per_tile(0), cache_bytes(512*1024), nthreads(0) {}
+};
+
+/** Applies kernel nsteps times, alternating between a and b: sweep 1
+reads a and writes b, sweep 2 reads b and writes a, and so on.  Points
+outside the interior are never written, so b's halo must already hold
+the same values as a's (eg: b is a copy of a).  a and b must cover the
+same index ranges.
+
+Rather than streaming the whole array through memory once per sweep,
+the two outer loop dimensions are cut into parallelogram tiles, each
+skewed back by the radius per sweep, and steps_per_tile sweeps are done
+on a tile while it is in cache.  Tiles on the same anti-diagonal are
+independent and run in parallel.  The result equals that of nsteps
+calls to apply_stencil().
+
+@return The array holding the result: a if nsteps is even, else b */
+template<class ValueT, class IndexT, class KernelT>
+Array<ValueT, 3, IndexT> const &iterate_stencil(
+    Array<ValueT, 3, IndexT> const &a,
+    Array<ValueT, 3, IndexT> const &b,
+    std::array<int,3> const &radius,
+    KernelT const &kernel,
+    int const nsteps,
+    SweepOptions const &opt = SweepOptions())
+{
+    std::vector<Dope<IndexT>> const &ad(a.dopes());
+    for (int k=0; k<3; ++k) {
+        if (ad[k].range != b.dopes()[k].range)
+            throw std::invalid_argument("iterate_stencil: arrays cover different index ranges");
+    }
+    Array<ValueT, 3, IndexT> const * const buf[2] = {&a, &b};
+    stencil_detail::Region<IndexT> const r(stencil_detail::region(ad, ad, radius));
+    if (nsteps <= 0 || r.empty()) return *buf[(nsteps > 0 ? nsteps : 0) % 2];
+
+    int const o = r.order[0], m = r.order[1], i = r.order[2];
+    int const steps = (opt.steps_per_tile > 0 ? opt.steps_per_tile : 4);
+
+    // Tiles are at least 2*radius so a tile's dependencies lie in its
+    // immediate predecessors
+    IndexT tile[2] = {(IndexT)opt.tile[0], (IndexT)opt.tile[1]};
+    if (tile[0] <= 0 || tile[1] <= 0) {
+        double const plane = 2.0 * sizeof(ValueT) * (r.hi[i] - r.lo[i]);    // Both buffers
+        IndexT const side = (IndexT)std::sqrt(opt.cache_bytes / plane);
+        if (tile[0] <= 0) tile[0] = side - steps * radius[o];
+        if (tile[1] <= 0) tile[1] = side - steps * radius[m];
+    }
+    tile[0] = std::max<IndexT>(tile[0], std::max(2*radius[o], 1));
+    tile[1] = std::max<IndexT>(tile[1], std::max(2*radius[m], 1));
+    IndexT const nt0 = (r.hi[o] - r.lo[o] + tile[0] - 1) / tile[0];
+    IndexT const nt1 = (r.hi[m] - r.lo[m] + tile[1] - 1) / tile[1];
+
+    StencilOptions serial;
+    serial.nthreads = 1;
+
+    for (int step0=0; step0 < nsteps; step0 += steps) {
+        int const nstep = std::min(steps, nsteps - step0);
+
+        // Range of tile t in dimension k after s sweeps' worth of skew
+        auto skewed = [&](int const k, IndexT const t, IndexT const nt, IndexT const len, int const s) {
+            IndexT const shift = s * radius[k];
+            IndexT const lo = std::max<IndexT>(r.lo[k], r.lo[k] + t*len - shift);
+            IndexT const hi = (t == nt-1 ? r.hi[k] : std::min<IndexT>(r.hi[k], r.lo[k] + (t+1)*len - shift));
+            return std::array<IndexT,2>{{lo, hi}};
+        };
+
+        for (IndexT diag=0; diag < nt0 + nt1 - 1; ++diag) {
+            IndexT const t0_lo = std::max<IndexT>(0, diag - (nt1-1));
+            IndexT const t0_hi = std::min<IndexT>(nt0-1, diag);
+            parallel_for(t0_hi - t0_lo + 1, opt.nthreads, [&](size_t const n) {
+                IndexT const t0 = t0_lo + (IndexT)n;
+                IndexT const t1 = diag - t0;
+                for (int s=0; s<nstep; ++s) {
+                    int const step = step0 + s;
+                    std::vector<Dope<IndexT>> dopes(buf[(step+1) % 2]->dopes());
+                    dopes[o].range = skewed(o, t0, nt0, tile[0], s);
+                    dopes[m].range = skewed(m, t1, nt1, tile[1], s);
+                    if (dopes[o].range[1] <= dopes[o].range[0] || dopes[m].range[1] <= dopes[m].range[0])
+                        continue;
+                    Array<ValueT, 3, IndexT> const dst(buf[(step+1) % 2]->memory(), dopes);
+                    apply_stencil(dst, *buf[step % 2], radius, kernel, serial);
+                }
+            });
+        }
+    }
+    return *buf[nsteps % 2];
+}
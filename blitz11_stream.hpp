@@ -0,0 +1,222 @@
+/**
+Streaming access to block files larger than RAM.
+
+SlabReader walks a block file (see blitz11_io.hpp) in slabs along one
+dimension.  Each slab is presented as an Array borrowing the reader's
+buffer, indexed in the file's global index space.  While the caller
+works on one slab, the next is read on a background thread.
+
+Slabs along the dimension of largest stride (the outermost, for a
+dense file) are read with a single pread().  Other dimensions are read
+run by run into a dense row-major buffer, one pread() per run, which is
+slower.
+*/
+
+#pragma once
+
+#include "blitz11_io.hpp"
+
+#include <cstdlib>
+
+
+template<class ValueT, int RANK, class IndexT=int>
+class SlabReader {
+    typedef typename std::remove_const<ValueT>::type T;
+    typedef typename transfer_const<char, ValueT>::type CharT;
+
+    struct Slab {
+        std::vector<T> buf;
+        std::vector<Dope<IndexT>> dopes;
+        ptrdiff_t origin;    // Element of buf at index diff 0
+        IndexT low, high;    // Range of this slab along _dim
+    };
+
+    std::string const _fname;
+    int _fd;
+    BlockFileInfo _info;
+    std::vector<Dope<IndexT>> _file_dopes;
+    int const _dim;
+    IndexT const _slab_extent;
+    bool const _read_ahead;
+
+    IndexT _next_low;       // Start of the next slab to read
+    Slab _slabs[2];
+    int _cur;               // Index into _slabs of the current slab; -1 before the first
+    std::future<void> _ahead;    // Reading _slabs[1-_cur]
+
+public:
+    /** @param dim Dimension to iterate over
+    @param slab_extent Number of indices along dim in each slab (the last may be short) */
+    SlabReader(std::string const &fname, int const dim, IndexT const slab_extent, bool const read_ahead = true)
+    : _fname(fname), _fd(-1), _dim(dim), _slab_extent(slab_extent),
+        _read_ahead(read_ahead), _cur(-1)
+    {
+        if (dim < 0 || dim >= RANK)
+            throw std::invalid_argument("SlabReader: dim out of range");
+        if (slab_extent <= 0)
+            throw std::invalid_argument("SlabReader: slab_extent must be positive");
+
+        _fd = ::open(fname.c_str(), O_RDONLY);
+        if (_fd < 0) throw blockfile_detail::io_error("Cannot open", fname);
+        try {
+            _info = read_block_info(_fd, fname);
+            _file_dopes = check_block_info<ValueT, IndexT>(_info, fname);
+        } catch(...) {
+            ::close(_fd);
+            throw;
+        }
+        if (_file_dopes.size() != RANK) {
+            ::close(_fd);
+            throw std::runtime_error("SlabReader: rank mismatch reading " + fname);
+        }
+        _next_low = _file_dopes[dim].range[0];
+    }
+
+    ~SlabReader()
+    {
+        if (_ahead.valid()) _ahead.wait();
+        ::close(_fd);
+    }
+
+    SlabReader(SlabReader const &) = delete;
+    SlabReader &operator=(SlabReader const &) = delete;
+
+    /** Dopes of the whole file */
+    std::vector<Dope<IndexT>> const &file_dopes() const { return _file_dopes; }
+
+    /** Advances to the next slab.  Invalidates arrays from earlier
+    slab() calls.  Returns false after the last slab. */
+    bool next()
+    {
+        IndexT const end = _file_dopes[_dim].range[1];
+
+        if (_cur < 0 || !_ahead.valid()) {
+            // First slab, or read-ahead off: read synchronously
+            if (_next_low >= end) return false;
+            _cur = (_cur < 0 ? 0 : _cur);
+            read_slab(_slabs[_cur], _next_low);
+        } else {
+            _ahead.get();    // Rethrows read errors
+            _cur = 1 - _cur;
+        }
+        _next_low = _slabs[_cur].high;
+
+        if (_read_ahead && _next_low < end) {
+            Slab *ahead = &_slabs[1-_cur];
+            IndexT const low = _next_low;
+            _ahead = std::async(std::launch::async, [this, ahead, low]() { read_slab(*ahead, low); });
+        }
+        return true;
+    }
+
+    /** The current slab, borrowing this reader's buffer */
+    Array<ValueT, RANK, IndexT> slab() const
+    {
+        Slab const &s(current());
+        MemoryBlock<CharT> memory(
+            reinterpret_cast<CharT *>(const_cast<T *>(s.buf.data())),
+            s.buf.size() * sizeof(T));
+        return Array<ValueT, RANK, IndexT>(
+            memory.rebased(s.origin * (ptrdiff_t)sizeof(T)), s.dopes);
+    }
+
+    /** Range of the current slab along the iterated dimension */
+    IndexT low() const { return current().low; }
+    IndexT high() const { return current().high; }
+
+private:
+    Slab const &current() const
+    {
+        if (_cur < 0) throw std::logic_error("SlabReader: no current slab; call next() first");
+        return _slabs[_cur];
+    }
+
+    /** File byte offset of the element at index diff */
+    off_t file_offset(ptrdiff_t const diff) const
+    {
+        return _info.header.data_offset + _info.header.origin_bytes + diff * (ptrdiff_t)sizeof(T);
+    }
+
+    void read_slab(Slab &s, IndexT const low)
+    {
+        using namespace blockfile_detail;
+
+        s.low = low;
+        s.high = std::min<IndexT>(low + _slab_extent, _file_dopes[_dim].range[1]);
+        std::vector<Dope<IndexT>> sdopes(_file_dopes);
+        sdopes[_dim].range[0] = s.low;
+        sdopes[_dim].range[1] = s.high;
+
+        size_t count = 1;
+        for (int i=0; i<RANK; ++i)
+            count *= std::max<ptrdiff_t>(0, sdopes[i].range[1] - sdopes[i].range[0]);
+        std::array<ptrdiff_t,2> const diffs(diff_range(&sdopes[0], RANK));
+        size_t const span = diffs[1] - diffs[0] + 1;
+
+        if (count == 0) {
+            s.buf.clear();
+            s.dopes = sdopes;
+            s.origin = 0;
+        } else if (span <= 2*count) {
+            // (Nearly) contiguous in the file: one read, keep the file's strides
+            s.buf.resize(span);
+            pread_all(_fd, &s.buf[0], span*sizeof(T), file_offset(diffs[0]), _fname);
+            s.dopes = sdopes;
+            s.origin = -diffs[0];
+        } else {
+            read_runs(s, sdopes, count);
+        }
+
+        if (_info.swapped)
+            swap_dtype(s.buf.data(), dtype_traits<ValueT>::kind, sizeof(T), s.buf.size());
+    }
+
+    /** Reads a scattered slab run by run, along the dimension of
+    smallest stride, into a dense row-major buffer.  Each run's
+    covering byte span is read with one pread() and gathered. */
+    void read_runs(Slab &s, std::vector<Dope<IndexT>> const &sdopes, size_t const count)
+    {
+        using namespace blockfile_detail;
+
+        int r = 0;
+        for (int i=1; i<RANK; ++i)
+            if (std::abs(sdopes[i].stride) < std::abs(sdopes[r].stride)) r = i;
+
+        std::array<IndexT,RANK> low, high;
+        for (int i=0; i<RANK; ++i) {
+            low[i] = sdopes[i].range[0];
+            high[i] = sdopes[i].range[1];
+        }
+        s.dopes = row_major_dopes(&low[0], &high[0], RANK);
+        s.buf.resize(count);
+        s.origin = -diff_range(&s.dopes[0], RANK)[0];
+
+        IndexT const run = high[r] - low[r];
+        ptrdiff_t const fstride = sdopes[r].stride;
+        ptrdiff_t const cover = (run-1) * (ptrdiff_t)std::abs(fstride) + 1;
+        std::vector<T> tmp(cover);
+        T const * const src = &tmp[fstride > 0 ? 0 : cover-1];
+        IndexT const extent[1] = {run};
+        ptrdiff_t const dstride[1] = {s.dopes[r].stride};
+        std::array<IndexT,RANK> ix(low);
+        for (;;) {
+            ix[r] = low[r];
+            ptrdiff_t const fdiff = index_diff(&sdopes[0], &ix[0], RANK);
+            T * const dst = &s.buf[s.origin + index_diff(&s.dopes[0], &ix[0], RANK)];
+
+            // Read the run's span in file order, then gather it
+            ptrdiff_t const first = (fstride > 0 ? fdiff : fdiff + (run-1)*fstride);
+            pread_all(_fd, &tmp[0], cover*sizeof(T), file_offset(first), _fname);
+            copy_strided(1, extent, dst, dstride, src, &fstride);
+
+            // Odometer over the other dimensions
+            int k = RANK-1;
+            for (; k >= 0; --k) {
+                if (k == r) continue;
+                if (++ix[k] < high[k]) break;
+                ix[k] = low[k];
+            }
+            if (k < 0) break;
+        }
+    }
+};
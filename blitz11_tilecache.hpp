@@ -0,0 +1,285 @@
+/**
+Out-of-core random access to block files through an LRU tile cache.
+
+TiledFileArray indexes a block file (see blitz11_io.hpp) exactly like
+an Array: index_diff() gives the element's byte offset in the data
+section, which is split into a tile number and an offset within the
+tile.  At most max_tiles tiles are held in memory; the least recently
+used one is evicted (and written back, if dirty) on a miss.
+
+Prefetch hints load tiles ahead of time: prefetch() loads the tiles
+holding an index box's elements, and AccessHint::SEQUENTIAL reads the
+following tiles on each miss.
+
+Not thread-safe; use one TiledFileArray per thread.
+*/
+
+#pragma once
+
+#include "blitz11_io.hpp"
+
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+
+struct TileCacheStats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t writebacks;    // Dirty tiles written to the file
+    size_t prefetches;    // Tiles loaded by prefetch hints rather than misses
+
+    TileCacheStats() : hits(0), misses(0), evictions(0), writebacks(0), prefetches(0) {}
+};
+
+enum class AccessHint {
+    RANDOM,          // No read-ahead
+    SEQUENTIAL       // On a miss, also load the next readahead tiles
+};
+
+
+template<class ValueT, int RANK, class IndexT=int>
+class TiledFileArray {
+    typedef typename std::remove_const<ValueT>::type T;
+
+    struct Tile {
+        size_t number;
+        std::vector<char> bytes;
+        bool dirty;
+    };
+    typedef std::list<Tile> TileList;
+
+    std::string const _fname;
+    int _fd;
+    bool const _writable;
+    BlockFileInfo _info;
+    std::vector<Dope<IndexT>> _dopes;
+    size_t _tile_bytes;
+    size_t const _max_tiles;
+    size_t _ntiles;                  // Tiles in the data section
+
+    TileList _lru;                   // Most recently used first
+    std::unordered_map<size_t, typename TileList::iterator> _index;
+    Tile *_last;                     // Fast path: most recently used tile (== &_lru.front())
+
+    AccessHint _hint;
+    size_t _readahead;
+    TileCacheStats _stats;
+
+public:
+    /** @param tile_bytes Size of a tile; rounded up to a multiple of sizeof(ValueT)
+    @param max_tiles Maximum number of tiles held in memory
+    @param writable Open the file read-write; set() is only allowed if true
+    Throws std::runtime_error if the file's origin_bytes is not a
+    multiple of sizeof(ValueT), which would split elements across tiles. */
+    TiledFileArray(std::string const &fname, size_t const tile_bytes = 1<<20,
+        size_t const max_tiles = 64, bool const writable = false)
+    : _fname(fname), _fd(-1), _writable(writable),
+        _max_tiles(std::max<size_t>(1, max_tiles)), _last(nullptr),
+        _hint(AccessHint::RANDOM), _readahead(0)
+    {
+        _fd = ::open(fname.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (_fd < 0) throw blockfile_detail::io_error("Cannot open", fname);
+        try {
+            _info = read_block_info(_fd, fname);
+            _dopes = check_block_info<ValueT, IndexT>(_info, fname);
+            if (_info.swapped)
+                throw std::runtime_error("TiledFileArray: file of foreign byte order: " + fname);
+            if (_dopes.size() != RANK)
+                throw std::runtime_error("TiledFileArray: rank mismatch reading " + fname);
+            // Tiles are whole elements from the start of the data section
+            if (_info.header.origin_bytes % sizeof(T) != 0)
+                throw std::runtime_error("TiledFileArray: origin not element-aligned in " + fname);
+        } catch(...) {
+            ::close(_fd);
+            throw;
+        }
+        _tile_bytes = ((std::max(tile_bytes, sizeof(T)) + sizeof(T) - 1) / sizeof(T)) * sizeof(T);
+        _ntiles = (_info.header.data_bytes + _tile_bytes - 1) / _tile_bytes;
+    }
+
+    ~TiledFileArray()
+    {
+        try { flush(); } catch(...) {}
+        ::close(_fd);
+    }
+
+    TiledFileArray(TiledFileArray const &) = delete;
+    TiledFileArray &operator=(TiledFileArray const &) = delete;
+
+    int rank() const { return RANK; }
+    std::vector<Dope<IndexT>> const &dopes() const { return _dopes; }
+    TileCacheStats const &stats() const { return _stats; }
+    void reset_stats() { _stats = TileCacheStats(); }
+
+    /** @param readahead Tiles to load after a missed tile, for AccessHint::SEQUENTIAL */
+    void set_access_hint(AccessHint const hint, size_t const readahead = 4)
+    {
+        _hint = hint;
+        _readahead = (hint == AccessHint::SEQUENTIAL ? readahead : 0);
+    }
+
+    /** Reads an element */
+    T operator()(IndexT const * const ix, RangeErrorFn const * const range_error=nullptr)
+    {
+        size_t offset;
+        Tile &tile(locate(ix, range_error, offset));
+        return *reinterpret_cast<T const *>(&tile.bytes[offset]);
+    }
+
+    /** Writes an element; the tile is written back on eviction or flush() */
+    void set(IndexT const * const ix, T const &val, RangeErrorFn const * const range_error=nullptr)
+    {
+        if (!_writable) throw std::logic_error("TiledFileArray: not opened writable: " + _fname);
+        size_t offset;
+        Tile &tile(locate(ix, range_error, offset));
+        *reinterpret_cast<T *>(&tile.bytes[offset]) = val;
+        tile.dirty = true;
+    }
+
+    /** Loads the tiles holding elements of the index box [low, high),
+    row by row, up to the cache capacity.  Tiles between the box's rows
+    are not loaded. */
+    void prefetch(IndexT const * const low, IndexT const * const high)
+    {
+        std::array<IndexT, RANK> lo, hi;
+        for (int i=0; i<RANK; ++i) {
+            lo[i] = std::max(low[i], _dopes[i].range[0]);
+            hi[i] = std::min(high[i], _dopes[i].range[1]);
+            if (hi[i] <= lo[i]) return;
+        }
+
+        // Rows run along the dimension of smallest |stride|
+        int r = RANK-1;
+        for (int i=0; i<RANK; ++i)
+            if (std::abs(_dopes[i].stride) < std::abs(_dopes[r].stride)) r = i;
+        ptrdiff_t const s = _dopes[r].stride;
+        bool const dense_row = (size_t)std::abs(s) * sizeof(T) <= _tile_bytes;    // No tile skipped
+
+        // Loads (or refreshes) tile t once; false when the cache is full
+        std::unordered_set<size_t> touched;
+        auto const touch = [&](size_t const t) {
+            if (!touched.insert(t).second) return true;
+            auto ii(_index.find(t));
+            if (ii == _index.end()) {
+                load(t);
+                ++_stats.prefetches;
+            } else {
+                _lru.splice(_lru.begin(), _lru, ii->second);
+                _last = &_lru.front();
+            }
+            return touched.size() < _max_tiles;
+        };
+
+        std::array<IndexT, RANK> ix(lo);
+        for (;;) {
+            ix[r] = lo[r];
+            ptrdiff_t const d0 = index_diff(&_dopes[0], &ix[0], RANK);
+            ptrdiff_t const d1 = d0 + (hi[r] - 1 - lo[r]) * s;
+            if (dense_row) {
+                size_t const t0 = tile_of(std::min(d0, d1)), t1 = tile_of(std::max(d0, d1));
+                for (size_t t=t0; t<=t1; ++t) if (!touch(t)) return;
+            } else {
+                for (IndexT j=0; j<hi[r]-lo[r]; ++j) if (!touch(tile_of(d0 + j*s))) return;
+            }
+
+            // Odometer over the other dimensions
+            int k = RANK-1;
+            for (; k >= 0; --k) {
+                if (k == r) continue;
+                if (++ix[k] < hi[k]) break;
+                ix[k] = lo[k];
+            }
+            if (k < 0) break;
+        }
+    }
+
+    /** Writes all dirty tiles back to the file */
+    void flush()
+    {
+        for (auto &tile : _lru) write_back(tile);
+    }
+
+private:
+    size_t tile_of(ptrdiff_t const diff) const
+        { return (_info.header.origin_bytes + diff * (ptrdiff_t)sizeof(T)) / _tile_bytes; }
+
+    /** Finds (loading if needed) the tile holding element ix */
+    Tile &locate(IndexT const * const ix, RangeErrorFn const * const range_error, size_t &offset)
+    {
+        ptrdiff_t const bytes = _info.header.origin_bytes
+            + index_diff(&_dopes[0], ix, RANK, range_error) * (ptrdiff_t)sizeof(T);
+        if (range_error && BLITZ11_UNLIKELY((uint64_t)bytes >= _info.header.data_bytes))    // Also bytes < 0
+            range_error_detail::raise(*range_error, "Memory", 0, 0, _info.header.data_bytes, bytes);
+
+        size_t const t = bytes / _tile_bytes;
+        offset = bytes % _tile_bytes;
+
+        if (_last && _last->number == t) {
+            ++_stats.hits;
+            return *_last;
+        }
+
+        auto ii(_index.find(t));
+        if (ii != _index.end()) {
+            ++_stats.hits;
+            _lru.splice(_lru.begin(), _lru, ii->second);
+            _last = &_lru.front();
+            return *_last;
+        }
+
+        ++_stats.misses;
+        for (size_t k=1; k<=_readahead && t+k < _ntiles && k < _max_tiles; ++k) {
+            if (_index.find(t+k) == _index.end()) {
+                load(t+k);
+                ++_stats.prefetches;
+            }
+        }
+        return load(t);
+    }
+
+    /** Loads tile t to the front of the LRU list, evicting if full */
+    Tile &load(size_t const t)
+    {
+        if (_lru.size() < _max_tiles) {
+            _lru.push_front(Tile());
+        } else {
+            Tile &victim(_lru.back());
+            write_back(victim);
+            _index.erase(victim.number);
+            _lru.splice(_lru.begin(), _lru, std::prev(_lru.end()));
+            ++_stats.evictions;
+        }
+
+        Tile &tile(_lru.front());
+        tile.number = t;
+        tile.dirty = false;
+        tile.bytes.resize(_tile_bytes);
+        size_t const start = t * _tile_bytes;
+        size_t const n = std::min<size_t>(_tile_bytes, _info.header.data_bytes - start);
+        try {
+            blockfile_detail::pread_all(_fd, &tile.bytes[0], n, _info.header.data_offset + start, _fname);
+        } catch(...) {
+            // Drop the half-loaded tile, so nothing can find its stale bytes
+            if (_last == &tile) _last = nullptr;
+            _lru.pop_front();
+            throw;
+        }
+
+        _index[t] = _lru.begin();
+        _last = &tile;
+        return tile;
+    }
+
+    void write_back(Tile &tile)
+    {
+        if (!tile.dirty) return;
+        size_t const start = tile.number * _tile_bytes;
+        size_t const n = std::min<size_t>(_tile_bytes, _info.header.data_bytes - start);
+        blockfile_detail::pwrite_all(_fd, &tile.bytes[0], n, _info.header.data_offset + start, _fname);
+        tile.dirty = false;
+        ++_stats.writebacks;
+    }
+};
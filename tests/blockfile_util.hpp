@@ -0,0 +1,54 @@
+/**
+Raw block file manipulation for the blitz11 I/O tests.
+*/
+
+#pragma once
+
+#include "blitz11_io.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+
+inline std::vector<char> read_all(std::string const &fname)
+{
+    std::ifstream in(fname, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+inline void write_all(std::string const &fname, std::vector<char> const &bytes)
+{
+    std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+template<class T>
+void reverse(T &x)
+{
+    char *c = reinterpret_cast<char *>(&x);
+    std::reverse(c, c + sizeof(T));
+}
+
+/** Rewrites a saved file as if by a machine of the opposite byte
+order; data elements are made of components of comp_size bytes */
+inline void make_foreign(std::string const &fname, size_t const comp_size)
+{
+    std::vector<char> bytes(read_all(fname));
+    BlockFileHeader h;
+    std::memcpy(&h, &bytes[0], sizeof(h));
+    uint64_t const data_offset = h.data_offset, data_bytes = h.data_bytes;
+    uint32_t const rank = h.rank;
+
+    reverse(h.byte_order); reverse(h.version); reverse(h.dtype_size); reverse(h.rank);
+    reverse(h.data_offset); reverse(h.data_bytes); reverse(h.origin_bytes);
+    std::memcpy(&bytes[0], &h, sizeof(h));
+
+    for (size_t i=0; i<3*rank; ++i)
+        std::reverse(&bytes[sizeof(h) + 8*i], &bytes[sizeof(h) + 8*i + 8]);
+    for (size_t i=0; i<data_bytes; i += comp_size)
+        std::reverse(&bytes[data_offset + i], &bytes[data_offset + i + comp_size]);
+    write_all(fname, bytes);
+}
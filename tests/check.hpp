@@ -0,0 +1,67 @@
+/**
+Minimal checking for the blitz11 tests: each test is a program that
+runs its CHECKs, reports failures on stderr and returns non-zero if
+any failed (see check_exit()).
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace check_detail {
+
+inline int &nfailed()
+{
+    static int n = 0;
+    return n;
+}
+
+inline void fail(char const *file, int line, std::string const &what)
+{
+    std::cerr << file << ":" << line << ": CHECK failed: " << what << std::endl;
+    ++nfailed();
+}
+
+}    // namespace check_detail
+
+#define CHECK(cond) \
+    do { if (!(cond)) check_detail::fail(__FILE__, __LINE__, #cond); } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { if (!((a) == (b))) check_detail::fail(__FILE__, __LINE__, \
+        std::string(#a " == " #b ": ") + std::to_string(a) + " vs " + std::to_string(b)); } while (0)
+
+#define CHECK_NEAR(a, b, tol) \
+    do { if (!(std::abs((a) - (b)) <= (tol))) check_detail::fail(__FILE__, __LINE__, \
+        std::string(#a " ~= " #b ": ") + std::to_string(a) + " vs " + std::to_string(b)); } while (0)
+
+#define CHECK_THROWS(ExcT, expr) \
+    do { \
+        bool thrown_ = false; \
+        try { expr; } catch (ExcT const &) { thrown_ = true; } \
+        if (!thrown_) check_detail::fail(__FILE__, __LINE__, "no " #ExcT " from " #expr); \
+    } while (0)
+
+/** Returns the exit status for main() */
+inline int check_exit()
+{
+    if (check_detail::nfailed()) std::cerr << check_detail::nfailed() << " check(s) failed" << std::endl;
+    return check_detail::nfailed() ? 1 : 0;
+}
+
+/** A fresh file name in a per-process scratch directory */
+inline std::string scratch_file(std::string const &name)
+{
+    static std::string dir;
+    if (dir.empty()) {
+        char tmpl[] = "/tmp/blitz11_test_XXXXXX";
+        if (!::mkdtemp(tmpl)) { std::perror("mkdtemp"); std::exit(2); }
+        dir = tmpl;
+    }
+    return dir + "/" + name;
+}
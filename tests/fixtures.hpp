@@ -0,0 +1,78 @@
+/**
+Array fixtures for the blitz11 tests: arrays over arbitrary index
+boxes in several memory layouts, filled with position-dependent values,
+and a plain loop over every index of a box to compare against.
+*/
+
+#pragma once
+
+#include "blitz11.hpp"
+
+#include <vector>
+
+
+enum class Layout {
+    ROW,         // C order
+    COLUMN,      // Fortran order
+    REVERSED     // C order with every stride negated
+};
+
+Layout const all_layouts[] = {Layout::ROW, Layout::COLUMN, Layout::REVERSED};
+
+inline char const *layout_name(Layout const layout)
+{
+    return layout == Layout::ROW ? "row" : layout == Layout::COLUMN ? "column" : "reversed";
+}
+
+/** Calls fn(ix) for every index in [low, high), last dimension fastest */
+template<int RANK, class FnT>
+void for_each_index(int const *low, int const *high, FnT const &fn)
+{
+    for (int k=0; k<RANK; ++k) if (high[k] <= low[k]) return;
+    int ix[RANK > 0 ? RANK : 1];
+    for (int k=0; k<RANK; ++k) ix[k] = low[k];
+    for (;;) {
+        fn(static_cast<int const *>(ix));
+        int k = RANK-1;
+        for (; k >= 0; --k) {
+            if (++ix[k] < high[k]) break;
+            ix[k] = low[k];
+        }
+        if (k < 0) break;
+    }
+}
+
+/** A distinct, exactly representable value for each index */
+template<class T, int RANK>
+T pattern(int const *ix)
+{
+    long v = 0;
+    for (int k=0; k<RANK; ++k) v = v*37 + ix[k];
+    return T(v % 1009) / T(4);
+}
+
+/** Uninitialized array over [low, high) in the given layout */
+template<class T, int RANK>
+Array<T, RANK> make_array(int const *low, int const *high, Layout const layout)
+{
+    std::vector<Dope<int>> dopes(row_major_dopes(low, high, RANK));
+    if (layout == Layout::COLUMN) {
+        ptrdiff_t stride = 1;
+        for (int k=0; k<RANK; ++k) {
+            dopes[k].stride = stride;
+            stride *= std::max(0, high[k] - low[k]);
+        }
+    } else if (layout == Layout::REVERSED) {
+        for (int k=0; k<RANK; ++k) dopes[k].stride = -dopes[k].stride;
+    }
+    return Array<T, RANK>(allocate_block<T>(&dopes[0], RANK), dopes);
+}
+
+/** make_array() filled with pattern() */
+template<class T, int RANK>
+Array<T, RANK> make_pattern(int const *low, int const *high, Layout const layout)
+{
+    Array<T, RANK> arr(make_array<T, RANK>(low, high, layout));
+    for_each_index<RANK>(low, high, [&arr](int const *ix) { arr(ix) = pattern<T, RANK>(ix); });
+    return arr;
+}
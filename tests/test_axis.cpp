@@ -0,0 +1,143 @@
+// Axis-wise reductions and scans vs plain loops along the axis, in
+// every layout, serial and threaded
+
+#include "blitz11_ops.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Checks reduce_axis(arr, axis, init, op) against folding op along
+the axis in index order */
+template<int RANK, class AccT, class OpT>
+void check_reduce(Array<double, RANK> const &arr, int const *low, int const *high,
+    int const axis, AccT const &init, OpT const &op, int const nthreads)
+{
+    Array<AccT, RANK-1> const ret(reduce_axis(arr, axis, init, op, nthreads));
+    int rlow[RANK-1], rhigh[RANK-1];
+    for (int k=0, r=0; k<RANK; ++k) if (k != axis) { rlow[r] = low[k]; rhigh[r++] = high[k]; }
+
+    int nbad = 0;
+    for_each_index<RANK-1>(rlow, rhigh, [&](int const *rix) {
+        int ix[RANK];
+        for (int k=0, r=0; k<RANK; ++k) if (k != axis) ix[k] = rix[r++];
+        AccT acc(init);
+        for (ix[axis]=low[axis]; ix[axis]<high[axis]; ++ix[axis]) acc = op(acc, arr(ix));
+        nbad += !(ret(rix) == acc);
+    });
+    CHECK_EQ(nbad, 0);
+}
+
+/** Checks scan_axis(arr, axis, init, op) likewise */
+template<int RANK, class OpT>
+void check_scan(Array<double, RANK> const &arr, int const *low, int const *high,
+    int const axis, double const init, OpT const &op, int const nthreads)
+{
+    Array<double, RANK> const ret(scan_axis(arr, axis, init, op, nthreads));
+    int nbad = 0;
+    for_each_index<RANK>(low, high, [&](int const *ix) {
+        int jx[RANK];
+        std::copy(ix, ix + RANK, jx);
+        double acc = init;
+        for (jx[axis]=low[axis]; jx[axis]<=ix[axis]; ++jx[axis]) acc = op(acc, arr(jx));
+        nbad += !(ret(ix) == acc);
+    });
+    CHECK_EQ(nbad, 0);
+}
+
+void test_folds()
+{
+    typedef ops_detail::Plus<double> Plus;
+    auto const sum_sq2 = [](double acc, double x) { return acc + 2*x*x; };
+    auto const count = [](int acc, double x) { return acc + (x > 100); };
+    auto const decay = [](double acc, double x) { return acc/2 + x; };    // Order matters
+
+    // Every axis long enough for the unrolled path, and a short one
+    int const low[3] = {-1, 0, 2}, high[3] = {9, 3, 13};
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const arr(make_pattern<double, 3>(low, high, layout));
+        for (int axis=0; axis<3; ++axis) {
+            for (int const nthreads : {0, 1, 3}) {
+                check_reduce<3>(arr, low, high, axis, 10.0, Plus(), nthreads);
+                check_reduce<3>(arr, low, high, axis, -1e9, ops_detail::Max<double>(), nthreads);
+                check_reduce<3>(arr, low, high, axis, 0.0, sum_sq2, nthreads);
+                check_reduce<3>(arr, low, high, axis, 7, count, nthreads);
+                check_reduce<3>(arr, low, high, axis, 1.0, decay, nthreads);
+                check_scan<3>(arr, low, high, axis, 10.0, Plus(), nthreads);
+                check_scan<3>(arr, low, high, axis, 1.0, decay, nthreads);
+            }
+        }
+    }
+
+    // A 3x8 array of ones: same results along either axis, any layout
+    int const l2[2] = {0, 0}, h2[2] = {3, 8};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const ones(make_array<double, 2>(l2, h2, layout));
+        fill(ones, 1.0);
+        int const i0[1] = {0};
+        CHECK_EQ(reduce_axis(ones, 1, 10.0, Plus())(i0), 18.0);
+        CHECK_EQ(reduce_axis(ones, 1, 0.0, sum_sq2)(i0), 16.0);
+        CHECK_EQ(reduce_axis(ones, 1, 0, [](int acc, double x) { return acc + (x > 0.5); })(i0), 8);
+        CHECK_EQ(reduce_axis(ones, 0, 10.0, Plus())(i0), 13.0);
+    }
+}
+
+void test_named()
+{
+    int const low[3] = {-1, 0, 2}, high[3] = {9, 3, 13};
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const arr(make_pattern<double, 3>(low, high, layout));
+        for (int axis=0; axis<3; ++axis) {
+            Array<double, 2> const s(sum_axis(arr, axis, 2)), mean(mean_axis(arr, axis, 1));
+            Array<double, 2> const mn(min_axis(arr, axis, 1)), mx(max_axis(arr, axis, 2));
+            Array<double, 3> const cs(cumsum_axis(arr, axis));
+
+            int nbad = 0;
+            int rlow[2], rhigh[2];
+            for (int k=0, r=0; k<3; ++k) if (k != axis) { rlow[r] = low[k]; rhigh[r++] = high[k]; }
+            for_each_index<2>(rlow, rhigh, [&](int const *rix) {
+                int ix[3];
+                for (int k=0, r=0; k<3; ++k) if (k != axis) ix[k] = rix[r++];
+                double tot = 0, lo = 1e300, hi = -1e300;
+                for (ix[axis]=low[axis]; ix[axis]<high[axis]; ++ix[axis]) {
+                    tot += arr(ix);
+                    lo = std::min(lo, arr(ix));
+                    hi = std::max(hi, arr(ix));
+                    nbad += !(cs(ix) == tot);
+                }
+                nbad += !(s(rix) == tot) + !(mn(rix) == lo) + !(mx(rix) == hi);
+                nbad += !(std::abs(mean(rix) - tot / (high[axis] - low[axis])) <= 1e-12 * std::abs(tot));
+            });
+            CHECK_EQ(nbad, 0);
+        }
+    }
+}
+
+void test_edge_cases()
+{
+    int const low[2] = {0, 0}, high[2] = {4, 0};
+    Array<int, 2> const empty(make_array<int, 2>(low, high, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, mean_axis(empty, 1));
+    CHECK_EQ(sum_axis(empty, 1).dopes()[0].range[1], 4);
+    int const i0[1] = {0};
+    CHECK_EQ(sum_axis(empty, 1)(i0), 0);
+    int const h2[2] = {0, 3};    // Nothing to average over, but the axis is not empty
+    CHECK_EQ(mean_axis(make_array<int, 2>(low, h2, Layout::ROW), 1).dopes()[0].range[1], 0);
+
+    Array<double, 2> const arr(make_pattern<double, 2>(low, high, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, sum_axis(arr, 2));
+    CHECK_THROWS(std::invalid_argument, mean_axis(arr, -1));
+    CHECK_THROWS(std::invalid_argument, cumsum_axis(arr, 2));
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_folds();
+    test_named();
+    test_edge_cases();
+    return check_exit();
+}
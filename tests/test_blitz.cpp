@@ -0,0 +1,86 @@
+// Blitz++ adapters: to_blitz / from_blitz with non-zero bases, negative
+// strides and column-major storage.  Built where Blitz++ is found.
+
+#include "blitz11_blitz.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Number of indices in [low, high) at which b and arr are not the same
+element (both are indexed the same) */
+template<class BlitzT, class ValueT>
+int nbad(BlitzT &b, Array<ValueT, 2> const &arr, int const *low, int const *high)
+{
+    CHECK_EQ(b.lbound(0), low[0]);
+    CHECK_EQ(b.lbound(1), low[1]);
+    CHECK_EQ(b.ubound(0), high[0] - 1);
+    CHECK_EQ(b.ubound(1), high[1] - 1);
+    int n = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { n += (&b(ix[0], ix[1]) != &arr(ix)); });
+    return n;
+}
+
+void test_to_blitz()
+{
+    int const low[2] = {-2, 3}, high[2] = {4, 8};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const arr(make_pattern<double, 2>(low, high, layout));
+        blitz::Array<double, 2> b(to_blitz(arr));
+        CHECK_EQ(nbad(b, arr, low, high), 0);
+
+        double expect = 0;
+        for_each_index<2>(low, high, [&](int const *ix) { expect += arr(ix); });
+        CHECK_EQ(blitz::sum(b), expect);
+
+        // Round trip keeps bases and strides
+        Array<double, 2> const back(from_blitz(b));
+        int n = 0;
+        for_each_index<2>(low, high, [&](int const *ix) { n += (&back(ix) != &arr(ix)); });
+        CHECK_EQ(n, 0);
+        CHECK(back.dopes()[0].stride == arr.dopes()[0].stride);
+        CHECK(back.dopes()[1].stride == arr.dopes()[1].stride);
+    }
+}
+
+void test_from_blitz()
+{
+    // Row-major with bases
+    blitz::Array<double, 2> b(blitz::Range(1, 4), blitz::Range(-2, 3));
+    for (int i=1; i<=4; ++i)
+        for (int j=-2; j<=3; ++j) b(i, j) = 10*i + j;
+    int const low[2] = {1, -2}, high[2] = {5, 4};
+    Array<double, 2> const a(from_blitz(b));
+    CHECK_EQ(nbad(b, a, low, high), 0);
+    CHECK_EQ(a.memory().size_bytes(), 24*sizeof(double));
+
+    // Negative stride
+    b.reverseSelf(1);
+    Array<double, 2> const r(from_blitz(b));
+    CHECK(r.dopes()[1].stride < 0);
+    CHECK_EQ(nbad(b, r, low, high), 0);
+
+    // Read-only
+    blitz::Array<double, 2> const &cb(b);
+    Array<double const, 2> const ca(from_blitz(cb));
+    CHECK_EQ(nbad(b, ca, low, high), 0);
+
+    // Column-major, 1-based
+    blitz::Array<double, 2> f(3, 5, blitz::fortranArray);
+    f = 1.5;
+    int const flow[2] = {1, 1}, fhigh[2] = {4, 6};
+    Array<double, 2> const fa(from_blitz(f));
+    CHECK(fa.dopes()[0].stride == 1 && fa.dopes()[1].stride == 3);
+    CHECK_EQ(nbad(f, fa, flow, fhigh), 0);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_to_blitz();
+    test_from_blitz();
+    return check_exit();
+}
@@ -0,0 +1,151 @@
+// Broadcast views: axis alignment, explicit mappings, extent-1
+// expansion, invalid mappings, and kernels with stride-0 operands
+
+#include "blitz11_ops.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** view(ix) is the same object as src(sx(ix)) everywhere in [low, high) */
+template<int OUT_RANK, int RANK, class SxT>
+int nbad(Array<double, OUT_RANK> const &view, Array<double, RANK> const &src,
+    int const *low, int const *high, SxT const &sx)
+{
+    int n = 0;
+    for_each_index<OUT_RANK>(low, high, [&](int const *ix) {
+        int s[RANK];
+        sx(ix, s);
+        n += (&view(ix) != &src(s));
+    });
+    return n;
+}
+
+void test_trailing()
+{
+    int const slow[1] = {-2}, shigh[1] = {3};
+    int const low[3] = {0, 1, 10}, high[3] = {2, 4, 15};
+    for (Layout const layout : all_layouts) {
+        Array<double, 1> const src(make_pattern<double, 1>(slow, shigh, layout));
+        Array<double, 3> const view(broadcast<3>(src, low, high));
+        CHECK(view.dopes()[0].stride == 0 && view.dopes()[1].stride == 0);
+        CHECK(view.dopes()[2].stride == src.dopes()[0].stride);
+        // View index low[2] maps to the source's lower bound
+        CHECK_EQ(nbad(view, src, low, high, [&](int const *ix, int *s) { s[0] = ix[2] - low[2] + slow[0]; }), 0);
+    }
+
+    // GeneralArray
+    Array<double, 1> const src(make_pattern<double, 1>(slow, shigh, Layout::ROW));
+    GeneralArray<double> const g(broadcast(GeneralArray<double>(src), low, high, 3));
+    CHECK_EQ(g.rank(), 3);
+    CHECK_EQ(nbad(Array<double, 3>(g), src, low, high, [&](int const *ix, int *s) { s[0] = ix[2] - low[2] + slow[0]; }), 0);
+}
+
+void test_axes()
+{
+    // Source dims (a, b) become view dims (2, 0); view dim 1 is new
+    int const slow[2] = {1, 0}, shigh[2] = {4, 5};
+    int const low[3] = {0, -1, 0}, high[3] = {5, 6, 3};
+    int const axes[2] = {2, 0};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const src(make_pattern<double, 2>(slow, shigh, layout));
+        Array<double, 3> const view(broadcast<3>(src, low, high, axes));
+        CHECK(view.dopes()[1].stride == 0);
+        CHECK_EQ(nbad(view, src, low, high, [&](int const *ix, int *s) {
+            s[0] = ix[2] - low[2] + slow[0];
+            s[1] = ix[0] - low[0] + slow[1];
+        }), 0);
+    }
+}
+
+void test_extent_one()
+{
+    // A 1xN row and an Mx1 column, each expanded to MxN
+    int const rlow[2] = {7, 0}, rhigh[2] = {8, 4};
+    int const clow[2] = {0, -3}, chigh[2] = {3, -2};
+    int const low[2] = {0, 0}, high[2] = {3, 4};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const row(make_pattern<double, 2>(rlow, rhigh, layout));
+        Array<double, 2> const col(make_pattern<double, 2>(clow, chigh, layout));
+        Array<double, 2> const rv(broadcast<2>(row, low, high));
+        Array<double, 2> const cv(broadcast<2>(col, low, high));
+        CHECK(rv.dopes()[0].stride == 0 && cv.dopes()[1].stride == 0);
+        CHECK_EQ(nbad(rv, row, low, high, [](int const *ix, int *s) { s[0] = 7; s[1] = ix[1]; }), 0);
+        CHECK_EQ(nbad(cv, col, low, high, [](int const *ix, int *s) { s[0] = ix[0]; s[1] = -3; }), 0);
+    }
+}
+
+void test_invalid()
+{
+    int const slow[2] = {0, 0}, shigh[2] = {3, 4};
+    Array<double, 2> const src(make_pattern<double, 2>(slow, shigh, Layout::ROW));
+    int const low[2] = {0, 0}, high[2] = {3, 5};
+    int const low3[3] = {0, 0, 0}, high3[3] = {3, 4, 2};
+    int const out[2] = {0, 3}, dup[2] = {1, 1}, neg[2] = {-1, 0}, ok[2] = {0, 1};
+
+    CHECK_THROWS(std::invalid_argument, broadcast<2>(src, low, high));               // 4 vs 5
+    CHECK_THROWS(std::invalid_argument, broadcast<3>(src, low3, high3));             // Trailing: 3 vs 4
+    CHECK_THROWS(std::invalid_argument, broadcast<3>(src, low3, high3, out));
+    CHECK_THROWS(std::invalid_argument, broadcast<3>(src, low3, high3, dup));
+    CHECK_THROWS(std::invalid_argument, broadcast<3>(src, low3, high3, neg));
+    CHECK_THROWS(std::invalid_argument, broadcast<1>(src, low, high));              // Lower rank
+    broadcast<3>(src, low3, high3, ok);
+}
+
+/** copy() and transform() with stride-0 operands vs plain loops */
+void test_kernels()
+{
+    int const low[2] = {-1, 2}, high[2] = {6, 11};
+    int const rlow[1] = {0}, rhigh[1] = {9};
+    int const clow[2] = {0, 0}, chigh[2] = {7, 1};
+    for (Layout const dl : all_layouts) {
+        Array<double, 1> const row(make_pattern<double, 1>(rlow, rhigh, dl));
+        Array<double, 2> const col(make_pattern<double, 2>(clow, chigh, dl));
+        Array<double, 2> const rv(broadcast<2>(row, low, high));
+        Array<double, 2> const cv(broadcast<2>(col, low, high));
+        Array<double, 2> const a(make_pattern<double, 2>(low, high, dl));
+        auto const r = [&](int const *ix) { int j = ix[1] - low[1]; return row(&j); };
+        auto const c = [&](int const *ix) { int const s[2] = {ix[0] - low[0], 0}; return col(s); };
+
+        for (Layout const layout : all_layouts) {
+            Array<double, 2> const dst(make_array<double, 2>(low, high, layout));
+            int n = 0;
+
+            copy(dst, rv);
+            for_each_index<2>(low, high, [&](int const *ix) { n += !(dst(ix) == r(ix)); });
+            CHECK_EQ(n, 0);
+
+            transform(dst, cv, [](double x) { return 3*x; });
+            n = 0;
+            for_each_index<2>(low, high, [&](int const *ix) { n += !(dst(ix) == 3*c(ix)); });
+            CHECK_EQ(n, 0);
+
+            transform(dst, a, rv, [](double x, double y) { return x - y; });
+            n = 0;
+            for_each_index<2>(low, high, [&](int const *ix) { n += !(dst(ix) == a(ix) - r(ix)); });
+            CHECK_EQ(n, 0);
+
+            transform(dst, rv, cv, [](double x, double y) { return x * y; });
+            n = 0;
+            for_each_index<2>(low, high, [&](int const *ix) { n += !(dst(ix) == r(ix) * c(ix)); });
+            CHECK_EQ(n, 0);
+        }
+        double expect = 0;
+        for_each_index<2>(low, high, [&](int const *ix) { expect += r(ix); });
+        CHECK_EQ(sum(rv), expect);
+    }
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_trailing();
+    test_axes();
+    test_extent_one();
+    test_invalid();
+    test_kernels();
+    return check_exit();
+}
@@ -0,0 +1,132 @@
+// Asynchronous checkpoints: round trips, atomic replacement, cleanup on error
+
+#include "blitz11_io.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include <dirent.h>
+
+
+namespace {
+
+/** Names in the directory of scratch_file() that contain part */
+int count_files(std::string const &part)
+{
+    std::string const path(scratch_file(""));
+    DIR * const dir = ::opendir(path.c_str());
+    int n = 0;
+    for (struct dirent *e; (e = ::readdir(dir)); )
+        n += (std::string(e->d_name).find(part) != std::string::npos);
+    ::closedir(dir);
+    return n;
+}
+
+template<class ArrayT>
+int mismatches(ArrayT const &arr, Array<double, 2> const &ref, int const *low, int const *high)
+{
+    int nbad = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { nbad += !(arr(ix) == ref(ix)); });
+    return nbad;
+}
+
+void test_save_async()
+{
+    int const low[2] = {-1, 3}, high[2] = {40, 70};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const ref(make_pattern<double, 2>(low, high, layout));
+        std::string const fname(scratch_file("async.b11"));
+        std::future<void> done(save_async(fname, ref));
+        done.get();
+        CHECK_EQ(mismatches(Array<double, 2>(load<double>(fname)), ref, low, high), 0);
+    }
+    CHECK_EQ(count_files(".tmp"), 0);
+}
+
+void test_writer()
+{
+    int const low[2] = {0, 0}, high[2] = {64, 33};
+    Array<double, 2> arr(make_pattern<double, 2>(low, high, Layout::ROW));
+    std::string const fname(scratch_file("ckpt.b11"));
+    {
+        CheckpointWriter writer(2);
+        for (int step=0; step<6; ++step) {
+            int const ix[2] = {0, 0};
+            arr(ix) = step;
+            writer.save(fname, arr);                                      // Same name, overlapping
+            writer.save(scratch_file("ckpt" + std::to_string(step) + ".b11"), arr);
+        }
+        writer.wait_all();
+    }
+    int const ix[2] = {0, 0};
+    CHECK(load<double>(fname)(ix) == 5);
+    for (int step=0; step<6; ++step)
+        CHECK(load<double>(scratch_file("ckpt" + std::to_string(step) + ".b11"))(ix) == step);
+    CHECK_EQ(mismatches(Array<double, 2>(load<double>(fname)), arr, low, high), 0);
+    CHECK_EQ(count_files(".tmp"), 0);
+}
+
+/** Back-to-back checkpoints to one name, in different slots: the later
+(small, fast) one must not be overwritten by the earlier (large, slow) one */
+void test_same_name_order()
+{
+    std::string const fname(scratch_file("order.b11"));
+    int const low[1] = {0}, big[1] = {4 << 20}, small[1] = {10};
+    Array<double, 1> const a(make_array<double, 1>(low, big, Layout::ROW));
+    Array<double, 1> const b(make_pattern<double, 1>(low, small, Layout::ROW));
+    for (int rep=0; rep<3; ++rep) {
+        CheckpointWriter writer(2);
+        writer.save(fname, a);
+        writer.save(fname, b);
+        writer.wait_all();
+        CHECK_EQ(load<double>(fname).dopes()[0].range[1], 10);
+    }
+    CHECK_EQ(count_files(".tmp"), 0);
+}
+
+/** The target is replaced, not rewritten in place: a reader that has the
+old checkpoint mapped keeps seeing it whole */
+void test_replace_not_rewrite()
+{
+    int const low[1] = {0}, high[1] = {5000};
+    Array<double, 1> arr(make_pattern<double, 1>(low, high, Layout::ROW));
+    std::string const fname(scratch_file("replace.b11"));
+    save_async(fname, arr).get();
+    Array<double const, 1> const old(load<double const>(fname, LoadMode::MMAP_SHARED));
+
+    int const ix[1] = {4321};
+    double const v = arr(ix);
+    arr(ix) = -v;
+    save_async(fname, arr).get();
+    CHECK(old(ix) == v);
+    CHECK(load<double>(fname)(ix) == -v);
+}
+
+void test_failure_keeps_target()
+{
+    int const low[1] = {0}, high[1] = {1000};
+    Array<double, 1> const arr(make_pattern<double, 1>(low, high, Layout::ROW));
+
+    // rename() over a non-empty directory fails after the data is written
+    std::string const dir(scratch_file("target_dir"));
+    CHECK(::mkdir(dir.c_str(), 0755) == 0);
+    save(dir + "/keep.b11", arr);
+    CHECK_THROWS(std::runtime_error, save_async(dir, arr).get());
+    CHECK(load<double>(dir + "/keep.b11").dopes()[0].range[1] == 1000);
+    CHECK_EQ(count_files(".tmp"), 0);
+
+    // Unwritable location
+    CHECK_THROWS(std::runtime_error, save_async(scratch_file("no/such/dir.b11"), arr).get());
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_save_async();
+    test_writer();
+    test_same_name_order();
+    test_replace_not_rewrite();
+    test_failure_keeps_target();
+    return check_exit();
+}
@@ -0,0 +1,120 @@
+// Chunked compressed storage: whole and partial round trips, damaged files
+
+#include "blitz11_chunked.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+#include "blockfile_util.hpp"
+
+
+namespace {
+
+std::vector<ChunkCodec> codecs()
+{
+    std::vector<ChunkCodec> ret;
+    for (ChunkCodec const c : {ChunkCodec::NONE, ChunkCodec::ZSTD, ChunkCodec::LZ4})
+        if (codec_available(c)) ret.push_back(c);
+    return ret;
+}
+
+void test_round_trip()
+{
+    int const low[3] = {-3, 0, 2}, high[3] = {6, 7, 13};
+    std::string const fname(scratch_file("c.b11c"));
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const ref(make_pattern<double, 3>(low, high, layout));
+        for (ChunkCodec const codec : codecs()) {
+            for (bool const shuffle : {false, true}) {
+                ChunkOptions opt;
+                opt.codec = codec;
+                opt.shuffle = shuffle;
+                opt.nthreads = 3;
+                save_chunked(fname, ref, std::vector<int>{4, 3, 5}, opt);
+
+                Array<double, 3> const all(load_chunked<double>(fname, 2));
+                CHECK(all.dopes()[0].range == ref.dopes()[0].range);
+                int nbad = 0;
+                for_each_index<3>(low, high, [&](int const *ix) { nbad += !(all(ix) == ref(ix)); });
+                CHECK_EQ(nbad, 0);
+
+                // A slab cutting through chunks
+                std::vector<int> const slo{0, 2, 5}, shi{5, 3, 12};
+                Array<double, 3> const part(load_chunked<double>(fname, slo, shi, 1));
+                nbad = 0;
+                for_each_index<3>(&slo[0], &shi[0], [&](int const *ix) { nbad += !(part(ix) == ref(ix)); });
+                CHECK_EQ(nbad, 0);
+            }
+        }
+    }
+
+    // Slab outside the stored box
+    CHECK_THROWS(std::exception, (load_chunked<double>(fname, std::vector<int>{-4, 0, 2}, std::vector<int>{0, 1, 3})));
+    CHECK_THROWS(std::runtime_error, load_chunked<float>(fname));
+}
+
+void test_damaged()
+{
+    int const low[2] = {0, -2}, high[2] = {10, 9};
+    Array<double, 2> const ref(make_pattern<double, 2>(low, high, Layout::ROW));
+    std::string const good(scratch_file("good.b11c"));
+    ChunkOptions opt;
+    opt.codec = ChunkCodec::NONE;
+    save_chunked(good, ref, std::vector<int>{4, 4}, opt);
+    std::vector<char> const bytes(read_all(good));
+    ChunkedFileHeader h0;
+    std::memcpy(&h0, &bytes[0], sizeof(h0));
+    CHECK_EQ(h0.nchunks, 9u);
+
+    std::string const fname(scratch_file("bad.b11c"));
+    auto const corrupt = [&](void (*edit)(ChunkedFileHeader &, ChunkedFileDim *, ChunkEntry *)) {
+        std::vector<char> b(bytes);
+        ChunkedFileHeader h;
+        std::memcpy(&h, &b[0], sizeof(h));
+        edit(h, reinterpret_cast<ChunkedFileDim *>(&b[sizeof(h)]),
+            reinterpret_cast<ChunkEntry *>(&b[h0.table_offset]));
+        std::memcpy(&b[0], &h, sizeof(h));
+        write_all(fname, b);
+        CHECK_THROWS(std::runtime_error, read_chunked_info(fname));
+        CHECK_THROWS(std::runtime_error, load_chunked<double>(fname));
+    };
+
+    // Header
+    corrupt([](ChunkedFileHeader &h, ChunkedFileDim *, ChunkEntry *) { h.rank = 1u << 30; });
+    corrupt([](ChunkedFileHeader &h, ChunkedFileDim *, ChunkEntry *) { h.nchunks = 8; });
+    corrupt([](ChunkedFileHeader &h, ChunkedFileDim *, ChunkEntry *) { h.nchunks = uint64_t(1) << 60; });
+    corrupt([](ChunkedFileHeader &h, ChunkedFileDim *, ChunkEntry *) { h.table_offset += 8; });
+    corrupt([](ChunkedFileHeader &h, ChunkedFileDim *, ChunkEntry *) { h.table_offset = ~uint64_t(0) - 4; });
+
+    // Dimensions
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *d, ChunkEntry *) { d[1].chunk = 0; });
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *d, ChunkEntry *) { d[0].chunk = -4; });
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *d, ChunkEntry *) { d[0].chunk = 3; });    // 4x3 grid
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *d, ChunkEntry *) { d[0].high = d[0].low - 1; });
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *d, ChunkEntry *) {
+        d[0].low = -(int64_t(1) << 62); d[0].high = int64_t(1) << 62; d[0].chunk = int64_t(1) << 62; });
+
+    // Chunk table
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *, ChunkEntry *t) { t[4].offset = 0; });
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *, ChunkEntry *t) { t[8].nbytes = uint64_t(1) << 40; });
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *, ChunkEntry *t) { t[2].offset = ~uint64_t(0) - 4; });
+    corrupt([](ChunkedFileHeader &, ChunkedFileDim *, ChunkEntry *t) { t[0].nbytes = 0; });
+
+    // Truncated table
+    write_all(fname, std::vector<char>(bytes.begin(), bytes.end() - 8));
+    CHECK_THROWS(std::runtime_error, read_chunked_info(fname));
+
+    // The untouched file still loads
+    Array<double, 2> const all(load_chunked<double>(good));
+    int nbad = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { nbad += !(all(ix) == ref(ix)); });
+    CHECK_EQ(nbad, 0);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_round_trip();
+    test_damaged();
+    return check_exit();
+}
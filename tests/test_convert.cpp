@@ -0,0 +1,76 @@
+// Conversions between Array<RANK> and GeneralArray: sharing, rank
+// checks, and dope storage reuse when converting from rvalues
+
+#include "blitz11.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include <utility>
+
+
+namespace {
+
+void test_lvalue()
+{
+    int const low[2] = {-1, 2}, high[2] = {4, 9};
+    Array<double, 2> const arr(make_pattern<double, 2>(low, high, Layout::REVERSED));
+
+    GeneralArray<double> const g(arr);
+    CHECK_EQ(g.rank(), 2);
+    CHECK(g.memory().base() == arr.memory().base());
+    CHECK(&g.dopes()[0] != &arr.dopes()[0]);    // Copied
+    int nbad = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { nbad += (&g(ix) != &arr(ix)); });
+    CHECK_EQ(nbad, 0);
+
+    Array<double, 2> const back(g);
+    CHECK(back.memory().base() == arr.memory().base());
+    CHECK(back.dopes()[1].stride == arr.dopes()[1].stride);
+    CHECK_EQ(g.rank(), 2);    // Source untouched
+
+    CHECK_THROWS(std::invalid_argument, (Array<double, 3>(g)));
+    CHECK_THROWS(std::invalid_argument, (Array<double, 1>(g)));
+}
+
+void test_rvalue()
+{
+    int const low[3] = {0, 0, 0}, high[3] = {2, 3, 4};
+    Array<double, 3> arr(make_pattern<double, 3>(low, high, Layout::COLUMN));
+    char * const base = arr.memory().base();
+    Dope<int> const * const dopes = &arr.dopes()[0];
+    size_t const nbytes = arr.memory().size_bytes();
+    int const ix[3] = {1, 2, 3};
+    double const v = arr(ix);
+
+    // Array -> GeneralArray takes over the dope storage
+    GeneralArray<double> g(std::move(arr));
+    CHECK(arr.dopes().empty());
+    CHECK(&g.dopes()[0] == dopes);
+    CHECK(g.memory().base() == base);
+    CHECK_EQ(g.memory().size_bytes(), nbytes);
+    CHECK(g(ix) == v);
+
+    // Rank mismatch: g is left unchanged
+    CHECK_THROWS(std::invalid_argument, (Array<double, 2>(std::move(g))));
+    CHECK_EQ(g.rank(), 3);
+    CHECK(&g.dopes()[0] == dopes);
+    CHECK(g.memory().base() == base);
+    CHECK(g(ix) == v);
+
+    // GeneralArray -> Array takes it back
+    Array<double, 3> back(std::move(g));
+    CHECK_EQ(g.rank(), 0);
+    CHECK(&back.dopes()[0] == dopes);
+    CHECK(back.memory().base() == base);
+    CHECK(back(ix) == v);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_lvalue();
+    test_rvalue();
+    return check_exit();
+}
@@ -0,0 +1,126 @@
+// Copy-on-write MemoryBlocks: when detach() clones, and what the clone keeps
+
+#include "blitz11.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include <cstring>
+
+
+namespace {
+
+void test_shared()
+{
+    MemoryBlock<char> a(64);
+    std::memset(a.data(), 'x', 64);
+    a.set_copy_on_write();
+    MemoryBlock<char> b(a);    // Inherits the flag
+    CHECK(b.copy_on_write());
+    CHECK(a.needs_detach() && b.needs_detach());
+
+    // Clones once
+    CHECK(a.detach());
+    CHECK(a.data() != b.data());
+    CHECK(a.copy_on_write());
+    CHECK_EQ(a.size_bytes(), 64u);
+    CHECK(std::memcmp(a.data(), b.data(), 64) == 0);
+    CHECK(!a.needs_detach());
+    CHECK(!a.detach());
+
+    // The remaining sharer is now the only owner
+    char * const bdata = b.data();
+    CHECK(!b.needs_detach());
+    CHECK(!b.detach());
+    CHECK(b.data() == bdata);
+
+    a.data()[0] = 'y';
+    CHECK(b.data()[0] == 'x');
+}
+
+void test_single_owner()
+{
+    MemoryBlock<char> a(16);
+    a.set_copy_on_write();
+    char * const data = a.data();
+    CHECK(!a.needs_detach());
+    CHECK(!a.detach());
+    CHECK(a.data() == data);
+
+    // Sharing without copy-on-write never clones
+    MemoryBlock<char> b(32);
+    MemoryBlock<char> const c(b);
+    CHECK(!b.needs_detach());
+    CHECK(!b.detach());
+    CHECK(b.data() == c.data());
+}
+
+void test_borrowed()
+{
+    char buf[32];
+    std::memset(buf, 'q', sizeof(buf));
+    MemoryBlock<char> a(buf, sizeof(buf));
+    a.set_copy_on_write();
+    CHECK(a.needs_detach());
+    CHECK(a.detach());
+    CHECK(a.data() != buf);
+    CHECK(std::memcmp(a.data(), buf, sizeof(buf)) == 0);
+    a.data()[0] = 'r';
+    CHECK(buf[0] == 'q');
+    CHECK(!a.detach());    // Now owned
+}
+
+/** The clone keeps the origin, so arrays with negative strides and
+non-zero bases index the same elements */
+void test_origin()
+{
+    int const low[2] = {-3, 2}, high[2] = {4, 8};
+    Array<double, 2> arr(make_pattern<double, 2>(low, high, Layout::REVERSED));
+    arr.set_copy_on_write();
+    Array<double, 2> const other(arr);
+    ptrdiff_t const origin = arr.memory().origin_bytes();
+    CHECK(origin != 0);
+
+    CHECK(arr.detach());
+    CHECK(arr.memory().base() != other.memory().base());
+    CHECK_EQ(arr.memory().origin_bytes(), origin);
+    int nbad = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { nbad += !(arr(ix) == pattern<double, 2>(ix)); });
+    CHECK_EQ(nbad, 0);
+
+    int const ix[2] = {0, 5};
+    arr(ix) = -1;
+    CHECK((other(ix) == pattern<double, 2>(ix)));
+}
+
+/** Several sharers: each clone happens once, and the last owner keeps
+the original */
+void test_many_sharers()
+{
+    int const low[1] = {0}, high[1] = {8};
+    std::vector<Dope<int>> const dopes(row_major_dopes(low, high, 1));
+    GeneralArray<double> g(allocate_block<double>(&dopes[0], 1), dopes);
+    g.set_copy_on_write();
+    GeneralArray<double> h(g), k(g);
+    char * const data = g.memory().data();
+
+    CHECK(g.detach());
+    CHECK(!g.detach());
+    CHECK(h.detach());    // Still shared with k
+    CHECK(!h.detach());
+    CHECK(!k.detach());   // Last owner of the original
+    CHECK(k.memory().data() == data);
+    CHECK(g.memory().data() != h.memory().data());
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_shared();
+    test_single_owner();
+    test_borrowed();
+    test_origin();
+    test_many_sharers();
+    return check_exit();
+}
@@ -0,0 +1,166 @@
+// DLPack export/import: element addressing with negative strides and
+// non-zero bases, ownership (deleters), and rejected tensors.  Built
+// only where <dlpack/dlpack.h> is available.
+
+#include "blitz11_dlpack.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Address of element j of a 2-D tensor */
+double *at(DLTensor const &t, int64_t const *j)
+{
+    char *p = static_cast<char *>(t.data) + t.byte_offset;
+    for (int k=0; k<t.ndim; ++k) p += j[k] * t.strides[k] * (int64_t)sizeof(double);
+    return reinterpret_cast<double *>(p);
+}
+
+void test_export()
+{
+    int const low[2] = {-2, 5}, high[2] = {4, 9};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const arr(make_pattern<double, 2>(low, high, layout));
+        DLManagedTensor * const tensor = to_dlpack(arr);
+        DLTensor const &t(tensor->dl_tensor);
+        CHECK_EQ(t.ndim, 2);
+        CHECK(t.device.device_type == kDLCPU);
+        CHECK(t.dtype.code == kDLFloat && t.dtype.bits == 64 && t.dtype.lanes == 1);
+        CHECK_EQ(t.shape[0], 6);
+        CHECK_EQ(t.shape[1], 4);
+        if (layout == Layout::REVERSED) CHECK(t.strides[0] < 0 && t.strides[1] < 0);
+
+        int n = 0;
+        for_each_index<2>(low, high, [&](int const *ix) {
+            int64_t const j[2] = {ix[0] - low[0], ix[1] - low[1]};
+            n += (at(t, j) != &arr(ix));
+        });
+        CHECK_EQ(n, 0);
+
+        // Round trip: same elements, indexed from 0
+        Array<double, 2> const back(from_dlpack<double, 2>(to_dlpack(arr)));
+        n = 0;
+        for_each_index<2>(low, high, [&](int const *ix) {
+            int const j[2] = {ix[0] - low[0], ix[1] - low[1]};
+            n += (&back(j) != &arr(ix));
+        });
+        CHECK_EQ(n, 0);
+        tensor->deleter(tensor);
+    }
+}
+
+/** The exported tensor keeps shared memory alive until its deleter runs */
+void test_export_lifetime()
+{
+    bool freed = false;
+    std::vector<double> buf(8);
+    {
+        std::shared_ptr<char> held(reinterpret_cast<char *>(buf.data()), [&freed](char *) { freed = true; });
+        int const low[1] = {0}, high[1] = {8};
+        DLManagedTensor *tensor;
+        {
+            Array<double, 1> const arr(MemoryBlock<char>(held, held.get(), 8*sizeof(double)),
+                row_major_dopes(low, high, 1));
+            held.reset();
+            tensor = to_dlpack(arr);
+        }
+        CHECK(!freed);
+        tensor->deleter(tensor);
+    }
+    CHECK(freed);
+}
+
+/** A DLManagedTensor over its own buffer, counting deleter calls */
+struct Owned {
+    static int ndeleted;
+    std::vector<double> buf;
+    std::vector<int64_t> shape, strides;
+    DLManagedTensor tensor;
+
+    Owned(int64_t const nrow, int64_t const ncol, bool const flip_rows)
+        : buf(nrow*ncol), shape{nrow, ncol}, strides{flip_rows ? -ncol : ncol, 1}
+    {
+        for (size_t i=0; i<buf.size(); ++i) buf[i] = i;
+        DLTensor &t(tensor.dl_tensor);
+        t.data = buf.data();
+        t.byte_offset = flip_rows ? (nrow-1)*ncol*sizeof(double) : 0;    // Row 0 is the last in memory
+        t.device.device_type = kDLCPU;
+        t.device.device_id = 0;
+        t.ndim = 2;
+        t.dtype = dlpack_dtype<double>::get();
+        t.shape = shape.data();
+        t.strides = strides.data();
+        tensor.manager_ctx = this;
+        tensor.deleter = [](DLManagedTensor *self) {
+            ++ndeleted;
+            delete static_cast<Owned *>(self->manager_ctx);
+        };
+    }
+};
+int Owned::ndeleted = 0;
+
+void test_import()
+{
+    for (bool const flip : {false, true}) {
+        Owned * const owned = new Owned(3, 4, flip);
+        std::vector<double> const expect(owned->buf);
+        int const before = Owned::ndeleted;
+        {
+            Array<double, 2> arr(from_dlpack<double, 2>(&owned->tensor));
+            Array<double, 2> const copy(arr);
+            int n = 0;
+            int ix[2];
+            for (ix[0]=0; ix[0]<3; ++ix[0])
+                for (ix[1]=0; ix[1]<4; ++ix[1])
+                    n += !(arr(ix) == expect[(flip ? 2-ix[0] : ix[0])*4 + ix[1]]);
+            CHECK_EQ(n, 0);
+
+            // The block spans exactly the tensor's elements
+            int const over[2] = {3, 0};
+            CHECK_THROWS(std::out_of_range, arr(over, throw_range_error()));
+            CHECK_EQ(arr.memory().size_bytes(), 12*sizeof(double));
+
+            arr = Array<double, 2>(copy);
+            CHECK_EQ(Owned::ndeleted, before);    // Still in use
+        }
+        CHECK_EQ(Owned::ndeleted, before + 1);    // Deleted exactly once
+    }
+
+    // Compact row-major tensors may leave strides NULL
+    Owned * const owned = new Owned(2, 5, false);
+    owned->tensor.dl_tensor.strides = nullptr;
+    GeneralArray<double> const g(from_dlpack<double>(&owned->tensor));
+    CHECK_EQ(g.rank(), 2);
+    CHECK(g.dopes()[0].stride == 5 && g.dopes()[1].stride == 1);
+    int const ix[2] = {1, 3};
+    CHECK(g(ix) == 8);
+}
+
+/** Rejected tensors are not consumed */
+void test_rejected()
+{
+    Owned * const owned = new Owned(2, 2, false);
+    int const before = Owned::ndeleted;
+    CHECK_THROWS(std::invalid_argument, (from_dlpack<float, 2>(&owned->tensor)));
+    CHECK_THROWS(std::invalid_argument, (from_dlpack<int64_t, 2>(&owned->tensor)));
+    CHECK_THROWS(std::invalid_argument, (from_dlpack<std::complex<float>, 2>(&owned->tensor)));
+    CHECK_THROWS(std::invalid_argument, (from_dlpack<double, 3>(&owned->tensor)));
+    owned->tensor.dl_tensor.device.device_type = kDLCUDA;
+    CHECK_THROWS(std::invalid_argument, (from_dlpack<double, 2>(&owned->tensor)));
+    CHECK_EQ(Owned::ndeleted, before);
+    owned->tensor.deleter(&owned->tensor);
+    CHECK_EQ(Owned::ndeleted, before + 1);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_export();
+    test_export_lifetime();
+    test_import();
+    test_rejected();
+    return check_exit();
+}
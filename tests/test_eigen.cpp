@@ -0,0 +1,119 @@
+// Eigen adapters: to_eigen / from_eigen in both storage orders, with
+// negative strides and through Blocks.  Built where Eigen is found.
+
+#include "blitz11_eigen.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Number of elements at which e (indexed from 0) and arr (indexed from
+low) are not the same object */
+template<class EigenT, class ValueT>
+int nbad(EigenT &e, Array<ValueT, 2> const &arr, int const *low, int const *high)
+{
+    CHECK_EQ(e.rows(), high[0] - low[0]);
+    CHECK_EQ(e.cols(), high[1] - low[1]);
+    int n = 0;
+    for_each_index<2>(low, high, [&](int const *ix) {
+        n += (&e.coeffRef(ix[0] - low[0], ix[1] - low[1]) != &arr(ix));
+    });
+    return n;
+}
+
+void test_to_eigen()
+{
+    int const low[2] = {-2, 3}, high[2] = {4, 8};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const arr(make_pattern<double, 2>(low, high, layout));
+        eigen_map<double>::matrix m(to_eigen(arr));
+        CHECK_EQ(nbad(m, arr, low, high), 0);
+
+        // Eigen arithmetic sees the Array's values
+        double expect = 0;
+        for_each_index<2>(low, high, [&](int const *ix) { expect += arr(ix); });
+        CHECK_EQ(m.sum(), expect);
+        m *= 2;
+        int const ix[2] = {1, 5};
+        CHECK((arr(ix) == 2*pattern<double, 2>(ix)));
+
+        // Read-only arrays give read-only maps
+        MemoryBlock<char const> const cmem(arr.memory().data(), arr.memory().size_bytes());
+        Array<double const, 2> const carr(cmem.rebased(arr.memory().origin_bytes()), arr.dopes());
+        eigen_map<double const>::matrix const cm(to_eigen(carr));
+        CHECK(cm.data() == &arr(low));
+        CHECK_EQ(cm.sum(), 2*expect);
+    }
+
+    // Rank 1, reversed
+    int const l1[1] = {5}, h1[1] = {12};
+    Array<double, 1> const v(make_pattern<double, 1>(l1, h1, Layout::REVERSED));
+    eigen_map<double>::vector const ev(to_eigen(v));
+    CHECK_EQ(ev.size(), 7);
+    int n = 0;
+    for (int i=l1[0]; i<h1[0]; ++i) n += (&ev(i - l1[0]) != &v(&i));
+    CHECK_EQ(n, 0);
+}
+
+template<int OPTIONS>
+void test_from_eigen()
+{
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, OPTIONS> M;
+    M m(5, 7);
+    for (int i=0; i<5; ++i)
+        for (int j=0; j<7; ++j) m(i, j) = 10*i + j;
+    int const low[2] = {0, 0}, high[2] = {5, 7};
+
+    Array<double, 2> const a(from_eigen(m));
+    CHECK_EQ(nbad(m, a, low, high), 0);
+    CHECK_EQ(a.memory().size_bytes(), 35*sizeof(double));
+
+    // Const matrices give read-only arrays
+    M const &cm(m);
+    Array<double const, 2> const ca(from_eigen(cm));
+    CHECK_EQ(nbad(m, ca, low, high), 0);
+
+    // A Block keeps its parent's strides
+    auto blk = m.block(1, 2, 3, 4);
+    Array<double, 2> const b(from_eigen(blk));
+    int const bhigh[2] = {3, 4};
+    CHECK_EQ(nbad(blk, b, low, bhigh), 0);
+    CHECK_EQ(b.memory().size_bytes(), (size_t)(&blk(2, 3) - &blk(0, 0) + 1) * sizeof(double));
+    Array<double const, 2> const tb(from_eigen(m.block(0, 1, 2, 2)));    // Temporary: read-only
+    CHECK(&tb(low) == &m(0, 1));
+}
+
+/** Negative strides survive to_eigen() -> from_eigen() */
+void test_round_trip()
+{
+    int const low[2] = {-2, 3}, high[2] = {4, 8};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const arr(make_pattern<double, 2>(low, high, layout));
+        eigen_map<double>::matrix m(to_eigen(arr));
+        int const zhigh[2] = {high[0] - low[0], high[1] - low[1]};
+        int const zero[2] = {0, 0};
+        Array<double, 2> const back(from_eigen(m));
+        CHECK_EQ(nbad(m, back, zero, zhigh), 0);
+        CHECK(back.dopes()[0].stride == arr.dopes()[0].stride);
+        CHECK(back.dopes()[1].stride == arr.dopes()[1].stride);
+        CHECK_EQ(back.memory().size_bytes(), arr.memory().size_bytes());
+
+        auto blk = m.block(1, 1, 3, 2);
+        Array<double, 2> const b(from_eigen(blk));
+        int const bhigh[2] = {3, 2};
+        CHECK_EQ(nbad(blk, b, zero, bhigh), 0);
+    }
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_to_eigen();
+    test_from_eigen<Eigen::ColMajor>();
+    test_from_eigen<Eigen::RowMajor>();
+    test_round_trip();
+    return check_exit();
+}
@@ -0,0 +1,168 @@
+// Block file save/load: all LoadModes, foreign byte order, damaged files
+
+#include "blitz11_io.hpp"
+#include "check.hpp"
+#include "blockfile_util.hpp"
+
+#include <complex>
+
+
+namespace {
+
+/** 4x5 array over [1,5)x[-2,3), optionally with a negative stride */
+template<class T>
+Array<T, 2> make(bool const flip)
+{
+    int const low[2] = {1, -2}, high[2] = {5, 3};
+    std::vector<Dope<int>> dopes(row_major_dopes(low, high, 2));
+    if (flip) dopes[1].stride = -dopes[1].stride;
+    Array<T, 2> arr(allocate_block<T>(&dopes[0], 2), dopes);
+    int ix[2];
+    for (ix[0]=1; ix[0]<5; ++ix[0])
+        for (ix[1]=-2; ix[1]<3; ++ix[1]) arr(ix) = T(10*ix[0] + ix[1]);
+    return arr;
+}
+
+template<class ArrayT, class T>
+bool same(ArrayT const &arr, Array<T, 2> const &ref)
+{
+    int ix[2];
+    for (ix[0]=1; ix[0]<5; ++ix[0])
+        for (ix[1]=-2; ix[1]<3; ++ix[1]) if (!(arr(ix) == ref(ix))) return false;
+    return true;
+}
+
+LoadMode const modes[] = {LoadMode::READ, LoadMode::MMAP_PRIVATE, LoadMode::MMAP_SHARED};
+
+void test_round_trip()
+{
+    for (bool const flip : {false, true}) {
+        Array<double, 2> const ref(make<double>(flip));
+        std::string const fname(scratch_file("rt.b11"));
+        save(fname, ref);
+        for (LoadMode const mode : modes) {
+            GeneralArray<double> const g(load<double>(fname, mode));
+            CHECK(g.dopes().size() == 2);
+            CHECK(same(Array<double, 2>(g), ref));
+            GeneralArray<double const> const c(load<double const>(fname, mode));
+            CHECK(same(Array<double const, 2>(c), ref));
+        }
+    }
+}
+
+void test_mmap_modes()
+{
+    Array<double, 2> const ref(make<double>(false));
+    std::string const fname(scratch_file("mm.b11"));
+    save(fname, ref);
+    int const ix[2] = {2, 0};
+    {
+        Array<double, 2> a(load<double>(fname, LoadMode::MMAP_PRIVATE));
+        a(ix) = -1;
+    }
+    CHECK(load<double>(fname)(ix) == 20);
+    {
+        Array<double, 2> a(load<double>(fname, LoadMode::MMAP_SHARED));
+        a(ix) = -1;
+    }
+    CHECK(load<double>(fname)(ix) == -1);
+}
+
+void test_foreign()
+{
+    {
+        Array<int32_t, 2> const ref(make<int32_t>(true));
+        std::string const fname(scratch_file("fi.b11"));
+        save(fname, ref);
+        make_foreign(fname, sizeof(int32_t));
+        CHECK(read_block_info(fname).swapped);
+        CHECK(same(Array<int32_t, 2>(load<int32_t>(fname)), ref));
+        CHECK_THROWS(std::runtime_error, load<int32_t>(fname, LoadMode::MMAP_PRIVATE));
+    }
+    {
+        typedef std::complex<double> C;
+        Array<C, 2> const ref(make<C>(false));
+        int ix[2];
+        for (ix[0]=1; ix[0]<5; ++ix[0])
+            for (ix[1]=-2; ix[1]<3; ++ix[1]) ref(ix) = C(ix[0], 0.5 + ix[1]);
+        std::string const fname(scratch_file("fc.b11"));
+        save(fname, ref);
+        make_foreign(fname, sizeof(double));
+        CHECK(same(Array<C, 2>(load<C>(fname)), ref));
+    }
+}
+
+void test_damaged()
+{
+    Array<double, 2> const ref(make<double>(false));
+    std::string const good(scratch_file("good.b11"));
+    save(good, ref);
+    std::vector<char> const bytes(read_all(good));
+    BlockFileHeader h0;
+    std::memcpy(&h0, &bytes[0], sizeof(h0));
+
+    // Truncated data section: every mode refuses, none SIGBUSes later
+    std::string const fname(scratch_file("bad.b11"));
+    write_all(fname, std::vector<char>(bytes.begin(), bytes.end() - 8));
+    for (LoadMode const mode : modes) CHECK_THROWS(std::runtime_error, load<double>(fname, mode));
+
+    // Header fields that must not be trusted
+    auto const corrupt = [&](void (*edit)(BlockFileHeader &, BlockFileDope *)) {
+        std::vector<char> b(bytes);
+        BlockFileHeader h;
+        std::memcpy(&h, &b[0], sizeof(h));
+        edit(h, reinterpret_cast<BlockFileDope *>(&b[sizeof(h)]));
+        std::memcpy(&b[0], &h, sizeof(h));
+        write_all(fname, b);
+        for (LoadMode const mode : modes) CHECK_THROWS(std::runtime_error, load<double>(fname, mode));
+    };
+    corrupt([](BlockFileHeader &h, BlockFileDope *) { h.rank = 1u << 30; });
+    corrupt([](BlockFileHeader &h, BlockFileDope *) { h.data_bytes += 4096; });
+    corrupt([](BlockFileHeader &, BlockFileDope *d) { d[0].high += 1; });
+    corrupt([](BlockFileHeader &, BlockFileDope *d) { d[1].stride = 1000; });
+    corrupt([](BlockFileHeader &h, BlockFileDope *) { h.origin_bytes -= 8; });
+    corrupt([](BlockFileHeader &, BlockFileDope *d) { d[0].low = -(int64_t(1) << 62); });
+
+    // Unknown version
+    corrupt([](BlockFileHeader &h, BlockFileDope *) { h.version = BLOCKFILE_VERSION + 1; });
+
+    // Wrong element type
+    CHECK_THROWS(std::runtime_error, load<float>(good));
+}
+
+/** Version 1 files predate origin_bytes: the field was reserved, and
+their origin is the start of the data */
+void test_version1()
+{
+    int const low[1] = {0}, high[1] = {6};
+    std::vector<Dope<int>> const dopes(row_major_dopes(low, high, 1));
+    Array<double, 1> const ref(allocate_block<double>(&dopes[0], 1), dopes);
+    for (int i=0; i<6; ++i) ref(&i) = 1.5*i;
+    std::string const fname(scratch_file("v1.b11"));
+    save(fname, ref);
+
+    std::vector<char> b(read_all(fname));
+    BlockFileHeader h;
+    std::memcpy(&h, &b[0], sizeof(h));
+    h.version = 1;
+    h.origin_bytes = 0x5a5a;    // Ignored
+    std::memcpy(&b[0], &h, sizeof(h));
+    write_all(fname, b);
+
+    CHECK_EQ(read_block_info(fname).header.origin_bytes, 0);
+    Array<double, 1> const a(load<double>(fname));
+    for (int i=0; i<6; ++i) CHECK(a(&i) == 1.5*i);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_round_trip();
+    test_mmap_modes();
+    test_foreign();
+    test_damaged();
+    test_version1();
+    return check_exit();
+}
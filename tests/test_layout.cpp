@@ -0,0 +1,217 @@
+// Tiled and Morton layouts: indexing, tile views, codes and round trips
+// vs strided arrays, including padded edge tiles and non-power-of-two
+// boxes.  Also built with -mbmi2 (test_layout_bmi2) for the pdep/pext path.
+
+#include "blitz11_layout.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Number of indices at which arr(ix) != ref(ix) */
+template<int RANK, class ArrayT, class RefT>
+int nbad(int const *low, int const *high, ArrayT const &arr, RefT const &ref)
+{
+    int n = 0;
+    for_each_index<RANK>(low, high, [&](int const *ix) { n += !(arr(ix) == ref(ix)); });
+    return n;
+}
+
+template<int RANK>
+void test_tiled(int const *low, int const *high, int const *tile)
+{
+    for (Layout const layout : all_layouts) {
+        Array<double, RANK> const ref(make_pattern<double, RANK>(low, high, layout));
+        TiledArray<double, RANK> const tiled(to_tiled(ref, tile));
+        CHECK_EQ(nbad<RANK>(low, high, tiled, ref), 0);
+
+        // Memory includes the padding of the edge tiles
+        size_t padded = 1;
+        for (int k=0; k<RANK; ++k) {
+            CHECK_EQ(tiled.ntiles(k), (high[k] - low[k] + tile[k] - 1) / tile[k]);
+            padded *= tiled.ntiles(k) * tile[k];
+        }
+        CHECK_EQ(tiled.memory().size_bytes(), padded * sizeof(double));
+
+        Array<double, RANK> const back(to_strided(tiled));
+        CHECK_EQ(nbad<RANK>(low, high, back, ref), 0);
+
+        // copy() back into an existing array of another layout
+        Array<double, RANK> const dst(make_array<double, RANK>(low, high,
+            layout == Layout::ROW ? Layout::COLUMN : Layout::ROW));
+        copy(dst, tiled);
+        CHECK_EQ(nbad<RANK>(low, high, dst, ref), 0);
+    }
+
+    // Tile views cover the index box exactly once, clipped at the edges,
+    // and alias the tiled memory
+    Array<double, RANK> const ref(make_pattern<double, RANK>(low, high, Layout::ROW));
+    TiledArray<double, RANK> const tiled(to_tiled(ref, tile));
+    size_t nseen = 0, nexpect = 1;
+    for (int k=0; k<RANK; ++k) nexpect *= high[k] - low[k];
+    tiled.for_each_tile([&](Array<double, RANK> const &t) {
+        int tlow[RANK], thigh[RANK];
+        for (int k=0; k<RANK; ++k) {
+            tlow[k] = t.dopes()[k].range[0];
+            thigh[k] = t.dopes()[k].range[1];
+            CHECK(tlow[k] >= low[k] && thigh[k] <= high[k]);
+            CHECK(thigh[k] - tlow[k] <= tile[k]);
+            CHECK(thigh[k] == high[k] || thigh[k] - tlow[k] == tile[k]);
+        }
+        for_each_index<RANK>(tlow, thigh, [&](int const *ix) {
+            ++nseen;
+            CHECK(&t(ix) == &tiled(ix));
+            CHECK(t(ix) == ref(ix));
+        });
+    });
+    CHECK_EQ(nseen, nexpect);
+
+    // Bounds checking
+    int ix[RANK];
+    for (int k=0; k<RANK; ++k) ix[k] = low[k];
+    ix[RANK-1] = high[RANK-1];
+    CHECK_THROWS(std::out_of_range, tiled(ix, throw_range_error()));
+}
+
+void test_tiled_errors()
+{
+    int const low[2] = {0, 0}, high[2] = {8, 8}, bad_tile[2] = {4, 3}, tile[2] = {4, 4};
+    CHECK_THROWS(std::invalid_argument, (TiledArray<double, 2>::allocate(low, high, bad_tile)));
+    int const zero_tile[2] = {0, 4}, negative_tile[2] = {4, -4};
+    CHECK_THROWS(std::invalid_argument, (TiledArray<double, 2>::allocate(low, high, zero_tile)));
+    CHECK_THROWS(std::invalid_argument, (TiledArray<double, 2>::allocate(low, high, negative_tile)));
+    CHECK_THROWS(std::invalid_argument, (TiledArray<double, 2>::size(low, high, zero_tile)));
+    CHECK_THROWS(std::invalid_argument, to_tiled(make_array<double, 2>(low, high, Layout::ROW), zero_tile));
+    CHECK_THROWS(std::invalid_argument, (TiledArray<double, 2>(MemoryBlock<char>(8), low, high, tile)));
+
+    TiledArray<double, 2> const tiled(TiledArray<double, 2>::allocate(low, high, tile));
+    int const other[2] = {9, 8};
+    Array<double, 2> const arr(make_array<double, 2>(low, other, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, copy(tiled, arr));
+}
+
+template<int RANK>
+void test_morton(int const *low, int const *high)
+{
+    MortonArray<double, RANK> const m(MortonArray<double, RANK>::allocate(low, high));
+
+    // The dimensions' code bits partition [0, bits)
+    uint64_t all = 0;
+    size_t padded = 1;
+    for (int k=0; k<RANK; ++k) {
+        CHECK((all & m.mask(k)) == 0);
+        all |= m.mask(k);
+        size_t p = 1;
+        while ((int)p < high[k] - low[k]) p <<= 1;
+        padded *= p;
+    }
+    CHECK_EQ(all + 1, (uint64_t)padded);
+    CHECK_EQ(m.memory().size_bytes(), padded * sizeof(double));
+
+    // code() agrees with a plain bit deposit; decode() inverts it; next()
+    // steps one coordinate
+    std::vector<bool> seen(padded, false);
+    int nbad_code = 0, nbad_decode = 0, nbad_next = 0, ndup = 0;
+    for_each_index<RANK>(low, high, [&](int const *ix) {
+        uint64_t const c = m.code(ix);
+        uint64_t expect = 0;
+        for (int k=0; k<RANK; ++k) expect |= layout_detail::deposit_bits(ix[k] - low[k], m.mask(k));
+        nbad_code += (c != expect);
+        if (c < padded) {
+            ndup += seen[c];
+            seen[c] = true;
+        }
+
+        int back[RANK];
+        m.decode(c, back);
+        for (int k=0; k<RANK; ++k) nbad_decode += (back[k] != ix[k]);
+
+        for (int k=0; k<RANK; ++k) {
+            if (ix[k] + 1 >= high[k]) continue;
+            int nx[RANK];
+            for (int j=0; j<RANK; ++j) nx[j] = ix[j];
+            ++nx[k];
+            nbad_next += (m.next(c, k) != m.code(nx));
+        }
+    });
+    CHECK_EQ(nbad_code, 0);
+    CHECK_EQ(nbad_decode, 0);
+    CHECK_EQ(nbad_next, 0);
+    CHECK_EQ(ndup, 0);
+
+    for (Layout const layout : all_layouts) {
+        Array<double, RANK> const ref(make_pattern<double, RANK>(low, high, layout));
+        MortonArray<double, RANK> const morton(to_morton(ref));
+        CHECK_EQ(nbad<RANK>(low, high, morton, ref), 0);
+        CHECK_EQ(nbad<RANK>(low, high, to_strided(morton), ref), 0);
+
+        Array<double, RANK> const dst(make_array<double, RANK>(low, high,
+            layout == Layout::ROW ? Layout::REVERSED : Layout::ROW));
+        copy(dst, morton);
+        CHECK_EQ(nbad<RANK>(low, high, dst, ref), 0);
+    }
+
+    int ix[RANK];
+    for (int k=0; k<RANK; ++k) ix[k] = low[k];
+    ix[0] = low[0] - 1;
+    CHECK_THROWS(std::out_of_range, m(ix, throw_range_error()));
+}
+
+void test_morton_errors()
+{
+    int const low[3] = {0, 0, 0}, high[3] = {1 << 22, 1 << 22, 1 << 20};    // 64 code bits
+    CHECK_THROWS(std::invalid_argument, (MortonArray<double, 3>(MemoryBlock<char>(8), low, high)));
+    int const small[3] = {5, 3, 1};
+    CHECK_THROWS(std::invalid_argument, (MortonArray<double, 3>(MemoryBlock<char>(8), low, small)));
+}
+
+}    // namespace
+
+
+int main()
+{
+#if defined(__BMI2__) && defined(__GNUC__)
+    if (!__builtin_cpu_supports("bmi2")) {
+        std::cerr << "CPU lacks BMI2; skipping" << std::endl;
+        return 77;
+    }
+#endif
+
+    {
+        int const low[2] = {-3, 5}, high[2] = {14, 26}, tile[2] = {4, 8};    // Padded edges
+        test_tiled<2>(low, high, tile);
+    }
+    {
+        int const low[2] = {0, 0}, high[2] = {16, 8}, tile[2] = {8, 4};      // Exact fit
+        test_tiled<2>(low, high, tile);
+    }
+    {
+        int const low[3] = {1, -2, 0}, high[3] = {6, 9, 13}, tile[3] = {2, 4, 4};
+        test_tiled<3>(low, high, tile);
+    }
+    {
+        int const low[1] = {-7}, high[1] = {30}, tile[1] = {16};
+        test_tiled<1>(low, high, tile);
+    }
+    test_tiled_errors();
+
+    {
+        int const low[2] = {-2, 3}, high[2] = {11, 9};    // 13x6 in a 16x8 code space
+        test_morton<2>(low, high);
+    }
+    {
+        int const low[3] = {0, 1, -4}, high[3] = {5, 18, 3};
+        test_morton<3>(low, high);
+    }
+    {
+        int const low[3] = {0, 0, 0}, high[3] = {8, 8, 8};
+        test_morton<3>(low, high);
+    }
+    {
+        int const low[1] = {3}, high[1] = {300};    // Spans two table bytes
+        test_morton<1>(low, high);
+    }
+    test_morton_errors();
+    return check_exit();
+}
@@ -0,0 +1,152 @@
+// Masked arrays: fill / transform / reduce / compact / expand vs plain
+// loops over an explicit mask, in every layout, for sparse, row-wrapping,
+// empty and full masks
+
+#include "blitz11_mask.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include <functional>
+
+
+namespace {
+
+typedef std::function<bool (int const *)> MaskFn;
+
+/** Mask array (1 = active) over [low, high) in the given layout */
+Array<int, 2> make_mask(int const *low, int const *high, Layout const layout, MaskFn const &active)
+{
+    Array<int, 2> m(make_array<int, 2>(low, high, layout));
+    for_each_index<2>(low, high, [&](int const *ix) { m(ix) = active(ix); });
+    return m;
+}
+
+void test_masked(int const *low, int const *high, MaskFn const &active)
+{
+    auto const pat = [](int const *ix) { return pattern<double, 2>(ix); };
+    auto const pat2 = [](int const *ix) { return pattern<double, 2>(ix) + 1000; };
+
+    // Expected results, from plain loops in row-major order
+    size_t count = 0;
+    double expect_sum = 0;
+    std::vector<double> expect_packed;
+    for_each_index<2>(low, high, [&](int const *ix) {
+        if (!active(ix)) return;
+        ++count;
+        expect_sum += pat(ix);
+        expect_packed.push_back(pat(ix));
+    });
+
+    for (Layout const ml : all_layouts) {
+        std::shared_ptr<Mask<> const> const mask(new Mask<>(make_mask(low, high, ml, active)));
+        CHECK_EQ(mask->count(), count);
+
+        // Runs never cross a row, and together cover exactly the active cells
+        int const n = high[1] - low[1];
+        size_t covered = 0;
+        for (auto const &run : mask->runs()) {
+            CHECK(run.len > 0);
+            CHECK((int)(run.pos % n) + run.len <= n);
+            for (int j=0; j<run.len; ++j) CHECK(mask->active(run.pos + j));
+            covered += run.len;
+        }
+        CHECK_EQ(covered, count);
+
+        // where() over the same values agrees with Mask(Array)
+        Array<int, 2> const marr(make_mask(low, high, ml, active));
+        std::shared_ptr<Mask<> const> const w(Mask<>::where(marr, [](int x) { return x > 0; }));
+        CHECK_EQ(w->count(), count);
+        CHECK_EQ(w->runs().size(), mask->runs().size());
+        for (size_t p=0; p<mask->size(); ++p) CHECK(w->active(p) == mask->active(p));
+
+        for (Layout const dl : all_layouts) {
+            for (Layout const sl : all_layouts) {
+                Array<double, 2> const a(make_pattern<double, 2>(low, high, sl));
+                Array<double, 2> const b(make_array<double, 2>(low, high,
+                    sl == Layout::ROW ? Layout::COLUMN : Layout::ROW));
+                for_each_index<2>(low, high, [&](int const *ix) { b(ix) = pat2(ix); });
+
+                Array<double, 2> const d(make_array<double, 2>(low, high, dl));
+                MaskedArray<double, 2> const md(d, mask);
+                auto const reset = [&]() { for_each_index<2>(low, high, [&](int const *ix) { d(ix) = -1; }); };
+                auto const nbad = [&](std::function<double (int const *)> const &on) {
+                    int nb = 0;
+                    for_each_index<2>(low, high, [&](int const *ix) {
+                        nb += !(d(ix) == (active(ix) ? on(ix) : -1.0));
+                    });
+                    return nb;
+                };
+
+                reset();
+                fill(md, 7.0);
+                CHECK_EQ(nbad([](int const *) { return 7.0; }), 0);
+
+                reset();
+                copy(md, a);
+                CHECK_EQ(nbad(pat), 0);
+
+                reset();
+                transform(md, a, [](double x) { return 2*x + 1; });
+                CHECK_EQ(nbad([&](int const *ix) { return 2*pat(ix) + 1; }), 0);
+
+                reset();
+                transform(md, a, b, [](double x, double y) { return x - 3*y; });
+                CHECK_EQ(nbad([&](int const *ix) { return pat(ix) - 3*pat2(ix); }), 0);
+
+                // Reductions and compaction in position order
+                MaskedArray<double, 2> const ma(a, mask);
+                CHECK_EQ(sum(ma), expect_sum);
+                CHECK_EQ(reduce(ma, size_t(0), [](size_t k, double) { return k + 1; }), count);
+
+                Array<double, 1> const packed(compact(ma));
+                CHECK_EQ((size_t)packed.dopes()[0].range[1], count);
+                int nb = 0;
+                for (int i=0; i<(int)count; ++i) nb += !(packed(&i) == expect_packed[i]);
+                CHECK_EQ(nb, 0);
+
+                reset();
+                expand(md, packed);
+                CHECK_EQ(nbad(pat), 0);
+            }
+        }
+    }
+}
+
+void test_errors()
+{
+    int const low[2] = {0, 0}, high[2] = {4, 5}, other[2] = {4, 6};
+    std::shared_ptr<Mask<> const> const mask(new Mask<>(make_mask(low, high, Layout::ROW,
+        [](int const *ix) { return ix[0] == ix[1]; })));
+    Array<double, 2> const wrong(make_array<double, 2>(low, other, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, (MaskedArray<double, 2>(wrong, mask)));
+
+    Array<double, 2> const d(make_array<double, 2>(low, high, Layout::ROW));
+    MaskedArray<double, 2> const md(d, mask);
+    CHECK_THROWS(std::invalid_argument, copy(md, wrong));
+
+    int const plow = 0, phigh = 3;
+    std::vector<Dope<int>> const pd(row_major_dopes(&plow, &phigh, 1));
+    Array<double, 1> const packed(allocate_block<double>(&pd[0], 1), pd);
+    CHECK_THROWS(std::invalid_argument, expand(md, packed));
+}
+
+}    // namespace
+
+
+int main()
+{
+    int const low[2] = {-2, 3}, high[2] = {7, 14};
+
+    // Scattered cells and runs of several lengths
+    test_masked(low, high, [](int const *ix) { return (ix[0]*7 + ix[1]*3) % 5 < 2; });
+
+    // Runs that wrap across rows: the last cells of one row and the
+    // first cells of the next are consecutive positions
+    test_masked(low, high, [&](int const *ix) { return ix[1] >= high[1]-3 || ix[1] < low[1]+2; });
+
+    test_masked(low, high, [](int const *) { return false; });
+    test_masked(low, high, [](int const *) { return true; });
+
+    test_errors();
+    return check_exit();
+}
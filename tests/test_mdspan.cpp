@@ -0,0 +1,126 @@
+// mdspan interoperability: layout_dope with negative strides and
+// non-zero bases, the standard layouts and their rejections, and
+// round trips through from_mdspan().  Built only where <mdspan> or
+// <experimental/mdspan> is available.
+
+#include "blitz11_mdspan.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Address of md's element (i, j) */
+template<class MdspanT>
+double *at(MdspanT const &md, int const i, int const j)
+    { return md.data_handle() + md.mapping()(i, j); }
+
+/** Number of elements at which md (indexed from 0) and arr (indexed
+from low) are not the same object */
+template<class MdspanT>
+int nbad(MdspanT const &md, Array<double, 2> const &arr, int const *low, int const *high)
+{
+    CHECK_EQ(md.extent(0), high[0] - low[0]);
+    CHECK_EQ(md.extent(1), high[1] - low[1]);
+    int n = 0;
+    for_each_index<2>(low, high, [&](int const *ix) {
+        n += (at(md, ix[0] - low[0], ix[1] - low[1]) != &arr(ix));
+    });
+    return n;
+}
+
+void test_layout_dope()
+{
+    int const low[2] = {-3, 4}, high[2] = {5, 11};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const arr(make_pattern<double, 2>(low, high, layout));
+        auto const md(to_mdspan(arr));
+        CHECK_EQ(nbad(md, arr, low, high), 0);
+
+        // data_handle() is the lowest-addressed element, and the mapping
+        // spans exactly the dense block
+        CHECK(md.data_handle() == reinterpret_cast<double *>(arr.memory().data()));
+        CHECK_EQ((size_t)md.mapping().required_span_size(), 8*7u);
+        CHECK(md.mapping().is_unique());
+        CHECK(md.mapping().is_exhaustive());
+
+        GeneralArray<double> const g(arr);
+        CHECK_EQ(nbad(to_mdspan<2>(g), arr, low, high), 0);
+        CHECK_THROWS(std::invalid_argument, to_mdspan<3>(g));
+    }
+
+    // A broadcast view is not unique
+    int const rlow[1] = {0}, rhigh[1] = {7};
+    Array<double, 1> const row(make_pattern<double, 1>(rlow, rhigh, Layout::REVERSED));
+    Array<double, 2> const bv(broadcast<2>(row, low, high));
+    auto const md(to_mdspan(bv));
+    CHECK(!md.mapping().is_unique());
+    CHECK(!md.mapping().is_exhaustive());
+    CHECK_EQ(nbad(md, bv, low, high), 0);
+}
+
+void test_standard_layouts()
+{
+    int const low[2] = {2, -1}, high[2] = {6, 8};
+    Array<double, 2> const row(make_pattern<double, 2>(low, high, Layout::ROW));
+    Array<double, 2> const col(make_pattern<double, 2>(low, high, Layout::COLUMN));
+    Array<double, 2> const rev(make_pattern<double, 2>(low, high, Layout::REVERSED));
+
+    CHECK_EQ(nbad(to_mdspan<blitz11_md::layout_stride>(row), row, low, high), 0);
+    CHECK_EQ(nbad(to_mdspan<blitz11_md::layout_stride>(col), col, low, high), 0);
+    CHECK_THROWS(std::invalid_argument, to_mdspan<blitz11_md::layout_stride>(rev));
+
+    CHECK_EQ(nbad(to_mdspan<blitz11_md::layout_right>(row), row, low, high), 0);
+    CHECK_THROWS(std::invalid_argument, to_mdspan<blitz11_md::layout_right>(col));
+    CHECK_THROWS(std::invalid_argument, to_mdspan<blitz11_md::layout_right>(rev));
+
+    CHECK_EQ(nbad(to_mdspan<blitz11_md::layout_left>(col), col, low, high), 0);
+    CHECK_THROWS(std::invalid_argument, to_mdspan<blitz11_md::layout_left>(row));
+    CHECK_THROWS(std::invalid_argument, to_mdspan<blitz11_md::layout_left>(rev));
+
+    // A strided sub-box is neither right nor left, but is strided
+    std::vector<Dope<int>> dopes(row.dopes());
+    dopes[1].range = {{0, 3}};
+    Array<double, 2> const sub(row.memory(), dopes);
+    int const slow[2] = {2, 0}, shigh[2] = {6, 3};
+    CHECK_EQ(nbad(to_mdspan<blitz11_md::layout_stride>(sub), sub, slow, shigh), 0);
+    CHECK_THROWS(std::invalid_argument, to_mdspan<blitz11_md::layout_right>(sub));
+}
+
+void test_from_mdspan()
+{
+    int const low[2] = {-3, 4}, high[2] = {5, 11};
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const arr(make_pattern<double, 2>(low, high, layout));
+        Array<double, 2> const back(from_mdspan(to_mdspan(arr), low));
+        int n = 0;
+        for_each_index<2>(low, high, [&](int const *ix) { n += (&back(ix) != &arr(ix)); });
+        CHECK_EQ(n, 0);
+        CHECK(back.dopes()[0].stride == arr.dopes()[0].stride);
+        CHECK(back.dopes()[1].stride == arr.dopes()[1].stride);
+
+        // Bounds checking covers exactly the borrowed span
+        int const over[2] = {high[0], low[1]};
+        CHECK_THROWS(std::out_of_range, back(over, throw_range_error()));
+    }
+
+    // A plain row-major mdspan over a buffer, indexed from 0
+    std::vector<double> buf(12);
+    for (size_t i=0; i<buf.size(); ++i) buf[i] = i;
+    blitz11_md::mdspan<double, blitz11_md::dextents<int, 2>> const md(buf.data(), 3, 4);
+    Array<double, 2> const arr(from_mdspan(md));
+    int const zlow[2] = {0, 0}, zhigh[2] = {3, 4};
+    CHECK_EQ(nbad(md, arr, zlow, zhigh), 0);
+    CHECK_EQ(arr.memory().size_bytes(), 12*sizeof(double));
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_layout_dope();
+    test_standard_layouts();
+    test_from_mdspan();
+    return check_exit();
+}
@@ -0,0 +1,153 @@
+// Allocation instrumentation: live/peak bytes, tags, size classes, detach() clones
+
+#include "blitz11.hpp"
+#include "check.hpp"
+
+#include <sstream>
+#include <thread>
+
+
+namespace {
+
+MemCounts tag_counts(std::string const &tag)
+{
+    MemStatsSnapshot const s(memstats_snapshot());
+    auto const it = s.by_tag.find(tag);
+    return it == s.by_tag.end() ? MemCounts() : it->second;
+}
+
+void test_size_class()
+{
+    CHECK_EQ(memstats_detail::size_class(0), 0);
+    CHECK_EQ(memstats_detail::size_class(1), 1);
+    CHECK_EQ(memstats_detail::size_class(2), 2);
+    CHECK_EQ(memstats_detail::size_class(3), 2);
+    CHECK_EQ(memstats_detail::size_class(4), 3);
+    CHECK_EQ(memstats_detail::size_class(1000), 10);
+    CHECK_EQ(memstats_detail::size_class(1024), 11);
+}
+
+void test_live_peak()
+{
+    MemStatsSnapshot const before(memstats_snapshot());
+    {
+        MemoryBlock<char> a(1000);
+        {
+            MemoryBlock<char> b(3000);
+            MemStatsSnapshot const s(memstats_snapshot());
+            CHECK_EQ(s.total.live_bytes, before.total.live_bytes + 4000);
+            CHECK_EQ(s.total.nalloc, before.total.nalloc + 2);
+            CHECK_EQ(s.total.live_blocks(), before.total.live_blocks() + 2);
+            CHECK_EQ(s.nalloc_by_class[10], before.nalloc_by_class[10] + 1);
+            CHECK_EQ(s.nalloc_by_class[12], before.nalloc_by_class[12] + 1);
+            CHECK_EQ(s.live_by_class[12], before.live_by_class[12] + 1);
+        }
+        MemStatsSnapshot const s(memstats_snapshot());
+        CHECK_EQ(s.total.live_bytes, before.total.live_bytes + 1000);
+        CHECK_EQ(s.total.nfree, before.total.nfree + 1);
+        CHECK(s.total.peak_bytes >= before.total.live_bytes + 4000);
+        CHECK_EQ(s.nalloc_by_class[12], before.nalloc_by_class[12] + 1);
+        CHECK_EQ(s.live_by_class[12], before.live_by_class[12]);
+        CHECK_EQ(s.live_by_class[10], before.live_by_class[10] + 1);
+
+        // Copies share; only the last one frees
+        MemoryBlock<char> const c(a);
+        CHECK_EQ(memstats_snapshot().total.nalloc, before.total.nalloc + 2);
+    }
+    MemStatsSnapshot const s(memstats_snapshot());
+    CHECK_EQ(s.total.live_bytes, before.total.live_bytes);
+    CHECK_EQ(s.total.nfree, before.total.nfree + 2);
+    CHECK_EQ(s.live_by_class[10], before.live_by_class[10]);
+
+    // Empty blocks are size class 0
+    { MemoryBlock<char> const e(0); }
+    CHECK_EQ(memstats_snapshot().nalloc_by_class[0], before.nalloc_by_class[0] + 1);
+}
+
+void test_tags()
+{
+    {
+        MemTag outer("outer");
+        MemoryBlock<char> a(100);
+        {
+            MemTag inner("inner");
+            MemoryBlock<char> b(200);
+            MemoryBlock<char> c(300);
+            CHECK_EQ(tag_counts("inner").live_bytes, 500u);
+            CHECK_EQ(tag_counts("inner").nalloc, 2u);
+        }
+        // Back to the outer tag; inner blocks are freed and stay counted there
+        MemoryBlock<char> d(50);
+        MemCounts const o(tag_counts("outer")), i(tag_counts("inner"));
+        CHECK_EQ(o.live_bytes, 150u);
+        CHECK_EQ(o.peak_bytes, 150u);
+        CHECK_EQ(o.nalloc, 2u);
+        CHECK_EQ(i.live_bytes, 0u);
+        CHECK_EQ(i.peak_bytes, 500u);
+        CHECK_EQ(i.nfree, 2u);
+    }
+    CHECK_EQ(tag_counts("outer").live_bytes, 0u);
+    CHECK_EQ(tag_counts("outer").live_blocks(), 0u);
+
+    // Untagged again
+    size_t const untagged = tag_counts("").nalloc;
+    { MemoryBlock<char> const a(10); }
+    CHECK_EQ(tag_counts("").nalloc, untagged + 1);
+    CHECK_EQ(tag_counts("outer").nalloc, 2u);
+
+    // Tags are per thread
+    MemTag tag("main");
+    std::thread([]() { MemoryBlock<char> const a(10); }).join();
+    CHECK_EQ(tag_counts("").nalloc, untagged + 2);
+    CHECK_EQ(tag_counts("main").nalloc, 0u);
+}
+
+void test_detach()
+{
+    MemStatsSnapshot const before(memstats_snapshot());
+    MemoryBlock<char> a(256);
+    a.set_copy_on_write();
+    {
+        MemoryBlock<char> b(a);
+        MemTag tag("clone");
+        CHECK(b.detach());
+        CHECK_EQ(tag_counts("clone").live_bytes, 256u);
+        CHECK_EQ(memstats_snapshot().total.live_bytes, before.total.live_bytes + 512);
+        CHECK(!b.detach());
+        CHECK_EQ(tag_counts("clone").nalloc, 1u);
+    }
+    CHECK_EQ(tag_counts("clone").live_bytes, 0u);
+    CHECK_EQ(memstats_snapshot().total.live_bytes, before.total.live_bytes + 256);
+
+    // Borrowed memory is not counted, but its clone is
+    char buf[64];
+    MemoryBlock<char> borrowed(buf, sizeof(buf));
+    CHECK_EQ(memstats_snapshot().total.nalloc, before.total.nalloc + 2);
+    borrowed.set_copy_on_write();
+    CHECK(borrowed.detach());
+    CHECK_EQ(memstats_snapshot().total.nalloc, before.total.nalloc + 3);
+    CHECK_EQ(memstats_snapshot().total.live_bytes, before.total.live_bytes + 320);
+}
+
+void test_print()
+{
+    MemTag tag("printed");
+    MemoryBlock<char> const a(100);
+    std::ostringstream os;
+    os << memstats_snapshot();
+    CHECK(os.str().find("printed") != std::string::npos);
+    CHECK(os.str().find("(total)") != std::string::npos);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_size_class();
+    test_live_peak();
+    test_tags();
+    test_detach();
+    test_print();
+    return check_exit();
+}
@@ -0,0 +1,26 @@
+// Allocation instrumentation compiled out: instrumented code still builds and runs
+
+#include "blitz11.hpp"
+#include "blitz11_memstats.hpp"
+#include "check.hpp"
+
+#include <sstream>
+
+#ifdef BLITZ11_MEMSTATS
+#error "test_memstats_off must be built without BLITZ11_MEMSTATS"
+#endif
+
+
+int main()
+{
+    std::ostringstream os;
+    {
+        MemTag tag("temperature");
+        MemStatsDumper dump(os, 10000);
+        MemoryBlock<char> const a(100);
+        CHECK_EQ(a.size_bytes(), 100u);
+        os << memstats_snapshot();
+    }
+    CHECK(os.str().empty());
+    return check_exit();
+}
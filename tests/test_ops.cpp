@@ -0,0 +1,120 @@
+// Elementwise ops and whole-array reductions vs plain index loops,
+// for Array and GeneralArray, over mixed layouts
+
+#include "blitz11_ops.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Number of indices at which arr(ix) != expect(ix) */
+template<int RANK, class ArrayT, class FnT>
+int nbad(int const *low, int const *high, ArrayT const &arr, FnT const &expect)
+{
+    int n = 0;
+    for_each_index<RANK>(low, high, [&](int const *ix) { n += !(arr(ix) == expect(ix)); });
+    return n;
+}
+
+template<int RANK>
+void test_rank(int const *low, int const *high)
+{
+    auto const pat = [](int const *ix) { return pattern<double, RANK>(ix); };
+    double naive_sum = 0, naive_min = 1e300, naive_max = -1e300;
+    for_each_index<RANK>(low, high, [&](int const *ix) {
+        naive_sum += pat(ix);
+        naive_min = std::min(naive_min, pat(ix));
+        naive_max = std::max(naive_max, pat(ix));
+    });
+
+    for (Layout const sl : all_layouts) {
+        Array<double, RANK> const src(make_pattern<double, RANK>(low, high, sl));
+        GeneralArray<double> const gsrc(src);
+
+        CHECK_EQ(sum(src), naive_sum);
+        CHECK_EQ(min_value(src), naive_min);
+        CHECK_EQ(max_value(src), naive_max);
+        CHECK_EQ(sum(gsrc), naive_sum);
+        CHECK_EQ(min_value(gsrc), naive_min);
+        CHECK_EQ(max_value(gsrc), naive_max);
+        CHECK_EQ(reduce(src, 0L, [](long n, double x) { return n + (x > 100); }),
+            reduce(gsrc, 0L, [](long n, double x) { return n + (x > 100); }));
+
+        double fe_sum = 0;
+        for_each(src, [&fe_sum](double x) { fe_sum += x; });
+        CHECK_EQ(fe_sum, naive_sum);
+
+        for (Layout const dl : all_layouts) {
+            Array<double, RANK> const dst(make_array<double, RANK>(low, high, dl));
+            GeneralArray<double> const gdst(dst);
+            Array<double, RANK> const other(make_pattern<double, RANK>(low, high,
+                dl == Layout::ROW ? Layout::REVERSED : Layout::ROW));
+
+            fill(dst, 7.0);
+            CHECK_EQ(nbad<RANK>(low, high, dst, [](int const *) { return 7.0; }), 0);
+            copy(dst, src);
+            CHECK_EQ(nbad<RANK>(low, high, dst, pat), 0);
+            transform(dst, src, [](double x) { return 2*x + 1; });
+            CHECK_EQ(nbad<RANK>(low, high, dst, [&](int const *ix) { return 2*pat(ix) + 1; }), 0);
+            transform(dst, src, other, [](double a, double b) { return a - 3*b; });
+            CHECK_EQ(nbad<RANK>(low, high, dst, [&](int const *ix) { return -2*pat(ix); }), 0);
+
+            fill(gdst, -1.0);
+            CHECK_EQ(nbad<RANK>(low, high, dst, [](int const *) { return -1.0; }), 0);
+            copy(gdst, gsrc);
+            CHECK_EQ(nbad<RANK>(low, high, dst, pat), 0);
+            transform(gdst, gsrc, [](double x) { return x / 2; });
+            CHECK_EQ(nbad<RANK>(low, high, dst, [&](int const *ix) { return pat(ix) / 2; }), 0);
+            transform(gdst, gsrc, GeneralArray<double>(other), [](double a, double b) { return a + b; });
+            CHECK_EQ(nbad<RANK>(low, high, dst, [&](int const *ix) { return 2*pat(ix); }), 0);
+        }
+    }
+}
+
+void test_broadcast()
+{
+    int const low[2] = {0, 1}, high[2] = {3, 5};
+    int const rlow[1] = {1}, rhigh[1] = {5};
+    Array<double, 1> const row(make_pattern<double, 1>(rlow, rhigh, Layout::REVERSED));
+    Array<double, 2> const rows(broadcast<2>(row, low, high));
+    for (Layout const layout : all_layouts) {
+        Array<double, 2> const dst(make_array<double, 2>(low, high, layout));
+        transform(dst, make_pattern<double, 2>(low, high, Layout::COLUMN), rows,
+            [](double a, double b) { return a * b; });
+        CHECK_EQ(nbad<2>(low, high, dst, [&](int const *ix)
+            { return pattern<double, 2>(ix) * pattern<double, 1>(ix + 1); }), 0);
+    }
+}
+
+void test_edge_cases()
+{
+    int const low[2] = {0, 0}, high[2] = {3, 0};
+    Array<double, 2> const empty(make_array<double, 2>(low, high, Layout::ROW));
+    CHECK_EQ(sum(empty), 0.0);
+    fill(empty, 1.0);    // No-op, no crash
+
+    int const l1[1] = {0}, h1[1] = {4}, h2[2] = {2, 2};
+    GeneralArray<double> const a(make_pattern<double, 1>(l1, h1, Layout::ROW));
+    GeneralArray<double> const b(make_pattern<double, 2>(low, h2, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, copy(a, b));
+    CHECK_THROWS(std::invalid_argument, transform(a, a, b, [](double x, double) { return x; }));
+}
+
+}    // namespace
+
+
+int main()
+{
+    int const l1[1] = {-3}, h1[1] = {9};
+    test_rank<1>(l1, h1);
+    int const l2[2] = {1, -2}, h2[2] = {5, 4};
+    test_rank<2>(l2, h2);
+    int const l3[3] = {-1, 0, 2}, h3[3] = {3, 5, 5};
+    test_rank<3>(l3, h3);
+    int const l5[5] = {0, 1, 0, -1, 2}, h5[5] = {2, 4, 3, 2, 4};
+    test_rank<5>(l5, h5);
+    test_broadcast();
+    test_edge_cases();
+    return check_exit();
+}
@@ -0,0 +1,108 @@
+// Access-pattern profiling (built with BLITZ11_ACCESS_PROFILE): report
+// contents, labels shared by views, and profile keys reused by arrays
+// of another shape
+
+#include "blitz11.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include <sstream>
+
+
+namespace {
+
+/** Lines of report about the array labeled label */
+std::string section(std::string const &report, std::string const &label)
+{
+    size_t const begin = report.find("  " + label + " @");
+    if (begin == std::string::npos) return "";
+    size_t end = begin;
+    for (;;) {    // Up to the next array's line, indented by two
+        end = report.find('\n', end);
+        if (end == std::string::npos || report.compare(end+1, 4, "    ") != 0) break;
+        ++end;
+    }
+    return report.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+}
+
+void test_report()
+{
+    int const low[2] = {0, 0}, high[2] = {16, 16};
+    Array<double, 2> const rows(make_array<double, 2>(low, high, Layout::ROW));
+    Array<double, 2> const cols(make_array<double, 2>(low, high, Layout::ROW));
+    Array<double, 2> const diag(make_array<double, 2>(low, high, Layout::ROW));
+    access_profile_label(rows, "rows");
+    access_profile_label(cols, "cols");
+    access_profile_label(diag, "diag");
+
+    int ix[2];
+    for (ix[0]=0; ix[0]<16; ++ix[0]) for (ix[1]=0; ix[1]<16; ++ix[1]) rows(ix) = 1;
+    for (ix[1]=0; ix[1]<16; ++ix[1]) for (ix[0]=0; ix[0]<16; ++ix[0]) cols(ix) = 1;
+    for (int i=0; i<16; ++i) { ix[0] = ix[1] = i; diag(ix) = 1; }    // Both indices change together
+
+    std::ostringstream os;
+    access_profile_report(os);
+    std::string const report(os.str());
+    CHECK(section(report, "rows").find("256 accesses") != std::string::npos);
+    CHECK(section(report, "rows").find("MISMATCH") == std::string::npos);
+    CHECK(section(report, "cols").find("MISMATCH: inner loop runs over dim 0") != std::string::npos);
+    CHECK(section(report, "diag").find("16 accesses") != std::string::npos);
+    CHECK(section(report, "diag").find("MISMATCH") == std::string::npos);
+}
+
+/** A view with a different origin (here, broadcast) reports under the
+label of the array whose memory it shares */
+void test_view_label()
+{
+    int const rlow[2] = {7, 0}, rhigh[2] = {8, 4};
+    int const low[2] = {0, 0}, high[2] = {3, 4};
+    Array<double, 2> const row(make_pattern<double, 2>(rlow, rhigh, Layout::ROW));
+    access_profile_label(row, "row");
+    Array<double, 2> const view(broadcast<2>(row, low, high));
+    CHECK(view.memory().base() != row.memory().base());
+
+    double sum = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { sum += view(ix); });
+
+    std::ostringstream os;
+    access_profile_report(os);
+    std::string const report(os.str());
+    CHECK(section(report, "row").find("12 accesses, extent [3 4]") != std::string::npos);
+    CHECK(report.find("(unlabeled)") == std::string::npos);
+}
+
+void test_reused_key()
+{
+    // A rank-1 array, then a rank-3 one at the same memory and dopes
+    // addresses, as when a freed array's storage is reused
+    static double memory[64];
+    Dope<int> dopes[3];
+    dopes[0].range = {{0, 64}};
+    dopes[0].stride = 1;
+    for (int i=0; i<64; ++i) profile_detail::record(memory, dopes, &i, 1, sizeof(double));
+
+    for (int k=0; k<3; ++k) {
+        dopes[k].range = {{0, 4}};
+        dopes[k].stride = (k == 0 ? 16 : k == 1 ? 4 : 1);
+    }
+    int const low[3] = {0, 0, 0}, high[3] = {4, 4, 4};
+    for_each_index<3>(low, high, [&](int const *ix)
+        { profile_detail::record(memory, dopes, ix, 3, sizeof(double)); });
+
+    std::ostringstream os;
+    access_profile_report(os);
+    std::string const report(os.str());
+    CHECK(report.find("64 accesses, extent [4 4 4], stride bytes [128 32 8]") != std::string::npos);
+    CHECK(report.find("extent [64]") == std::string::npos);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_report();
+    test_view_label();
+    test_reused_key();
+    return check_exit();
+}
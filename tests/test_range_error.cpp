@@ -0,0 +1,127 @@
+// Bounds errors: throw_range_error() messages and backtraces for Array, StaticArray, MemoryBlock
+
+#include "blitz11.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** what() of the std::out_of_range thrown by f, or "" if none */
+template<class F>
+std::string what_of(F const &f)
+{
+    try {
+        f();
+    } catch (std::out_of_range const &e) {
+        return e.what();
+    }
+    return std::string();
+}
+
+bool contains(std::string const &s, std::string const &part)
+    { return s.find(part) != std::string::npos; }
+
+/** Checks the first line of a throw_range_error() message */
+void check_message(std::string const &what, std::string const &head)
+{
+    CHECK(contains(what, head));
+    if (!contains(what, head)) std::cerr << "  got: " << what << std::endl;
+}
+
+void test_array()
+{
+    RangeErrorFn const * const err = throw_range_error();
+    int const low[3] = {-2, 1, 0}, high[3] = {5, 4, 6};
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const arr(make_pattern<double, 3>(low, high, layout));
+        int const ok[3] = {4, 3, 0}, over[3] = {0, 4, 0}, under[3] = {-3, 1, 0}, last[3] = {0, 1, 6};
+        CHECK(what_of([&] { arr(ok, err); }).empty());
+        check_message(what_of([&] { arr(over, err); }), "Indexing error: dimension 1, index 4 outside [1, 4)");
+        check_message(what_of([&] { arr(under, err); }), "Indexing error: dimension 0, index -3 outside [-2, 5)");
+        check_message(what_of([&] { arr(last, err); }), "Indexing error: dimension 2, index 6 outside [0, 6)");
+    }
+
+    // Unchecked access does not consult a RangeErrorFn
+    Array<double, 3> const arr(make_pattern<double, 3>(low, high, Layout::ROW));
+    int const ok[3] = {0, 1, 0};
+    CHECK(what_of([&] { arr(ok); }).empty());
+}
+
+void test_static()
+{
+    RangeErrorFn const * const err = throw_range_error();
+
+    typedef StaticArray<double, int, StaticDim<1,5,5>, StaticDim<-2,3,1>> S;
+    S const s(S::allocate());
+    int const over[2] = {5, 0}, under[2] = {1, -3};
+    check_message(what_of([&] { s(over, err); }), "Indexing error: dimension 0, index 5 outside [1, 5)");
+    check_message(what_of([&] { s(under, err); }), "Indexing error: dimension 1, index -3 outside [-2, 3)");
+
+    typedef StaticArray<double, int, StaticDim<0,3,1>, DynamicDim> M;
+    std::array<Dope<int>, 1> dyn;
+    dyn[0].range = {{-4, 3}};
+    dyn[0].stride = 3;
+    M const m(M::allocate(dyn));
+    int const bad_dynamic[2] = {0, 3};
+    check_message(what_of([&] { m(bad_dynamic, err); }), "Indexing error: dimension 1, index 3 outside [-4, 3)");
+}
+
+void test_memory()
+{
+    RangeErrorFn const * const err = throw_range_error();
+    MemoryBlock<char> const mem(MemoryBlock<char>(16).rebased(4));
+    CHECK(what_of([&] { mem.index_bytes(-4, err); }).empty());
+    CHECK(what_of([&] { mem.index_bytes(11, err); }).empty());
+    check_message(what_of([&] { mem.index_bytes(12, err); }), "Memory error: dimension 0, index 16 outside [0, 16)");
+    check_message(what_of([&] { mem.index_bytes(-5, err); }), "Memory error: dimension 0, index -1 outside [0, 16)");
+}
+
+/** A custom RangeErrorFn gets the raw details; if it returns, the
+access goes ahead (here, still inside the block) */
+void test_custom()
+{
+    std::string type;
+    int idim = -1;
+    long lo = 0, hi = 0, index = 0;
+    RangeErrorFn const fn([&](std::string const &t, int d, long l, long h, long i) {
+        type = t; idim = d; lo = l; hi = h; index = i;
+    });
+    int const low[2] = {0, 0}, high[2] = {3, 4};
+    Array<double, 2> const arr(make_pattern<double, 2>(low, high, Layout::ROW));
+    int const bad[2] = {1, 4};
+    CHECK_EQ(arr(bad, &fn), arr(bad));
+    CHECK(type == "Indexing");
+    CHECK_EQ(idim, 1);
+    CHECK_EQ(lo, 0);
+    CHECK_EQ(hi, 4);
+    CHECK_EQ(index, 4);
+}
+
+void test_backtrace()
+{
+    int const low[1] = {0}, high[1] = {2};
+    Array<double, 1> const arr(make_pattern<double, 1>(low, high, Layout::ROW));
+    int const bad[1] = {2};
+    std::string const what(what_of([&] { arr(bad, throw_range_error()); }));
+    std::string const trace(range_error_backtrace());
+#ifdef BLITZ11_HAVE_BACKTRACE
+    CHECK(!trace.empty());
+    CHECK(contains(what, trace));
+#else
+    CHECK(trace.empty());
+#endif
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_array();
+    test_static();
+    test_memory();
+    test_custom();
+    test_backtrace();
+    return check_exit();
+}
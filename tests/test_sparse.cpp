@@ -0,0 +1,166 @@
+// Gather/scatter and CSR products vs a dense matrix, by position, in
+// every layout
+
+#include "blitz11_sparse.hpp"
+#include "blitz11_ops.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+int const ilow[2] = {1, -2}, ihigh[2] = {5, 4};    // 24 inputs
+int const olow[2] = {0, 3}, ohigh[2] = {3, 8};     // 15 outputs
+size_t const nin = 24, nout = 15;
+
+/** Elements of arr in position (row-major index) order */
+template<int RANK>
+std::vector<double> by_position(Array<double, RANK> const &arr, int const *low, int const *high)
+{
+    std::vector<double> ret;
+    for_each_index<RANK>(low, high, [&](int const *ix) { ret.push_back(arr(ix)); });
+    return ret;
+}
+
+/** Pseudo-random triplets with duplicates; the first and last output
+rows and one in the middle are left empty */
+struct Triplets {
+    std::vector<int> rows, cols;
+    std::vector<double> vals;
+    std::vector<std::vector<double>> dense;
+
+    Triplets(size_t const nrows, size_t const ncols, size_t const n)
+        : dense(nrows, std::vector<double>(ncols, 0.0))
+    {
+        unsigned seed = 12345;
+        auto const next = [&seed](unsigned const m) { seed = seed * 1103515245u + 12345u; return (seed >> 8) % m; };
+        while (rows.size() < n) {
+            int const r = next(nrows), c = next(ncols);
+            if (r == 0 || r == (int)nrows-1 || r == (int)nrows/2) continue;
+            double const v = (int)next(9) - 4 + 0.5;
+            rows.push_back(r);
+            cols.push_back(c);
+            vals.push_back(v);
+            dense[r][c] += v;
+        }
+    }
+};
+
+void test_spmv()
+{
+    Triplets const t(nout, nin, 70);
+    CsrMatrix<double> const A(CsrMatrix<double>::from_triplets(
+        nout, nin, t.rows.data(), t.cols.data(), t.vals.data(), t.vals.size()));
+    CHECK_EQ(A.nnz(), 70u);
+    CsrMatrix<double> const At(A.transpose());
+
+    for (Layout const il : all_layouts) {
+        Array<double, 2> const in(make_pattern<double, 2>(ilow, ihigh, il));
+        std::vector<double> const x(by_position(in, ilow, ihigh));
+        for (Layout const ol : all_layouts) {
+            Array<double, 2> const out(make_pattern<double, 2>(olow, ohigh, ol));
+            std::vector<double> const y0(by_position(out, olow, ohigh));
+            for (int const nthreads : {1, 3, 0}) {
+                for (bool const accumulate : {false, true}) {
+                    copy(out, make_pattern<double, 2>(olow, ohigh, Layout::ROW));
+                    spmv(out, A, in, nthreads, accumulate);
+                    std::vector<double> const y(by_position(out, olow, ohigh));
+                    int nbad = 0;
+                    for (size_t r=0; r<nout; ++r) {
+                        double expect = (accumulate ? y0[r] : 0.0);
+                        for (size_t c=0; c<nin; ++c) expect += t.dense[r][c] * x[c];
+                        nbad += !(y[r] == expect);
+                    }
+                    CHECK_EQ(nbad, 0);
+                }
+            }
+
+            // Transpose: outputs back onto the inputs' shape
+            Array<double, 2> const back(make_array<double, 2>(ilow, ihigh, ol));
+            spmv(back, At, out, 2);
+            std::vector<double> const y(by_position(out, olow, ohigh)), z(by_position(back, ilow, ihigh));
+            int nbad = 0;
+            for (size_t c=0; c<nin; ++c) {
+                double expect = 0;
+                for (size_t r=0; r<nout; ++r) expect += t.dense[r][c] * y[r];
+                nbad += !(z[c] == expect);
+            }
+            CHECK_EQ(nbad, 0);
+        }
+    }
+
+    Array<double, 2> const in(make_pattern<double, 2>(ilow, ihigh, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, spmv(in, A, in));
+    int const bad_row[1] = {15}, col[1] = {0};
+    double const val[1] = {1};
+    CHECK_THROWS(std::invalid_argument, CsrMatrix<double>::from_triplets(nout, nin, bad_row, col, val, 1));
+}
+
+void test_gather_scatter()
+{
+    // idx[i]: a permutation of the inputs' positions, then some repeats
+    std::vector<int> idx(nin);
+    for (size_t i=0; i<nin; ++i) idx[i] = (i * 7 + 3) % nin;
+    for (Layout const il : all_layouts) {
+        Array<double, 2> const in(make_pattern<double, 2>(ilow, ihigh, il));
+        std::vector<double> const x(by_position(in, ilow, ihigh));
+        for (Layout const ol : all_layouts) {
+            Array<double, 2> const out(make_array<double, 2>(olow, ohigh, ol));
+            gather(out, in, idx.data());
+            std::vector<double> const y(by_position(out, olow, ohigh));
+            int nbad = 0;
+            for (size_t i=0; i<nout; ++i) nbad += !(y[i] == x[idx[i]]);
+            CHECK_EQ(nbad, 0);
+
+            // 1-D gather (affine) from the same input
+            int const l1[1] = {-4}, h1[1] = {20};
+            Array<double, 1> const flat(make_array<double, 1>(l1, h1, ol));
+            gather(flat, in, idx.data());
+            nbad = 0;
+            std::vector<double> const f(by_position(flat, l1, h1));
+            for (size_t i=0; i<nin; ++i) nbad += !(f[i] == x[idx[i]]);
+            CHECK_EQ(nbad, 0);
+
+            // Scatter the 1-D copy back through the permutation
+            Array<double, 2> const restored(make_array<double, 2>(ilow, ihigh, ol));
+            scatter(restored, idx.data(), flat);
+            CHECK(by_position(restored, ilow, ihigh) == x);
+        }
+    }
+}
+
+void test_scatter_add()
+{
+    Triplets const t(nout, nin, 90);
+    for (Layout const il : all_layouts) {
+        Array<double, 2> const in(make_pattern<double, 2>(ilow, ihigh, il));
+        std::vector<double> const x(by_position(in, ilow, ihigh));
+        for (Layout const ol : all_layouts) {
+            Array<double, 2> const out(make_pattern<double, 2>(olow, ohigh, ol));
+            std::vector<double> const y0(by_position(out, olow, ohigh));
+            for (int const nthreads : {1, 3}) {
+                copy(out, make_pattern<double, 2>(olow, ohigh, Layout::COLUMN));
+                scatter_add(out, t.rows.data(), t.vals.data(), in, t.cols.data(), t.vals.size(), nthreads);
+                std::vector<double> const y(by_position(out, olow, ohigh));
+                int nbad = 0;
+                for (size_t r=0; r<nout; ++r) {
+                    double expect = y0[r];
+                    for (size_t c=0; c<nin; ++c) expect += t.dense[r][c] * x[c];
+                    nbad += !(y[r] == expect);
+                }
+                CHECK_EQ(nbad, 0);
+            }
+        }
+    }
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_spmv();
+    test_gather_scatter();
+    test_scatter_add();
+    return check_exit();
+}
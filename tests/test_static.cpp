@@ -0,0 +1,94 @@
+// StaticArray: compile-time / runtime mixed layouts vs the equivalent
+// runtime Array, bounds errors on static dimensions, and storage size
+
+#include "blitz11.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+/** Every element of sa is the same object as in sa.array() */
+template<int RANK, class StaticT>
+int nbad(StaticT const &sa, int const *low, int const *high)
+{
+    Array<double, RANK> const arr(sa.array());
+    int n = 0;
+    for_each_index<RANK>(low, high, [&](int const *ix) { n += (&sa(ix) != &arr(ix)); });
+    return n;
+}
+
+void test_all_static()
+{
+    // 4x5 row-major with non-zero lower bounds
+    typedef StaticArray<double, int, StaticDim<1,5,5>, StaticDim<-2,3,1>> S;
+    static_assert(S::RANK == 2 && S::NDYNAMIC == 0, "all static");
+    static_assert(sizeof(S) == sizeof(MemoryBlock<char>), "static dims take no storage");
+
+    S const sa(S::allocate());
+    int const low[2] = {1, -2}, high[2] = {5, 3};
+    CHECK_EQ(nbad<2>(sa, low, high), 0);
+    std::vector<Dope<int>> const dopes(sa.dopes());
+    CHECK(dopes[0].range[0] == 1 && dopes[0].range[1] == 5 && dopes[0].stride == 5);
+    CHECK(dopes[1].range[0] == -2 && dopes[1].range[1] == 3 && dopes[1].stride == 1);
+    CHECK_EQ(sa.memory().size_bytes(), 20*sizeof(double));
+
+    for_each_index<2>(low, high, [&](int const *ix) { sa(ix) = pattern<double, 2>(ix); });
+    int n = 0;
+    for_each_index<2>(low, high, [&](int const *ix) { n += !(sa.array()(ix) == pattern<double, 2>(ix)); });
+    CHECK_EQ(n, 0);
+
+    // Bounds errors on static dimensions, either side
+    RangeErrorFn const * const err = throw_range_error();
+    int const over[2] = {5, 0}, under[2] = {1, -3}, ok[2] = {4, 2};
+    CHECK_THROWS(std::out_of_range, sa(over, err));
+    CHECK_THROWS(std::out_of_range, sa(under, err));
+    sa(ok, err) = 1;
+}
+
+void test_mixed()
+{
+    // Column-major static inner dims around a runtime outer dim, with a
+    // negative runtime stride
+    typedef StaticArray<double, int, StaticDim<0,3,1>, DynamicDim, StaticDim<0,2,3>> S;
+    static_assert(S::RANK == 3 && S::NDYNAMIC == 1, "one dynamic dim");
+    static_assert(sizeof(S) > sizeof(MemoryBlock<char>), "dynamic dims are stored");
+
+    std::array<Dope<int>, 1> dyn;
+    dyn[0].range = {{-4, 3}};
+    dyn[0].stride = -6;
+    S const sa(S::allocate(dyn));
+    int const low[3] = {0, -4, 0}, high[3] = {3, 3, 2};
+    CHECK_EQ(nbad<3>(sa, low, high), 0);
+    CHECK(sa.dopes()[1].stride == -6);
+    CHECK_EQ(sa.memory().size_bytes(), 3*7*2*sizeof(double));
+
+    // Distinct elements
+    for_each_index<3>(low, high, [&](int const *ix) { sa(ix) = pattern<double, 3>(ix); });
+    int n = 0;
+    for_each_index<3>(low, high, [&](int const *ix) { n += !(sa(ix) == pattern<double, 3>(ix)); });
+    CHECK_EQ(n, 0);
+
+    RangeErrorFn const * const err = throw_range_error();
+    int const bad_static[3] = {3, 0, 0}, bad_dynamic[3] = {0, 3, 0}, bad_last[3] = {0, 0, -1};
+    CHECK_THROWS(std::out_of_range, sa(bad_static, err));
+    CHECK_THROWS(std::out_of_range, sa(bad_dynamic, err));
+    CHECK_THROWS(std::out_of_range, sa(bad_last, err));
+
+    // A view over existing memory
+    typedef StaticArray<double, int, DynamicDim, DynamicDim> D;
+    Array<double, 2> const arr(make_pattern<double, 2>(low, high, Layout::COLUMN));
+    std::array<Dope<int>, 2> const d2 = {{arr.dopes()[0], arr.dopes()[1]}};
+    D const view(arr.memory(), d2);
+    CHECK_EQ(nbad<2>(view, low, high), 0);
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_all_static();
+    test_mixed();
+    return check_exit();
+}
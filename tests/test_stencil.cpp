@@ -0,0 +1,152 @@
+// Stencils vs plain loops over the interior, in every layout;
+// temporally blocked sweeps vs one apply_stencil() per sweep
+
+#include "blitz11_stencil.hpp"
+#include "blitz11_ops.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+
+namespace {
+
+int const low[3] = {-2, 0, 1}, high[3] = {9, 13, 8};
+
+/** Lopsided, so a flipped offset or dimension changes the result */
+struct Skewed {
+    double operator()(StencilView<double> const &u) const
+    {
+        return u(-1,0,0) + 3*u(2,0,0) + 5*u(0,1,0) + 7*u(0,0,-1) + 0.5*u(0,0,0);
+    }
+};
+std::array<int,3> const skewed_radius = {{2, 1, 1}};
+
+double at(Array<double, 3> const &arr, int const i, int const j, int const k)
+{
+    int const ix[3] = {i, j, k};
+    return arr(ix);
+}
+
+/** Checks dst against Skewed applied by hand over src's interior
+clipped to [dlow, dhigh); other points must still hold sentinel */
+void check_skewed(Array<double, 3> const &dst, Array<double, 3> const &src,
+    int const *dlow, int const *dhigh, double const sentinel)
+{
+    int nbad = 0;
+    for_each_index<3>(dlow, dhigh, [&](int const *ix) {
+        bool inside = true;
+        for (int k=0; k<3; ++k)
+            inside = inside && ix[k] >= low[k] + skewed_radius[k] && ix[k] < high[k] - skewed_radius[k];
+        int const i = ix[0], j = ix[1], k = ix[2];
+        double const expect = !inside ? sentinel
+            : at(src,i-1,j,k) + 3*at(src,i+2,j,k) + 5*at(src,i,j+1,k) + 7*at(src,i,j,k-1) + 0.5*at(src,i,j,k);
+        nbad += !(dst(ix) == expect);
+    });
+    CHECK_EQ(nbad, 0);
+}
+
+void test_apply()
+{
+    for (Layout const sl : all_layouts) {
+        Array<double, 3> const src(make_pattern<double, 3>(low, high, sl));
+        for (Layout const dl : all_layouts) {
+            Array<double, 3> const dst(make_array<double, 3>(low, high, dl));
+            for (int const nthreads : {1, 3}) {
+                for (std::array<int,3> const block : {std::array<int,3>{{0,0,0}}, std::array<int,3>{{3,2,5}}}) {
+                    StencilOptions opt;
+                    opt.block = block;
+                    opt.nthreads = nthreads;
+                    fill(dst, -7.0);
+                    apply_stencil(dst, src, skewed_radius, Skewed(), opt);
+                    check_skewed(dst, src, low, high, -7.0);
+                }
+            }
+
+            // Destination covering only part of the interior, and some halo
+            int const dlow[3] = {3, -1, 2}, dhigh[3] = {11, 6, 5};
+            Array<double, 3> const part(make_array<double, 3>(dlow, dhigh, dl));
+            fill(part, -7.0);
+            apply_stencil(part, src, skewed_radius, Skewed());
+            check_skewed(part, src, dlow, dhigh, -7.0);
+        }
+    }
+}
+
+void test_interior()
+{
+    Array<double, 3> const src(make_pattern<double, 3>(low, high, Layout::COLUMN));
+    Array<double, 3> const in(interior(src, skewed_radius));
+    for (int k=0; k<3; ++k) {
+        CHECK_EQ(in.dopes()[k].range[0], low[k] + skewed_radius[k]);
+        CHECK_EQ(in.dopes()[k].range[1], high[k] - skewed_radius[k]);
+    }
+    int const ix[3] = {3, 4, 5};
+    CHECK(&in(ix) == &src(ix));
+    std::vector<Dope<int>> const thin(interior(src, {{6, 0, 0}}).dopes());
+    CHECK_EQ(thin[0].range[1] - thin[0].range[0], 0);
+}
+
+/** Checks iterate_stencil() against nsteps calls to apply_stencil() */
+template<class KernelT>
+void check_sweeps(Layout const layout, std::array<int,3> const &radius, KernelT const &kernel,
+    int const nsteps, SweepOptions const &opt)
+{
+    Array<double, 3> const a(make_pattern<double, 3>(low, high, layout));
+    Array<double, 3> const b(make_pattern<double, 3>(low, high, layout));
+    Array<double, 3> const ra(make_pattern<double, 3>(low, high, layout));
+    Array<double, 3> const rb(make_pattern<double, 3>(low, high, layout));
+
+    Array<double, 3> const &ret(iterate_stencil(a, b, radius, kernel, nsteps, opt));
+    CHECK(&ret == (nsteps % 2 ? &b : &a));
+
+    Array<double, 3> const * const ref[2] = {&ra, &rb};
+    for (int step=0; step<nsteps; ++step)
+        apply_stencil(*ref[(step+1) % 2], *ref[step % 2], radius, kernel);
+
+    int nbad = 0;
+    for_each_index<3>(low, high, [&](int const *ix)
+        { nbad += !(a(ix) == ra(ix)) + !(b(ix) == rb(ix)); });
+    CHECK_EQ(nbad, 0);
+}
+
+void test_iterate()
+{
+    auto const smooth = [](StencilView<double> const &u) {
+        return (u(-1,0,0) + u(1,0,0) + u(0,-1,0) + u(0,1,0) + u(0,0,-1) + u(0,0,1) + 2*u(0,0,0)) / 8;
+    };
+    std::array<int,3> const unit = {{1, 1, 1}};
+
+    for (Layout const layout : all_layouts) {
+        for (int const nsteps : {0, 1, 2, 5, 9}) {
+            SweepOptions opt;
+            check_sweeps(layout, unit, smooth, nsteps, opt);
+            check_sweeps(layout, skewed_radius, Skewed(), nsteps, opt);
+
+            // Small tiles: many tiles per diagonal, steps straddling tiles
+            opt.tile = {{3, 2}};
+            for (int const steps : {1, 3, 4}) {
+                for (int const nthreads : {1, 3}) {
+                    opt.steps_per_tile = steps;
+                    opt.nthreads = nthreads;
+                    check_sweeps(layout, unit, smooth, nsteps, opt);
+                    check_sweeps(layout, skewed_radius, Skewed(), nsteps, opt);
+                }
+            }
+        }
+    }
+
+    int const h2[3] = {9, 13, 7};
+    Array<double, 3> const a(make_pattern<double, 3>(low, high, Layout::ROW));
+    Array<double, 3> const b(make_pattern<double, 3>(low, h2, Layout::ROW));
+    CHECK_THROWS(std::invalid_argument, iterate_stencil(a, b, unit, smooth, 1));
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_apply();
+    test_interior();
+    test_iterate();
+    return check_exit();
+}
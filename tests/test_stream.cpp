@@ -0,0 +1,107 @@
+// SlabReader: slabs along every dimension, gapped files, foreign byte order
+
+#include "blitz11_stream.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+#include "blockfile_util.hpp"
+
+#include <complex>
+
+
+namespace {
+
+int const low[3] = {-2, 1, 0}, high[3] = {5, 4, 6};
+
+/** Reads fname slab by slab along dim; checks every slab against ref
+and that the slabs tile the file exactly */
+template<class T>
+void check_slabs(std::string const &fname, Array<T, 3> const &ref,
+    int const dim, int const slab_extent, bool const read_ahead)
+{
+    SlabReader<T, 3> reader(fname, dim, slab_extent, read_ahead);
+    int next_low = low[dim], nbad = 0;
+    while (reader.next()) {
+        CHECK_EQ(reader.low(), next_low);
+        CHECK(reader.high() - reader.low() <= slab_extent);
+        Array<T, 3> const slab(reader.slab());
+        int slo[3], shi[3];
+        for (int k=0; k<3; ++k) { slo[k] = low[k]; shi[k] = high[k]; }
+        slo[dim] = reader.low();
+        shi[dim] = reader.high();
+        for_each_index<3>(slo, shi, [&](int const *ix) { nbad += !(slab(ix) == ref(ix)); });
+        next_low = reader.high();
+    }
+    CHECK_EQ(next_low, high[dim]);
+    CHECK_EQ(nbad, 0);
+}
+
+void test_slabs()
+{
+    std::string const fname(scratch_file("s.b11"));
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const ref(make_pattern<double, 3>(low, high, layout));
+        save(fname, ref);
+        for (int dim=0; dim<3; ++dim)
+            for (int const extent : {1, 2, 100})
+                for (bool const read_ahead : {false, true})
+                    check_slabs(fname, ref, dim, extent, read_ahead);
+    }
+}
+
+/** A file whose smallest stride is 2, so no dimension is contiguous */
+void test_gapped()
+{
+    std::string const fname(scratch_file("sg.b11"));
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const ref(make_pattern<double, 3>(low, high, layout));
+        std::vector<Dope<int>> dopes(ref.dopes());
+        for (Dope<int> &d : dopes) d.stride *= 2;
+        Array<double, 3> const gapped(allocate_block<double>(&dopes[0], 3), dopes);
+        for_each_index<3>(low, high, [&](int const *ix) { gapped(ix) = ref(ix); });
+        save(fname, gapped);
+        for (int dim=0; dim<3; ++dim)
+            for (int const extent : {1, 3})
+                check_slabs(fname, ref, dim, extent, true);
+    }
+}
+
+void test_foreign()
+{
+    typedef std::complex<double> C;
+    Array<C, 3> const ref(make_array<C, 3>(low, high, Layout::COLUMN));
+    for_each_index<3>(low, high, [&](int const *ix)
+        { ref(ix) = C(pattern<double, 3>(ix), -0.5 * ix[1]); });
+    std::string const fname(scratch_file("sc.b11"));
+    save(fname, ref);
+    make_foreign(fname, sizeof(double));
+    for (int dim=0; dim<3; ++dim) check_slabs(fname, ref, dim, 2, true);
+}
+
+void test_misuse()
+{
+    int const lo[3] = {0, 0, 0}, hi[3] = {2, 2, 2};
+    std::string const fname(scratch_file("m.b11"));
+    save(fname, make_pattern<double, 3>(lo, hi, Layout::ROW));
+
+    SlabReader<double, 3> reader(fname, 0, 1);
+    CHECK_THROWS(std::logic_error, reader.slab());
+    CHECK_THROWS(std::logic_error, reader.low());
+    CHECK_THROWS(std::logic_error, reader.high());
+
+    CHECK_THROWS(std::invalid_argument, (SlabReader<double, 3>(fname, 3, 1)));
+    CHECK_THROWS(std::invalid_argument, (SlabReader<double, 3>(fname, 0, 0)));
+    CHECK_THROWS(std::runtime_error, (SlabReader<double, 2>(fname, 0, 1)));
+    CHECK_THROWS(std::runtime_error, (SlabReader<float, 3>(fname, 0, 1)));
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_slabs();
+    test_gapped();
+    test_foreign();
+    test_misuse();
+    return check_exit();
+}
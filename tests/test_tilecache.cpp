@@ -0,0 +1,169 @@
+// TiledFileArray: reads, write-back through eviction and flush, hints,
+// read errors
+
+#include "blitz11_tilecache.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+
+#include <algorithm>
+
+
+namespace {
+
+int const low[3] = {-2, 1, 0}, high[3] = {5, 4, 6};
+
+/** Tiles of 5 doubles, 3 held: most accesses cross tiles and evict */
+size_t const tile_bytes = 5 * sizeof(double), max_tiles = 3;
+
+void test_read()
+{
+    std::string const fname(scratch_file("t.b11"));
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const ref(make_pattern<double, 3>(low, high, layout));
+        save(fname, ref);
+        for (AccessHint const hint : {AccessHint::RANDOM, AccessHint::SEQUENTIAL}) {
+            TiledFileArray<double, 3> tiled(fname, tile_bytes, max_tiles);
+            tiled.set_access_hint(hint, 2);
+            int nbad = 0;
+            for_each_index<3>(low, high, [&](int const *ix)
+                { nbad += !(tiled(ix, throw_range_error()) == ref(ix)); });
+            CHECK_EQ(nbad, 0);
+            CHECK(tiled.stats().evictions > 0);
+        }
+    }
+}
+
+void test_write()
+{
+    std::string const fname(scratch_file("w.b11"));
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const ref(make_pattern<double, 3>(low, high, layout));
+        save(fname, ref);
+        {
+            TiledFileArray<double, 3> tiled(fname, tile_bytes, max_tiles, true);
+            for_each_index<3>(low, high, [&](int const *ix) {
+                if (ix[2] % 2 == 0) tiled.set(ix, -ref(ix));
+            });
+            CHECK(tiled.stats().writebacks > 0);    // Evicted dirty tiles
+            tiled.flush();
+        }
+        Array<double, 3> const back(load<double>(fname));
+        int nbad = 0;
+        for_each_index<3>(low, high, [&](int const *ix)
+            { nbad += !(back(ix) == (ix[2] % 2 == 0 ? -ref(ix) : ref(ix))); });
+        CHECK_EQ(nbad, 0);
+    }
+}
+
+void test_prefetch()
+{
+    std::string const fname(scratch_file("p.b11"));
+    Array<double, 3> const ref(make_pattern<double, 3>(low, high, Layout::ROW));
+    save(fname, ref);
+    TiledFileArray<double, 3> tiled(fname, tile_bytes, max_tiles);
+    int const plo[3] = {0, 1, 0}, phi[3] = {1, 2, 6};    // One row of 6: two tiles at most
+    tiled.prefetch(plo, phi);
+    CHECK(tiled.stats().prefetches > 0);
+    tiled.reset_stats();
+    for_each_index<3>(plo, phi, [&](int const *ix) { CHECK(tiled(ix) == ref(ix)); });
+    CHECK_EQ(tiled.stats().misses, 0u);
+}
+
+/** Distinct tiles holding the elements of [plo, phi) of ref, as saved */
+size_t tiles_of(Array<double, 3> const &ref, int const *plo, int const *phi)
+{
+    std::vector<size_t> tiles;
+    for_each_index<3>(plo, phi, [&](int const *ix) {
+        tiles.push_back((reinterpret_cast<char const *>(&ref(ix)) - ref.memory().data()) / tile_bytes);
+    });
+    std::sort(tiles.begin(), tiles.end());
+    return std::unique(tiles.begin(), tiles.end()) - tiles.begin();
+}
+
+/** A strided box loads only the tiles its elements are in, not the
+whole span between them */
+void test_prefetch_strided()
+{
+    std::string const fname(scratch_file("ps.b11"));
+    for (Layout const layout : all_layouts) {
+        Array<double, 3> const ref(make_pattern<double, 3>(low, high, layout));
+        save(fname, ref);
+        int const plo[3] = {-2, 2, 4}, phi[3] = {5, 4, 5};    // 7x2x1, far apart in ROW order
+        size_t const expect = tiles_of(ref, plo, phi);
+
+        TiledFileArray<double, 3> tiled(fname, tile_bytes, 100);
+        tiled.prefetch(plo, phi);
+        CHECK_EQ(tiled.stats().prefetches, expect);
+        tiled.reset_stats();
+        for_each_index<3>(plo, phi, [&](int const *ix) { CHECK(tiled(ix) == ref(ix)); });
+        CHECK_EQ(tiled.stats().misses, 0u);
+
+        // Capped at the cache size; a second prefetch loads nothing new
+        TiledFileArray<double, 3> small(fname, tile_bytes, max_tiles);
+        small.prefetch(plo, phi);
+        CHECK_EQ(small.stats().prefetches, std::min(expect, max_tiles));
+        small.reset_stats();
+        int const one_lo[3] = {-2, 2, 4}, one_hi[3] = {-1, 3, 5};
+        small.prefetch(one_lo, one_hi);
+        CHECK_EQ(small.stats().prefetches, 0u);
+    }
+}
+
+/** A failed tile read leaves nothing stale behind */
+void test_read_error()
+{
+    std::string const fname(scratch_file("e.b11"));
+    int const l1[1] = {0}, h1[1] = {20};
+    Array<double, 1> const ref(make_pattern<double, 1>(l1, h1, Layout::ROW));
+    save(fname, ref);
+    uint64_t const data_offset = read_block_info(fname).header.data_offset;
+
+    for (size_t const ntiles : {size_t(1), size_t(3)}) {
+        TiledFileArray<double, 1> tiled(fname, tile_bytes, ntiles);
+        int const in0 = 2, in1 = 7;    // Tiles 0 and 1
+        CHECK(tiled(&in0) == ref(&in0));
+
+        // Tile 1 can no longer be read
+        CHECK(::truncate(fname.c_str(), data_offset + tile_bytes) == 0);
+        CHECK_THROWS(std::runtime_error, tiled(&in1));
+        CHECK_THROWS(std::runtime_error, tiled(&in1));    // Not served stale bytes
+        CHECK(tiled(&in0) == ref(&in0));
+        save(fname, ref);
+        CHECK(tiled(&in1) == ref(&in1));
+    }
+}
+
+void test_misuse()
+{
+    std::string const fname(scratch_file("m.b11"));
+    save(fname, make_pattern<double, 3>(low, high, Layout::ROW));
+    TiledFileArray<double, 3> tiled(fname, tile_bytes, max_tiles);
+    int const ix[3] = {0, 1, 0}, bad[3] = {5, 1, 0};
+    CHECK_THROWS(std::logic_error, tiled.set(ix, 1.0));
+    CHECK_THROWS(std::out_of_range, tiled(bad, throw_range_error()));
+    CHECK_THROWS(std::runtime_error, (TiledFileArray<double, 2>(fname)));
+    CHECK_THROWS(std::runtime_error, (TiledFileArray<float, 3>(fname)));
+
+    // Elements would straddle tiles if the origin is not element-aligned
+    int const l1[1] = {0}, h1[1] = {16};
+    std::vector<Dope<int>> const dopes(row_major_dopes(l1, h1, 1));
+    Array<double, 1> const odd(MemoryBlock<char>(136).rebased(4), dopes);
+    for_each_index<1>(l1, h1, [&](int const *ix) { odd(ix) = ix[0]; });
+    std::string const oname(scratch_file("o.b11"));
+    save(oname, odd);
+    CHECK_THROWS(std::runtime_error, (TiledFileArray<double, 1>(oname, 64)));
+}
+
+}    // namespace
+
+
+int main()
+{
+    test_read();
+    test_write();
+    test_prefetch();
+    test_prefetch_strided();
+    test_read_error();
+    test_misuse();
+    return check_exit();
+}